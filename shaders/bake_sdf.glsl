@@ -0,0 +1,51 @@
+#version 430 core
+#include "hg_sdf.glsl"
+
+// Compute shader behind bakeScene() (src/sdf_bake.cpp). Stage 0 evaluates
+// the centre of every cell to find the ones near the surface, stage 1 fills
+// one brick per work group.
+
+const float MAX_DIST_TO_TRAVEL = 100.0;
+
+#include "baked_sdf.glsl"
+#include "scene.glsl"
+
+layout (local_size_x = BAKED_BRICK_SIZE, local_size_y = BAKED_BRICK_SIZE, local_size_z = BAKED_BRICK_SIZE) in;
+
+layout (std430, binding = 5) readonly buffer bakeJobs {
+    ivec4 jobs[];       // x volume, yzw cell
+};
+
+layout (std430, binding = 6) writeonly buffer bakeCenters {
+    float centers[];
+};
+
+layout (r16f, binding = 0) writeonly uniform image3D bakedAtlasImage;
+
+uniform int u_stage;
+uniform int u_firstJob;
+uniform int u_jobCount;
+
+void main() {
+    if (u_stage == 0) {
+        int job = u_firstJob + int(gl_WorkGroupID.x * gl_WorkGroupSize.x * gl_WorkGroupSize.y * gl_WorkGroupSize.z + gl_LocalInvocationIndex);
+        if (job >= u_jobCount) {
+            return;
+        }
+        BakedVolume v = volumes[jobs[job].x];
+        vec3 pos = v.min.xyz + (vec3(jobs[job].yzw) + 0.5) * v.min.w;
+        centers[job] = evalPrimitiveAnalytic(prims[v.primitive], pos);
+    } else {
+        int job = u_firstJob + int(gl_WorkGroupID.x);
+        BakedVolume v = volumes[jobs[job].x];
+        ivec3 cell = jobs[job].yzw;
+        int brick = bakedCells[v.dims.w + cell.x + v.dims.x * (cell.y + v.dims.y * cell.z)].brick;
+        ivec3 origin = ivec3(brick & 1023, (brick >> 10) & 1023, brick >> 20);
+
+        // Samples sit on the cell corners and faces, so neighbouring bricks share their border values
+        vec3 corner = vec3(gl_LocalInvocationID) / float(BAKED_BRICK_SIZE - 1);
+        vec3 pos = v.min.xyz + (vec3(cell) + corner) * v.min.w;
+        float d = evalPrimitiveAnalytic(prims[v.primitive], pos);
+        imageStore(bakedAtlasImage, origin + ivec3(gl_LocalInvocationID), vec4(d));
+    }
+}
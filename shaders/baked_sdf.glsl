@@ -0,0 +1,63 @@
+// Baked distance volumes for static fractals, built by bakeScene() in
+// src/sdf_bake.cpp. Layouts must match src/sdf_bake.h.
+//
+// A volume is a grid of cells over the primitive's bounds. Cells near the
+// surface own a brick of BAKED_BRICK_SIZE^3 distance samples in the atlas
+// texture; every other cell only stores a lower bound for its whole extent.
+
+#define BAKED_BRICK_SIZE 8
+
+struct BakedVolume {
+    vec4 min;          // xyz corner, w cell size
+    ivec4 dims;        // xyz cells, w first cell in bakedCells
+    int primitive;
+    float errorBound;  // largest overestimate of trilinear interpolation, already subtracted
+    float band;        // below this plus sdfTolerance the analytic SDF is evaluated, see bakedBand()
+    int pad;
+};
+
+struct BakedCell {
+    float distance;    // lower bound over the cell when there is no brick
+    int brick;         // atlas origin packed as x | y << 10 | z << 20, or -1
+};
+
+layout (std430, binding = 3) readonly buffer bakedVolumes {
+    BakedVolume volumes[];
+};
+
+layout (std430, binding = 4) readonly buffer bakedCellData {
+    BakedCell bakedCells[];
+};
+
+layout (binding = 1) uniform sampler3D bakedAtlas;
+
+// Lower bound of the distance to the baked primitive. The samples are exact
+// distances, so for a 1-Lipschitz SDF interpolating them overestimates by at
+// most the distance to the farthest brick corner, errorBound.
+float bakedDistance(int volume, vec3 pos) {
+    BakedVolume v = volumes[volume];
+    vec3 halfSize = 0.5 * v.min.w * vec3(v.dims.xyz);
+    float outside = fBox(pos - v.min.xyz - halfSize, halfSize);
+    if (outside > 0.0) {
+        return outside;
+    }
+
+    vec3 local = (pos - v.min.xyz) / v.min.w;
+    ivec3 cell = min(ivec3(local), v.dims.xyz - 1);
+    BakedCell c = bakedCells[v.dims.w + cell.x + v.dims.x * (cell.y + v.dims.y * cell.z)];
+    if (c.brick < 0) {
+        return c.distance;
+    }
+
+    vec3 origin = vec3(c.brick & 1023, (c.brick >> 10) & 1023, c.brick >> 20);
+    vec3 uvw = origin + 0.5 + (local - vec3(cell)) * float(BAKED_BRICK_SIZE - 1);
+    return texture(bakedAtlas, uvw / vec3(textureSize(bakedAtlas, 0))).r - v.errorBound;
+}
+
+// Below this distance the analytic SDF is evaluated instead. The baked value
+// is only a lower bound, up to twice errorBound short, which is fine to step
+// by but not where the distance itself is used: soft shadows read penumbrae
+// off distances up to their sdfTolerance, so the band grows by it.
+float bakedBand(int volume) {
+    return volumes[volume].band + sdfTolerance;
+}
@@ -0,0 +1,36 @@
+// Camera model shared by the scene (rCam in fragment.glsl) and the temporal
+// resolve (taa.glsl). uv is in getUV() units: pixels from the centre of the
+// frame divided by its height.
+
+// Distance of the image plane, in uv units
+float cameraZoom(float scroll) {
+    return max(0.5,(scroll*0.05)+0.5);
+}
+
+// Ray direction through uv for a camera looking along camTarget
+vec3 cameraRay(vec2 uv, vec3 camTarget, float scroll) {
+    float zoom = cameraZoom(scroll);
+    vec3 forward = normalize(camTarget),
+        right = normalize(cross(forward, vec3(0, 1., 0))),
+        up = cross(right, forward),
+        center = forward*zoom,
+        intersection = center + uv.x*right + uv.y*up,
+        dir = normalize(intersection);
+    return dir;
+}
+
+// Inverse of cameraRay: xy is the uv that dir passes through, z > 0 when dir
+// points in front of the camera
+vec3 cameraProject(vec3 dir, vec3 camTarget, float scroll) {
+    float zoom = cameraZoom(scroll);
+    vec3 forward = normalize(camTarget),
+        right = normalize(cross(forward, vec3(0, 1., 0))),
+        up = cross(right, forward);
+    float z = dot(dir, forward);
+    return vec3(zoom * vec2(dot(dir, right), dot(dir, up)) / z, z);
+}
+
+// Width of one pixel at distance dist along a ray, for a frame height pixels tall
+float cameraPixelSize(float dist, float height, float scroll) {
+    return dist / (height * cameraZoom(scroll));
+}
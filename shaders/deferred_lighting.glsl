@@ -0,0 +1,141 @@
+#version 430 core
+
+// Lighting pass of the deferred path (src/deferred_shading.h). Shades the
+// surface each G-buffer pixel holds with the lights light_cull.glsl kept for
+// its tile, in the same order as shadeSurface(), so the result matches the
+// forward pass. Writes the same outputs as fragment.glsl. AO and shadows
+// come from the reduced resolution passes when they are enabled
+// (src/occlusion_passes.h), upsampled with a bilateral filter.
+
+#include "hg_sdf.glsl"
+#include "occlusion.glsl"
+
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out float HitDistance;
+
+uniform vec3 u_camPos;
+uniform vec3 u_camTarget;
+uniform int u_flashlight;
+uniform int u_tilesX;   // light culling tiles per row this frame
+uniform ivec2 u_size;   // pixels of this frame
+uniform int u_aoScale;      // AO buffer resolution divisor, 1 uses the G-buffer's AO
+uniform int u_shadowScale;  // shadow buffer resolution divisor, 1 traces the shadows here
+uniform int u_shadowLights; // lights with a shadow slot, the flashlight gets the next one
+
+uniform sampler2D programTexture1;
+layout (binding = 6) uniform sampler2D u_gNormalMaterial;
+layout (binding = 7) uniform sampler2D u_gHitDistance;
+layout (binding = 8) uniform sampler2D u_gPositionAO;
+layout (binding = 9) uniform sampler2D u_ao;
+layout (binding = 10) uniform sampler2DArray u_shadows;
+
+const float MAX_DIST_TO_TRAVEL = 100.0; // as in fragment.glsl
+
+vec2 minID(vec2 res1, vec2 res2) {
+    return (res1.x < res2.x) ? res1 : res2;
+}
+
+#include "baked_sdf.glsl"
+#include "scene.glsl"
+
+// Shadow rays see the same scene as the forward pass
+vec2 calcSDF(vec3 pos) {
+    return calcSceneSDF(pos);
+}
+
+#include "lighting.glsl"
+
+layout (std430, binding = 8) readonly buffer tileLightMasks {
+    uint lightMasks[];
+};
+
+// Bilateral upsampling from a 1/scale buffer: the four nearest texels with
+// bilinear weights, each scaled down by how far its anchor pixel is from this
+// pixel's tangent plane and how different its normal is, so nothing bleeds
+// across silhouettes or creases
+const ivec2 UPSAMPLE_TAPS[4] = ivec2[4](ivec2(0, 0), ivec2(1, 0), ivec2(0, 1), ivec2(1, 1));
+
+vec4 upsampleWeights(ivec2 pixel, int scale, vec3 pos, float dist, vec3 normal, out ivec2 texels[4]) {
+    vec2 f = (vec2(pixel) - float(scale / 2)) / float(scale);
+    ivec2 base = ivec2(floor(f));
+    f -= vec2(base);
+    vec4 bilinear = vec4((1.0 - f.x) * (1.0 - f.y), f.x * (1.0 - f.y), (1.0 - f.x) * f.y, f.x * f.y);
+
+    ivec2 last = (u_size + scale - 1) / scale - 1;
+    vec4 weights;
+    for (int i = 0; i < 4; i++) {
+        texels[i] = clamp(base + UPSAMPLE_TAPS[i], ivec2(0), last);
+        ivec2 anchor = occlusionAnchor(texels[i], scale, u_size);
+        vec3 anchorPos = texelFetch(u_gPositionAO, anchor, 0).xyz;
+        vec3 anchorNormal = texelFetch(u_gNormalMaterial, anchor, 0).xyz;
+        float planeDist = abs(dot(anchorPos - pos, normal));
+        float depthWeight = exp(-planeDist / (OCCLUSION_PLANE_TOLERANCE * dist));
+        float normalWeight = pow(max(dot(anchorNormal, normal), 0.0), 8.0);
+        // the small bilinear share keeps the sum above zero when nothing matches
+        weights[i] = bilinear[i] * (depthWeight * normalWeight + 0.0001);
+    }
+    return weights / (weights.x + weights.y + weights.z + weights.w);
+}
+
+float upsampleShadow(int slot, ivec2 texels[4], vec4 weights) {
+    int layer = slot / SHADOW_SLOTS_PER_LAYER;
+    int c = slot % SHADOW_SLOTS_PER_LAYER;
+    float shadow = 0.0;
+    for (int i = 0; i < 4; i++) {
+        shadow += weights[i] * texelFetch(u_shadows, ivec3(texels[i], layer), 0)[c];
+    }
+    return shadow;
+}
+
+void main() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float dist = texelFetch(u_gHitDistance, pixel, 0).r;
+
+    vec3 col = vec3(0.005);
+    if (dist<MAX_DIST_TO_TRAVEL) {
+        vec4 normalVal = texelFetch(u_gNormalMaterial, pixel, 0);
+        vec4 positionAO = texelFetch(u_gPositionAO, pixel, 0);
+        vec3 pos = positionAO.xyz;
+        vec3 normal = normalVal.xyz;
+        vec3 rDirRef = reflect(normalize(pos - u_camPos), normal);
+        vec3 material = getMaterial(pos, normalVal.w, normal, 0.5);
+
+        float ambientOcc = positionAO.w;
+        if (u_aoScale > 1) {
+            ivec2 texels[4];
+            vec4 weights = upsampleWeights(pixel, u_aoScale, pos, dist, normal, texels);
+            ambientOcc = 0.0;
+            for (int i = 0; i < 4; i++) {
+                ambientOcc += weights[i] * texelFetch(u_ao, texels[i], 0).r;
+            }
+        }
+        ivec2 shadowTexels[4];
+        vec4 shadowWeights = vec4(0.0);
+        if (u_shadowScale > 1) {
+            shadowWeights = upsampleWeights(pixel, u_shadowScale, pos, dist, normal, shadowTexels);
+        }
+
+        int first = ((pixel.y / LIGHT_TILE) * u_tilesX + pixel.x / LIGHT_TILE) * LIGHT_MASK_WORDS;
+        for (int word = 0; word < LIGHT_MASK_WORDS; word++) {
+            uint bits = lightMasks[first + word];
+            while (bits != 0u) {
+                int bit = findLSB(bits);
+                bits &= bits - 1u;
+                int index = word*32 + bit;
+                float shadow = u_shadowScale > 1 && index < u_shadowLights
+                             ? upsampleShadow(index, shadowTexels, shadowWeights)
+                             : lightShadow(lights[index], pos);
+                col += calcLightShadowed(lights[index], pos, normal, rDirRef, ambientOcc, material, 0.5, shadow);
+            }
+        }
+        if (u_flashlight>0) {
+            float shadow = u_shadowScale > 1 ? upsampleShadow(u_shadowLights, shadowTexels, shadowWeights)
+                                             : lightShadow(flashlight(), pos);
+            col += calcLightShadowed(flashlight(), pos, normal, rDirRef, ambientOcc, material, 0.5, shadow);
+        }
+        col = clamp(col, 0.0, 1.0);
+    }
+
+    FragColor = vec4(pow(col, vec3(1.0 / 2.2)), 1.0);
+    HitDistance = dist;
+}
@@ -0,0 +1,61 @@
+#version 430 core
+
+// Depth prepass (src/depth_prepass.h). One fragment per tile of
+// u_tile x u_tile pixels of the scene pass. It marches a cone around the
+// tile's centre ray that contains every primary ray of the tile, and stores
+// how far all of them can skip without passing the surface. rMarch in
+// fragment.glsl starts there, so the empty space in front of a tile is
+// crossed once instead of once per pixel.
+
+#include "hg_sdf.glsl"
+#include "camera.glsl"
+
+layout (location = 0) out float SafeDistance;
+
+uniform vec2 u_resolution;  // of the scene pass
+uniform float u_scroll;
+uniform vec3 u_camPos;
+uniform vec3 u_camTarget;
+uniform int u_tile;
+
+const int PREPASS_STEPS = 128;
+const float MAX_DIST_TO_TRAVEL = 100.0; // as in fragment.glsl
+
+vec2 minID(vec2 res1, vec2 res2) {
+    return (res1.x < res2.x) ? res1 : res2;
+}
+
+#include "baked_sdf.glsl"
+#include "scene.glsl"
+
+vec2 tileUV(vec2 pixel) {
+    return (pixel - 0.5 * u_resolution) / u_resolution.y;
+}
+
+void main() {
+    // The tile's pixels plus one on every side, supersampling and the
+    // temporal jitter offset rays by less than that
+    vec2 lo = floor(gl_FragCoord.xy) * float(u_tile) - 1.0;
+    vec2 hi = lo + float(u_tile) + 2.0;
+    vec3 axis = cameraRay(tileUV(0.5 * (lo + hi)), u_camTarget, u_scroll);
+
+    // At distance t every ray of the tile is within t*spread of the axis. The
+    // widest ray goes through a corner, the cone's section is convex.
+    float spread = 0.0;
+    spread = max(spread, length(cameraRay(tileUV(lo), u_camTarget, u_scroll) - axis));
+    spread = max(spread, length(cameraRay(tileUV(hi), u_camTarget, u_scroll) - axis));
+    spread = max(spread, length(cameraRay(tileUV(vec2(lo.x, hi.y)), u_camTarget, u_scroll) - axis));
+    spread = max(spread, length(cameraRay(tileUV(vec2(hi.x, lo.y)), u_camTarget, u_scroll) - axis));
+
+    // A step s keeps every ray's points within d of the sampled axis point:
+    // (t + s)*spread + s <= d. Stop once the cone is about as wide as the
+    // free space around it.
+    float t = 0.0;
+    for (int i = 0; i < PREPASS_STEPS && t < MAX_DIST_TO_TRAVEL; i++) {
+        float d = calcSceneSDF(u_camPos + axis * t).x;
+        float s = (d - t * spread) / (1.0 + spread);
+        if (s < 0.05 * t * spread + 0.0001) break;
+        t += s;
+    }
+    SafeDistance = min(t, MAX_DIST_TO_TRAVEL);
+}
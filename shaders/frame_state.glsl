@@ -0,0 +1,16 @@
+// Everything the scene pass needs to know about the frame, in one uniform
+// block written once per frame just before the draw (FrameState in
+// src/frame_state.h, the layouts must match)
+layout (std140, binding = 0) uniform FrameState {
+    vec2 u_resolution;
+    vec2 u_jitter;      // subpixel offset of the temporal mode's ray
+    vec3 u_camPos;
+    float u_time;
+    vec3 u_camTarget;
+    float u_scroll;
+    int u_flashlight;
+    int u_renderMode;
+    int u_prepassTile;  // pixels per depth prepass texel, 0 without the prepass
+    int u_deferred;     // write the G-buffer instead of shading (deferred_shading.h), 2 leaves out the AO
+    int u_relaxedMarch; // over-relax rMarch() and let getNormal() reuse its last sample (primary_rays.glsl)
+};
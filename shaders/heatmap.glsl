@@ -0,0 +1,48 @@
+// March statistics for the heatmap render modes (src/march_stats.h). The
+// includer counts rMarch iterations in marchSteps and scene SDF evaluations
+// in sdfCalls; heatmap() turns one pixel's counts into a colour and adds them
+// to the frame totals in the atomic counter buffer.
+//
+// GL 4.3 only promises 8 atomic counters per stage, and has no atomic add
+// for them. So each total is kept as base 16 digits, one counter per digit,
+// and a pixel increments each digit counter by its own digit: at most 15
+// increments per digit instead of one per step.
+
+#define HEATMAP_STEPS_MODE 6   // primary ray rMarch iterations
+#define HEATMAP_CALLS_MODE 7   // calcSDF calls, shading included
+#define HEATMAP_STEP_DIGITS 3  // MARCH_STATS_STEP_DIGITS in src/march_stats.h
+#define HEATMAP_CALL_DIGITS 4  // a pixel counts at most 16^4 - 1 calls
+
+layout (binding = 0, offset = 0) uniform atomic_uint u_stepDigits[HEATMAP_STEP_DIGITS];
+layout (binding = 0, offset = 12) uniform atomic_uint u_callDigits[HEATMAP_CALL_DIGITS];
+layout (binding = 0, offset = 28) uniform atomic_uint u_exhaustedPixels;
+
+int marchSteps = 0;  // rMarch iterations of this pixel
+int sdfCalls = 0;    // calcSDF calls of this pixel
+
+// Blue through green and yellow to red for t in [0, 1]
+vec3 heatColor(float t) {
+    t = clamp(t, 0.0, 1.0);
+    return clamp(vec3(1.5 - abs(4.0 * t - 3.0), 1.5 - abs(4.0 * t - 2.0), 1.5 - abs(4.0 * t - 1.0)), 0.0, 1.0);
+}
+
+// Counts the pixel into the totals and returns its colour. A primary ray that
+// ran out of steps (maxSteps) is magenta in both modes.
+vec3 heatmap(int mode, int maxSteps) {
+    int steps = marchSteps;
+    for (int digit = 0; digit < HEATMAP_STEP_DIGITS; digit++, steps >>= 4) {
+        for (int i = 0; i < (steps & 15); i++) atomicCounterIncrement(u_stepDigits[digit]);
+    }
+    int calls = min(sdfCalls, (1 << (4 * HEATMAP_CALL_DIGITS)) - 1);
+    for (int digit = 0; digit < HEATMAP_CALL_DIGITS; digit++, calls >>= 4) {
+        for (int i = 0; i < (calls & 15); i++) atomicCounterIncrement(u_callDigits[digit]);
+    }
+
+    if (marchSteps >= maxSteps) {
+        atomicCounterIncrement(u_exhaustedPixels);
+        return vec3(1.0, 0.0, 1.0);
+    }
+    // Squared so the gamma correction after it leaves the ramp roughly linear
+    vec3 col = mode == HEATMAP_STEPS_MODE ? heatColor(float(marchSteps) / 128.0) : heatColor(float(sdfCalls) / 1024.0);
+    return col * col;
+}
@@ -0,0 +1,95 @@
+#version 430 core
+
+// Tile light culling for the deferred path (src/deferred_shading.h). One work
+// group per LIGHT_TILE x LIGHT_TILE pixels bounds the surface points in its
+// part of the G-buffer and keeps the lights whose range and spot cone reach
+// them, as one bit per light index. A light that is culled would have added
+// exactly nothing to those pixels.
+
+#include "lights.glsl"
+
+#define TILE_PIXELS (LIGHT_TILE * LIGHT_TILE)
+
+layout (local_size_x = LIGHT_TILE, local_size_y = LIGHT_TILE) in;
+
+layout (binding = 7) uniform sampler2D u_gHitDistance;
+layout (binding = 8) uniform sampler2D u_gPositionAO;
+
+layout (std430, binding = 8) writeonly buffer tileLightMasks {
+    uint lightMasks[];  // LIGHT_MASK_WORDS per tile, tiles row by row
+};
+
+uniform ivec2 u_size;   // pixels of this frame, the lower left part of the G-buffer
+
+const float MAX_DIST_TO_TRAVEL = 100.0; // as in fragment.glsl
+
+shared vec3 boundsMin[TILE_PIXELS];
+shared vec3 boundsMax[TILE_PIXELS];
+shared uint tileMask[LIGHT_MASK_WORDS];
+
+// Whether a cone around `axis` with the given half angle can reach the sphere.
+// Conservative near the apex. Bart Wronski, "Cull that cone!"
+bool coneReachesSphere(vec3 apex, vec3 axis, float cosAngle, vec3 center, float radius) {
+    if (cosAngle <= 0.0) return true; // 90 degrees or wider, not worth testing
+    vec3 v = center - apex;
+    float along = dot(v, axis);
+    float sinAngle = sqrt(1.0 - cosAngle*cosAngle);
+    float distClosest = cosAngle * sqrt(max(dot(v, v) - along*along, 0.0)) - along * sinAngle;
+    return distClosest <= radius && along >= -radius;
+}
+
+// Tested against the box's bounding sphere for the cone, the box itself for the range
+bool lightReachesBox(Light light, vec3 lo, vec3 hi) {
+    vec3 pos = light.positionSize.xyz;
+    float range = light.colorRange.w;
+    if (range > 0.0) {
+        vec3 closest = clamp(pos, lo, hi);
+        if (dot(closest - pos, closest - pos) >= range*range) return false;
+    }
+    vec3 axis = light.target.xyz - pos;
+    if (dot(axis, axis) == 0.0) return true;
+    return coneReachesSphere(pos, normalize(axis), light.cone.y, 0.5*(lo + hi), 0.5*length(hi - lo));
+}
+
+void main() {
+    uint index = gl_LocalInvocationIndex;
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+
+    // Sky pixels and the pixels past the frame's edge don't count
+    vec3 lo = vec3(1e30), hi = vec3(-1e30);
+    if (all(lessThan(pixel, u_size)) && texelFetch(u_gHitDistance, pixel, 0).r < MAX_DIST_TO_TRAVEL) {
+        lo = hi = texelFetch(u_gPositionAO, pixel, 0).xyz;
+    }
+    boundsMin[index] = lo;
+    boundsMax[index] = hi;
+    if (index < LIGHT_MASK_WORDS) tileMask[index] = 0u;
+    memoryBarrierShared();
+    barrier();
+
+    for (uint stride = TILE_PIXELS / 2; stride > 0u; stride >>= 1) {
+        if (index < stride) {
+            boundsMin[index] = min(boundsMin[index], boundsMin[index + stride]);
+            boundsMax[index] = max(boundsMax[index], boundsMax[index + stride]);
+        }
+        memoryBarrierShared();
+        barrier();
+    }
+    lo = boundsMin[0];
+    hi = boundsMax[0];
+
+    // One invocation per light, the bits end up the same whatever order they're set in
+    if (lo.x <= hi.x) {
+        for (int i = int(index); i < u_lightCount; i += TILE_PIXELS) {
+            if (lightReachesBox(lights[i], lo, hi)) {
+                atomicOr(tileMask[i / 32], 1u << (i % 32));
+            }
+        }
+    }
+    memoryBarrierShared();
+    barrier();
+
+    uint tile = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+    if (index < LIGHT_MASK_WORDS) {
+        lightMasks[tile * LIGHT_MASK_WORDS + index] = tileMask[index];
+    }
+}
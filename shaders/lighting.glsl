@@ -0,0 +1,215 @@
+// Surface shading, shared by the forward path of fragment.glsl and the
+// deferred lighting pass (deferred_lighting.glsl). Expects calcSDF() for the
+// shadow and AO rays, the programTexture1 sampler for getMaterial() and the
+// u_camPos, u_camTarget and u_flashlight uniforms for the flashlight.
+
+#include "lights.glsl"
+
+vec3 triPlanar(sampler2D tex, vec3 p, vec3 normal, float size) {
+    p*=(1.0/size);
+    normal = abs(normal);
+    normal = pow(normal, vec3(5.0));
+    normal /= normal.x + normal.y + normal.z;
+    return (texture(tex, p.xy * 0.5 + 0.5) * normal.z +
+    texture(tex, p.xz * 0.5 + 0.5) * normal.y +
+    texture(tex, p.yz * 0.5 + 0.5) * normal.x).rgb;
+}
+
+vec3 getMaterial(vec3 p, float id, vec3 normal, float size) {
+    vec3 m;
+    switch (int(id)) {
+            case 1:
+                m = vec3(1.0, 0.0, 0.0);
+                break;
+            case 2:
+                m = triPlanar(programTexture1, p, normal, size);
+                break;
+            case 3:
+                m = vec3(0.0, 0.0, 1.0);
+                break;
+            case 4:
+                m = vec3(1.0, 1.0, 0.0);
+                break;
+            case 5:
+                m = vec3(1.0, 0.0, 1.0);
+                break;
+            case 6:
+                m = vec3(0.0, 1.0, 1.0);
+                break;
+            case 7:
+                m = vec3(1.0, 1.0, 1.0);
+                break;
+            default:
+                m = vec3(1.0);
+                break;
+    }
+    return m;
+}
+
+// Fractal detail the secondary rays leave out, see sdfTolerance: a fraction
+// of each AO sample's height, and of the distance a shadow ray has travelled
+// or its penumbra width there, whichever is wider
+const float AO_LOD = 0.25;
+const float SHADOW_LOD = 0.01;
+
+float calcAO(vec3 pos, vec3 normal) { //Ambient occlusion
+    float occ = 0.0;
+    float sca = 1.0;
+    float tolerance = sdfTolerance;
+
+    for(int i=0; i<5; i++) {
+        float hrconst = 0.03; // larger values = AO
+        float hr = hrconst + 0.15*float(i)/4.0;
+        vec3 aopos =  normal * hr + pos;
+        sdfTolerance = max(tolerance, AO_LOD*hr);
+        float dd = calcSDF( aopos ).x;
+        occ += (hr-dd)*sca;
+        sca *= 0.95;
+    }
+    sdfTolerance = tolerance;
+    return clamp(1.0 - occ*1.5, 0.0, 1.0);
+}
+
+// cut1 and cut2 define the center cone and the max width of the light
+// they are cosines of the corresponding angles, so a center cone of
+// 15 degrees and a max width of 30 degrees would correspond to
+// cut1 = 0.9659258 and cut2 = 0.8660254
+// lr is the normalized light ray
+float calcDirLight(vec3 p, vec3 lookfrom, vec3 lookat, in float cut1, in float cut2) {
+    vec3 lr = normalize(lookfrom - p);
+    float intensity = dot(lr, normalize(lookfrom - lookat));
+    return smoothstep(cut2, cut1, intensity);
+}
+
+// The camera's flashlight isn't in the light list, it follows u_camPos
+Light flashlight() {
+    Light fLight;
+    fLight.positionSize = vec4(u_camPos, 0.0001);
+    fLight.colorRange = vec4(0.6431, 0.6118, 0.498, 0.0);
+    fLight.target = vec4(u_camPos + u_camTarget, 0.0);
+    fLight.cone = vec4(cos(radians(15.0)), cos(radians(30.0)), 0.0, 0.0);
+    return fLight;
+}
+
+// https://iquilezles.org/articles/rmshadows
+float calcSoftshadow(in vec3 ro, in vec3 rd, in float mint, in float tmax, float w)
+{
+	float t = mint;
+    float k = 1/(10*w);  // "softness" of shadow. smaller numbers = softer
+
+    // unroll first loop iteration
+    float h = calcSDF(ro + rd*t).x;
+    float res = min(1., k*h/t);
+    t += h;
+    float ph = h; // previous h
+    
+    for( int i=1; i<60; i++ )
+    {
+        if( res<0.01 || t>tmax ) break;        
+
+        h = calcSDF(ro + rd*t).x;
+        float y = h*h/(2.0*ph);
+        float d = sqrt(h*h-y*y);
+        res = min(res, k*d/max(0.0, t-y));
+        ph = h;
+        t += h;
+    }
+    res = clamp( res, 0.0, 1.0 );
+    return res*res*(3.0-2.0*res);  // smoothstep, smoothly transition from 0 to 1
+}
+
+float calcSoftshadowV2(in vec3 ro, in vec3 rd, float mint, float maxt, float w)
+{
+    float res = 1.0;
+    float t = mint;
+    for( int i=0; i<256 && t<maxt; i++ )
+    {
+        float h = calcSDF(ro + t*rd).x;
+        res = min( res, h/(w*t) );
+        t += clamp(h, 0.005, 0.50);
+        if( res<-1.0 || t>maxt ) break;
+    }
+    res = max(res,-1.0);
+    return 0.25*(1.0+res)*(1.0+res)*(2.0-res);
+}
+
+float calcSoftshadowV3(in vec3 ro, in vec3 rd, float mint, float maxt, float w) {
+    float res = 1.0;
+    float ph = 1e20;
+    float t = mint;
+    float tolerance = sdfTolerance;
+    for( int i=0; i<256 && t<maxt; i++ )
+    {
+        sdfTolerance = max(tolerance, max(SHADOW_LOD, w)*t);
+        float h = calcSDF(ro + rd*t).x;
+        if( h<0.001 )
+        {
+            res = 0.0;
+            break;
+        }
+        float y = h*h/(2.0*ph);
+        float d = sqrt(h*h-y*y);
+        res = min( res, d/(w*max(0.0,t-y)) );
+        ph = h;
+        t += h;
+    }
+    sdfTolerance = tolerance;
+    return res;
+}
+
+// Spot cone and range attenuation of a light at pos, shadows aside
+float lightIntensity(Light lightSource, vec3 pos) {
+    float light = calcDirLight(pos, lightSource.positionSize.xyz, lightSource.target.xyz, lightSource.cone.x, lightSource.cone.y);
+    return light * lightRangeFalloff(lightSource, pos);
+}
+
+// Soft shadow factor towards a light, 1 where it doesn't shine anyway
+float lightShadow(Light lightSource, vec3 pos) {
+    if (lightIntensity(lightSource, pos) <= 0.001) return 1.0; // no need to calculate shadow if we're in the dark
+    vec3 lRay = normalize(lightSource.positionSize.xyz - pos);
+    return calcSoftshadowV3(pos, lRay, 0.01, 3.0, lightSource.positionSize.w);
+}
+
+// calcLight with a shadow factor from elsewhere, e.g. the reduced resolution shadow pass
+vec3 calcLightShadowed(Light lightSource, vec3 pos, vec3 normal, vec3 rDirRef, float ambientOcc, vec3 material, float kSpecular, float shadow) {
+    float kDiffuse = 0.4,
+        kAmbient = 0.005;
+
+    vec3 iSpecular = 6.*lightSource.colorRange.rgb,  // intensity
+        iDiffuse = 2.*lightSource.colorRange.rgb,
+        iAmbient = 1.5*lightSource.colorRange.rgb;
+
+    float alpha_phong = 20.0; // phong alpha component
+
+
+    vec3 lRay = normalize(lightSource.positionSize.xyz - pos);
+    
+    float light = lightIntensity(lightSource, pos);
+    vec3 lDirRef = reflect(lRay, normal);
+
+    vec3 dif = light*kDiffuse*iDiffuse*max(dot(lRay, normal), 0.)*shadow;
+    vec3 spec = light*kSpecular*iSpecular*pow(max(dot(lRay, rDirRef), 0.), alpha_phong)*shadow;
+    vec3 amb = light*kAmbient*iAmbient*ambientOcc;
+
+    return material*(amb + dif + spec);
+    
+}
+
+vec3 calcLight(Light lightSource, vec3 pos, vec3 normal, vec3 rDirRef, float ambientOcc, vec3 material, float kSpecular, vec3 color) {
+    return calcLightShadowed(lightSource, pos, normal, rDirRef, ambientOcc, material, kSpecular, lightShadow(lightSource, pos));
+}
+
+// Shades a surface point with every light, as seen along rDir
+vec3 shadeSurface(vec3 pos, vec3 normal, float matID, float ambientOcc, vec3 rDir) {
+    vec3 col = vec3(0.005);
+    vec3 rDirRef = reflect(rDir, normal); // reflected ray
+    vec3 material = getMaterial(pos, matID, normal, 0.5);
+
+    for (int i = 0; i < u_lightCount; i++) {
+        col += calcLight(lights[i], pos, normal, rDirRef, ambientOcc, material, 0.5, col);
+    }
+    if (u_flashlight>0) {
+        col += calcLight(flashlight(), pos, normal, rDirRef, ambientOcc, material, 0.5, col);
+    }
+    return col;
+}
@@ -0,0 +1,34 @@
+// The scene's light list, read by lighting.glsl and by the tile culling of
+// the deferred path (light_cull.glsl).
+
+// Lights come from the scene file (SceneLight in scene.h), streamed every
+// frame since they can move. A spotlight: full intensity within the focus
+// angle around the line from its position to its target, none outside the
+// spread angle.
+struct Light {
+    vec4 positionSize;  // xyz position, w size (larger = softer shadows)
+    vec4 colorRange;    // rgb colour, w range, 0 for unlimited
+    vec4 target;        // xyz point the light is aimed at
+    vec4 cone;          // x cos(focus), y cos(spread)
+};
+
+// Must match MAX_SCENE_LIGHTS in scene.h
+#define MAX_LIGHTS 256
+// uints per tile in the deferred path's light masks, one bit per light
+#define LIGHT_MASK_WORDS (MAX_LIGHTS / 32)
+// Pixels per light culling tile along each axis, must match DEFERRED_TILE in deferred_shading.h
+#define LIGHT_TILE 16
+
+layout(std430, binding = 7) readonly buffer sceneLights {
+    Light lights[];
+};
+uniform int u_lightCount;
+
+// Fades a light out towards its range, so culling it beyond that is exact
+float lightRangeFalloff(Light lightSource, vec3 pos) {
+    float range = lightSource.colorRange.w;
+    if (range <= 0.0) return 1.0;
+    float d = length(lightSource.positionSize.xyz - pos) / range;
+    float f = clamp(1.0 - d*d*d*d, 0.0, 1.0);
+    return f*f;
+}
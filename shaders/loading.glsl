@@ -0,0 +1,19 @@
+#version 430 core
+
+// Shown while fragment.glsl is still compiling in the background
+
+layout (location = 0) out vec4 FragColor;
+
+#include "frame_state.glsl"
+
+void main() {
+    vec2 uv = gl_FragCoord.xy / u_resolution;
+    vec3 col = vec3(0.005);
+
+    // a bar sweeping along the bottom of the window
+    float head = fract(u_time * 0.5);
+    float bar = step(uv.y, 0.01) * smoothstep(0.25, 0.0, abs(uv.x - head));
+    col += bar * vec3(0.6431, 0.6118, 0.498);
+
+    FragColor = vec4(pow(col, vec3(1.0 / 2.2)), 1.0);
+}
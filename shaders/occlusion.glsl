@@ -0,0 +1,16 @@
+// Layout of the reduced resolution AO and shadow buffers (src/occlusion_passes.h),
+// shared by the passes that fill them and the lighting pass that upsamples them.
+
+// Shadow factors of four lights per layer of the shadow buffer
+#define SHADOW_SLOTS_PER_LAYER 4
+// Two pixels are on the same surface when each lies within this fraction of
+// the view distance of the other's tangent plane. A distance test alone
+// would split surfaces seen at grazing angles.
+#define OCCLUSION_PLANE_TOLERANCE 0.01
+
+// The full resolution pixel a texel of a 1/scale buffer stands for. The
+// bilateral upsample weighs texels by how well this pixel's G-buffer entry
+// matches the pixel being shaded.
+ivec2 occlusionAnchor(ivec2 texel, int scale, ivec2 size) {
+    return min(texel * scale + scale / 2, size - 1);
+}
@@ -0,0 +1,95 @@
+#version 430 core
+
+// Reduced resolution ambient occlusion (u_pass 0) and light shadow factors
+// (u_pass 1) for the deferred path, see src/occlusion_passes.h. Each texel
+// evaluates the G-buffer pixel occlusionAnchor() gives it. While nothing
+// changes from frame to frame (u_historyCount > 0) it evaluates another pixel
+// of its block each frame instead, one on the anchor's surface, and averages
+// it into the history.
+
+#include "hg_sdf.glsl"
+#include "occlusion.glsl"
+
+layout (location = 0) out float AmbientOcclusion;
+
+uniform int u_pass;
+uniform int u_scale;
+uniform ivec2 u_size;          // full resolution pixels of this frame
+uniform ivec2 u_sampleOffset;  // pixel of the block to evaluate when averaging
+uniform int u_historyCount;    // frames averaged into the history, 0 ignores it
+uniform int u_shadowLights;    // lights with a shadow slot, the flashlight gets the next one
+uniform vec3 u_camPos;
+uniform vec3 u_camTarget;
+uniform int u_flashlight;
+
+uniform sampler2D programTexture1;
+layout (binding = 6) uniform sampler2D u_gNormalMaterial;
+layout (binding = 7) uniform sampler2D u_gHitDistance;
+layout (binding = 8) uniform sampler2D u_gPositionAO;
+layout (binding = 11) uniform sampler2D u_aoHistory;
+layout (binding = 12) uniform sampler2DArray u_shadowHistory;
+layout (rgba16f, binding = 1) writeonly uniform image2DArray u_shadows;
+
+const float MAX_DIST_TO_TRAVEL = 100.0; // as in fragment.glsl
+
+vec2 minID(vec2 res1, vec2 res2) {
+    return (res1.x < res2.x) ? res1 : res2;
+}
+
+#include "baked_sdf.glsl"
+#include "scene.glsl"
+
+vec2 calcSDF(vec3 pos) {
+    return calcSceneSDF(pos);
+}
+
+#include "lighting.glsl"
+
+// Both pixels see the same surface, or both see the sky
+bool sameSurface(ivec2 a, ivec2 b) {
+    float da = texelFetch(u_gHitDistance, a, 0).r;
+    float db = texelFetch(u_gHitDistance, b, 0).r;
+    if (da >= MAX_DIST_TO_TRAVEL || db >= MAX_DIST_TO_TRAVEL) return da >= MAX_DIST_TO_TRAVEL && db >= MAX_DIST_TO_TRAVEL;
+    vec3 na = texelFetch(u_gNormalMaterial, a, 0).xyz;
+    vec3 nb = texelFetch(u_gNormalMaterial, b, 0).xyz;
+    vec3 pa = texelFetch(u_gPositionAO, a, 0).xyz;
+    vec3 pb = texelFetch(u_gPositionAO, b, 0).xyz;
+    return abs(dot(pb - pa, na)) < OCCLUSION_PLANE_TOLERANCE * da && dot(na, nb) > 0.9;
+}
+
+void main() {
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    ivec2 pixel = occlusionAnchor(texel, u_scale, u_size);
+    if (u_historyCount > 0) {
+        ivec2 candidate = min(texel * u_scale + u_sampleOffset, u_size - 1);
+        if (sameSurface(candidate, pixel)) pixel = candidate;
+    }
+    bool hit = texelFetch(u_gHitDistance, pixel, 0).r < MAX_DIST_TO_TRAVEL;
+    vec3 pos = texelFetch(u_gPositionAO, pixel, 0).xyz;
+    vec3 normal = texelFetch(u_gNormalMaterial, pixel, 0).xyz;
+    float weight = 1.0 / float(u_historyCount + 1);
+
+    if (u_pass == 0) {
+        float ao = hit ? calcAO(pos, normal) : 1.0;
+        if (u_historyCount > 0) ao = mix(texelFetch(u_aoHistory, texel, 0).r, ao, weight);
+        AmbientOcclusion = ao;
+        return;
+    }
+
+    // Every slot gets written, the upsample may read a light from a
+    // neighbouring texel that it doesn't reach
+    int slots = u_shadowLights + 1;
+    for (int layer = 0; layer * SHADOW_SLOTS_PER_LAYER < slots; layer++) {
+        vec4 shadows = vec4(1.0);
+        for (int c = 0; c < SHADOW_SLOTS_PER_LAYER && hit; c++) {
+            int slot = layer * SHADOW_SLOTS_PER_LAYER + c;
+            if (slot < u_shadowLights) {
+                shadows[c] = lightShadow(lights[slot], pos);
+            } else if (slot == u_shadowLights && u_flashlight > 0) {
+                shadows[c] = lightShadow(flashlight(), pos);
+            }
+        }
+        if (u_historyCount > 0) shadows = mix(texelFetch(u_shadowHistory, ivec3(texel, layer), 0), shadows, weight);
+        imageStore(u_shadows, ivec3(texel, layer), shadows);
+    }
+}
@@ -0,0 +1,20 @@
+#version 430 core
+
+// Text overlay (src/text_overlay.h): glyph coverage from the FreeType atlas,
+// over a translucent backdrop
+
+layout (location = 0) out vec4 FragColor;
+
+layout (binding = 15) uniform sampler2D u_glyphs; // R8 coverage
+uniform vec4 u_textColor;
+
+in vec2 v_uv;
+
+void main() {
+    if (v_uv.x < 0.0) {
+        FragColor = vec4(0.0, 0.0, 0.0, 0.6);
+        return;
+    }
+    float coverage = texelFetch(u_glyphs, ivec2(v_uv), 0).r;
+    FragColor = vec4(u_textColor.rgb, u_textColor.a * coverage);
+}
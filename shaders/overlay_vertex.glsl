@@ -0,0 +1,15 @@
+#version 430 core
+
+// Text overlay quads (src/text_overlay.h), positioned in pixels from the top left
+
+layout (location = 0) in vec4 in_positionUV; // xy pixels, zw glyph atlas texels, negative for the backdrop
+
+uniform vec2 u_viewport;
+
+out vec2 v_uv;
+
+void main() {
+    vec2 ndc = in_positionUV.xy / u_viewport * 2.0 - 1.0;
+    gl_Position = vec4(ndc.x, -ndc.y, 0.0, 1.0);
+    v_uv = in_positionUV.zw;
+}
@@ -0,0 +1,149 @@
+// Primary rays of the forward render modes, shared by the fragment shader
+// (fragment.glsl) and the tiled compute path (raymarch_tiled.glsl). The
+// includer provides the camera uniforms, MAX_DIST_TO_TRAVEL, calcSDF() for
+// normals and secondary rays, marchSDF() for the primary rays and
+// prepassDistance() for where they start, and includes heatmap.glsl before
+// calcSDF() so both can count. Pixel positions are passed in as fragCoord, in
+// gl_FragCoord units.
+
+const float MAX_STEPS = 500.0;
+const float MIN_DIST_TO_SDF = 0.000001;
+const float EPSILON = 0.001;
+const float LOD_MULTIPLIER = 60;
+// Fractal detail left out by the primary rays, in pixels, see sdfTolerance
+const float SDF_LOD_PIXELS = 1.0;
+// Step length of the relaxed march in radii, while the unbounding spheres overlap
+const float RELAXATION = 1.6;
+
+vec4 getNormal(vec3 pos) {
+    vec2 dist = calcSDF(pos);
+    vec2 e = vec2(EPSILON, 0.0);
+
+    vec3 normal = dist.x - vec3(
+        calcSDF(pos-e.xyy).x,
+        calcSDF(pos-e.yxy).x,
+        calcSDF(pos-e.yyx).x);
+
+    return vec4(normalize(normal), dist.y);
+}
+
+// Sphere tracing, over-relaxed with u_relaxedMarch (Keinert et al.,
+// "Enhanced Sphere Tracing"): the ray then steps RELAXATION times the safe
+// radius. The step was safe if the unbounding spheres before and after it
+// overlap; if they don't, the ray goes back to where plain sphere tracing
+// would have stepped and continues without relaxation. The radii come from
+// the scene with sdfLipschitz set, so the spheres hold for the inexact
+// primitives too. Both stop at the same distance to the surface.
+float rMarch(vec3 rOrig, vec3 rDir, float dStart) {
+    float dOrig = dStart; // distance from ray origin
+    float omega = u_relaxedMarch != 0 ? RELAXATION : 1.0;
+    float stepLength = 0.0;
+    float prevRadius = 0.0;
+
+    sdfLipschitz = u_relaxedMarch != 0;
+    for(int i=0; i<MAX_STEPS; i++) {
+        marchSteps++;
+        // Normals and shading at the hit keep the tolerance it was found with
+        sdfTolerance = SDF_LOD_PIXELS * cameraPixelSize(dOrig, u_resolution.y, u_scroll);
+        float dSurf = marchSDF(rOrig + rDir * dOrig).x;
+        if (omega > 1.0 && prevRadius + abs(dSurf) < stepLength) {
+            // Overshot, back to the unrelaxed step
+            dOrig -= stepLength - stepLength / omega;
+            omega = 1.0;
+            continue;
+        }
+        // Only a relaxed step can get past the end unnoticed
+        if(dOrig > MAX_DIST_TO_TRAVEL) break;
+        float hitDist = dOrig + dSurf;
+        if(hitDist > MAX_DIST_TO_TRAVEL || abs(dSurf) < MIN_DIST_TO_SDF*clamp(((hitDist*hitDist-3)*LOD_MULTIPLIER),1,MAX_DIST_TO_TRAVEL*MAX_DIST_TO_TRAVEL*LOD_MULTIPLIER)) {
+            dOrig = hitDist;
+            break;
+        }
+        stepLength = dSurf * omega;
+        prevRadius = abs(dSurf);
+        dOrig += stepLength;
+    }
+    sdfLipschitz = false;
+
+    return dOrig;
+}
+
+
+float hitDistance = MAX_DIST_TO_TRAVEL; // of the last render() call
+
+vec3 render(vec3 rOrig, vec3 rDir, float dStart) {
+    vec3 col = vec3(0.005);
+
+    float dist = rMarch(rOrig, rDir, dStart);
+    hitDistance = dist;
+
+    if (dist<MAX_DIST_TO_TRAVEL) {
+        vec3 pos = rOrig + rDir * dist; // surface point location
+        vec4 normalVal = getNormal(pos);
+        vec3 normal = normalVal.xyz; //surface normal
+        float matID = normalVal.w;
+
+        float ambientOcc = calcAO(pos, normal);
+
+        col = shadeSurface(pos, normal, matID, ambientOcc, rDir);
+        //col = abs(normal);
+    }
+    return clamp(col, 0.0, 1.0);
+}
+
+// method that can generat uv coordinates with an offset for supersampling
+vec2 getUV(vec2 fragCoord, vec2 offset) {
+    return ((fragCoord + offset) - 0.5 * u_resolution.xy) / u_resolution.y;
+}
+
+// new camera module that is cleaner to call
+vec3 rCam(vec2 fragCoord, vec2 offset) {
+    return cameraRay(getUV(fragCoord, offset), u_camTarget, u_scroll);
+}
+
+// can super sample at different levels to reduce aliasing
+vec3 superSample(vec2 fragCoord, int AA)
+{
+    vec3 col = vec3(0.0);
+    float bxy = int(fragCoord.x + fragCoord.y) & 1;
+    float nbxy = 1. - bxy;
+    float dStart = prepassDistance(fragCoord);
+    switch (AA) {
+        case 0:
+            col = render(u_camPos, vec3(0.0), dStart);
+            col = vec3(getUV(fragCoord, vec2(0.0)), 0.0);
+            break;
+        case 1:
+            col = render(u_camPos, rCam(fragCoord, vec2(0.0)), dStart);
+            break;
+        case 2:
+            col = (render(u_camPos, rCam(fragCoord, vec2(0.33 * nbxy, 0.)), dStart) + render(u_camPos, rCam(fragCoord, vec2(0.33 * bxy, 0.66)), dStart));
+            col /= 2;
+            break;
+        case 3:
+            col = (render(u_camPos, rCam(fragCoord, vec2(0.66 * nbxy, 0.)), dStart) +
+                  render(u_camPos, rCam(fragCoord, vec2(0.66 * bxy, 0.66)), dStart) +
+                  render(u_camPos, rCam(fragCoord, vec2(0.33, 0.33)), dStart));
+            col /= 3;
+            break;
+        case 4:
+            vec4 e = vec4(0.125, -0.125, 0.375, -0.375);
+            col = render(u_camPos, rCam(fragCoord, e.xz), dStart);
+            col += render(u_camPos, rCam(fragCoord, e.yw), dStart);
+            col += render(u_camPos, rCam(fragCoord, e.wx), dStart);
+            col += render(u_camPos, rCam(fragCoord, e.zy), dStart);
+            col /= 4;
+            break;
+        case 5:
+            // One jittered ray per frame, taa.glsl accumulates them over time
+            col = render(u_camPos, rCam(fragCoord, u_jitter), dStart);
+            break;
+        case HEATMAP_STEPS_MODE:
+        case HEATMAP_CALLS_MODE:
+            // Shaded like mode 1 so shadows and AO count, then replaced by the counts
+            render(u_camPos, rCam(fragCoord, vec2(0.0)), dStart);
+            col = heatmap(AA, int(MAX_STEPS));
+            break;
+    }
+    return col;
+}
@@ -0,0 +1,106 @@
+// Primitive records of the `primitives` SSBO and their distance functions,
+// shared by the grid interpreter (scene.glsl), the generated scene code and
+// the tiled compute path. Layouts must match src/scene.h.
+
+#define PRIM_PLANE 0
+#define PRIM_BOX 1
+#define PRIM_SPHERE 2
+#define PRIM_BLOB 3
+#define PRIM_TORUS 4
+#define PRIM_CYLINDER 5
+#define PRIM_MENGER 6
+#define PRIM_MANDELBULB 7
+
+struct Primitive {
+    vec4 positionScale; // xyz translation, w uniform scale
+    vec4 rotation;      // unit quaternion, local to world
+    vec4 params;
+    ivec4 info;         // x type, y material ID, z integer parameter, w baked volume + 1
+};
+
+layout (std430, binding = 0) readonly buffer primitives {
+    Primitive prims[];
+};
+
+// Rotates v by the inverse of the unit quaternion q
+vec3 invRotate(vec4 q, vec3 v) {
+    vec3 t = 2.0 * cross(-q.xyz, v);
+    return v + q.w * t + cross(-q.xyz, t);
+}
+
+float evalPrimitiveAnalytic(Primitive prim, vec3 pos) {
+    float scale = prim.positionScale.w;
+    vec3 p = invRotate(prim.rotation, pos - prim.positionScale.xyz) / scale;
+    vec4 a = prim.params;
+    float d;
+    switch (prim.info.x) {
+        case PRIM_PLANE:
+            d = fPlane(p, a.xyz, a.w);
+            break;
+        case PRIM_BOX:
+            d = fBox(p, a.xyz);
+            break;
+        case PRIM_SPHERE:
+            d = fSphere(p, a.x);
+            break;
+        case PRIM_BLOB:
+            d = fBlob(p);
+            break;
+        case PRIM_TORUS:
+            d = fTorus(p, a.x, a.y);
+            break;
+        case PRIM_CYLINDER:
+            d = fCylinder(p, a.x, a.y);
+            break;
+        case PRIM_MENGER:
+            d = fMengerLOD(p, prim.info.z, a.x, sdfTolerance / scale);
+            break;
+        case PRIM_MANDELBULB:
+            vec4 trap;
+            d = mandelbulbLOD(p, sdfTolerance / scale, trap);
+            break;
+        default:
+            d = MAX_DIST_TO_TRAVEL;
+            break;
+    }
+    return d * scale;
+}
+
+// Radius of a sphere around the primitive's position that contains it, or
+// -1 when it is unbounded. The extents are those of primitiveBounds() in
+// src/scene.cpp.
+float primitiveRadius(Primitive prim) {
+    vec4 a = prim.params;
+    vec3 extent;
+    switch (prim.info.x) {
+        case PRIM_BOX: extent = a.xyz; break;
+        case PRIM_SPHERE: extent = vec3(a.x); break;
+        case PRIM_BLOB: extent = vec3(1.65); break;
+        case PRIM_TORUS: extent = vec3(a.x + a.y, a.x, a.x + a.y); break;
+        case PRIM_CYLINDER: extent = vec3(a.x, a.y, a.x); break;
+        case PRIM_MENGER: extent = vec3(a.x); break;
+        case PRIM_MANDELBULB: extent = vec3(1.25); break;
+        default: return -1.0;
+    }
+    return length(extent) * prim.positionScale.w;
+}
+
+// How much faster than the distance to the surface the primitive's distance
+// function can change, as in primitiveLipschitz() in src/scene.cpp. The exact
+// distances and the bounds of hg_sdf.glsl are 1, fBlob() is not a bound and
+// gets steeper. Uniform scale leaves it unchanged.
+float primitiveLipschitz(Primitive prim) {
+    return prim.info.x == PRIM_BLOB ? BLOB_LIPSCHITZ : 1.0;
+}
+
+// Static fractals read their baked volume first, see baked_sdf.glsl
+float evalPrimitive(Primitive prim, vec3 pos) {
+    if (prim.info.w > 0) {
+        int volume = prim.info.w - 1;
+        float d = bakedDistance(volume, pos);
+        if (d > bakedBand(volume)) {
+            return d;
+        }
+    }
+    return evalPrimitiveAnalytic(prim, pos);
+}
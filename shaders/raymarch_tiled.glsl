@@ -0,0 +1,135 @@
+#version 430 core
+
+// Tiled compute path (src/tiled_raymarch.h), an alternative to drawing
+// fragment.glsl on the fullscreen quad. One workgroup per 8x8 pixel tile:
+// the workgroup first collects the primitives whose bounding spheres the
+// tile's rays can reach into shared memory, then every invocation marches
+// its pixel's primary rays against only that list. Shading, shadows and AO
+// still see the whole scene.
+
+#include "hg_sdf.glsl"
+#include "camera.glsl"
+
+#define TILE_SIZE 8             // TILED_SIZE in src/tiled_raymarch.h
+#define TILE_MAX_PRIMITIVES 64  // a fuller tile marches the whole scene instead
+
+layout (local_size_x = TILE_SIZE, local_size_y = TILE_SIZE) in;
+
+layout (rgba8, binding = 2) writeonly uniform image2D u_color;
+layout (r32f, binding = 3) writeonly uniform image2D u_hitDistance;
+
+uniform vec2 u_resolution;
+uniform float u_time;
+uniform float u_scroll;
+uniform vec3 u_camPos;
+uniform vec3 u_camTarget;
+uniform int u_flashlight;
+uniform int u_renderMode;
+uniform vec2 u_jitter;      // subpixel offset of the temporal mode's ray
+uniform int u_prepassTile;  // pixels per depth prepass texel, 0 without the prepass
+uniform int u_relaxedMarch; // over-relaxed rMarch(), see primary_rays.glsl
+
+layout (binding = 5) uniform sampler2D u_prepassDistance;
+
+uniform sampler2D programTexture1;
+
+const float MAX_DIST_TO_TRAVEL = 100.0; // as in fragment.glsl
+
+vec2 minID(vec2 res1, vec2 res2) {
+    return (res1.x < res2.x) ? res1 : res2;
+}
+
+#include "heatmap.glsl"
+#include "baked_sdf.glsl"
+#include "primitives.glsl"
+#include "scene.glsl"
+
+vec2 calcSDF(vec3 pos) {
+    sdfCalls++;
+    return calcSceneSDF(pos);
+}
+
+#include "lighting.glsl"
+
+shared Primitive tilePrims[TILE_MAX_PRIMITIVES];
+shared vec4 tileSpheres[TILE_MAX_PRIMITIVES]; // xyz centre, w radius or -1 when unbounded
+shared uint tileCount;
+
+// The tile's rays leave the camera within a cone: at distance t each is
+// within t*spread of the axis point (see depth_prepass.glsl). A sphere can
+// only be hit when it comes that close to the axis somewhere, which it does
+// closest at the t minimising |axis*t - v| - t*spread.
+bool coneReaches(vec3 axis, float spread, vec3 center, float radius) {
+    vec3 v = center - u_camPos;
+    float along = dot(v, axis);
+    float across = length(v - axis * along);
+    float cosine = sqrt(max(1.0 - spread * spread, 0.0));
+    if (along + spread * across / max(cosine, 1e-4) < 0.0) {
+        return length(v) <= radius; // closest at the camera
+    }
+    return across * cosine - spread * along <= radius;
+}
+
+// The scene as far as this tile's rays can tell
+vec2 marchSDF(vec3 pos) {
+    if (tileCount > TILE_MAX_PRIMITIVES) {
+        return calcSDF(pos);
+    }
+    sdfCalls++;
+    vec2 dist = vec2(MAX_DIST_TO_TRAVEL * 2.0, 0.0);
+    for (uint i = 0u; i < tileCount; i++) {
+        vec4 sphere = tileSpheres[i];
+        // The bounding sphere can't beat the closest primitive so far
+        if (sphere.w >= 0.0 && length(pos - sphere.xyz) - sphere.w >= dist.x) continue;
+        float d = lipschitzDistance(evalPrimitive(tilePrims[i], pos), primitiveLipschitz(tilePrims[i]));
+        dist = minID(vec2(d, float(tilePrims[i].info.y)), dist);
+    }
+    return dist;
+}
+
+// The whole tile reads the same prepass texel when the tiles line up
+float prepassDistance(vec2 fragCoord) {
+    if (u_prepassTile == 0) return 0.0;
+    return texelFetch(u_prepassDistance, ivec2(fragCoord) / u_prepassTile, 0).r;
+}
+
+#include "primary_rays.glsl"
+
+void main() {
+    if (gl_LocalInvocationIndex == 0u) {
+        tileCount = 0u;
+    }
+    barrier();
+
+    // The tile's pixels plus one on every side, supersampling and the
+    // temporal jitter offset rays by less than that
+    vec2 lo = vec2(gl_WorkGroupID.xy) * float(TILE_SIZE) - 1.0;
+    vec2 hi = lo + float(TILE_SIZE) + 2.0;
+    vec3 axis = rCam(0.5 * (lo + hi), vec2(0.0));
+    float spread = 0.0;
+    spread = max(spread, length(rCam(lo, vec2(0.0)) - axis));
+    spread = max(spread, length(rCam(hi, vec2(0.0)) - axis));
+    spread = max(spread, length(rCam(vec2(lo.x, hi.y), vec2(0.0)) - axis));
+    spread = max(spread, length(rCam(vec2(hi.x, lo.y), vec2(0.0)) - axis));
+
+    uint invocations = gl_WorkGroupSize.x * gl_WorkGroupSize.y;
+    for (uint i = gl_LocalInvocationIndex; i < uint(prims.length()); i += invocations) {
+        Primitive prim = prims[i];
+        float radius = primitiveRadius(prim);
+        if (radius >= 0.0 && !coneReaches(axis, spread, prim.positionScale.xyz, radius)) continue;
+        uint slot = atomicAdd(tileCount, 1u);
+        if (slot < TILE_MAX_PRIMITIVES) {
+            tilePrims[slot] = prim;
+            tileSpheres[slot] = vec4(prim.positionScale.xyz, radius);
+        }
+    }
+    barrier();
+
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(vec2(pixel), u_resolution))) return;
+
+    vec3 col = superSample(vec2(pixel) + 0.5, u_renderMode);
+    col = pow(col, vec3( 1.0 / 2.2));	// gamma correction
+    imageStore(u_color, pixel, vec4(col, 1.0));
+    imageStore(u_hitDistance, pixel, vec4(hitDistance));
+}
@@ -0,0 +1,53 @@
+// Data-driven scene: the primitive records of primitives.glsl plus the
+// uniform grid built by buildSceneGrid() in src/scene.cpp. Layouts must match
+// src/scene.h.
+
+#include "primitives.glsl"
+
+layout (std430, binding = 1) readonly buffer sceneGrid {
+    vec4 gridMin;       // xyz, w margin left after the motion slack
+    vec4 gridCellSize;
+    ivec4 gridDims;     // xyz, w number of unbounded primitives
+    uvec2 gridCells[];  // (first index, count)
+};
+
+layout (std430, binding = 2) readonly buffer sceneGridIndices {
+    uint gridIndices[];
+};
+
+vec2 evalPrimitives(uint first, uint count, vec3 pos, vec2 dist) {
+    for (uint i = first; i < first + count; i++) {
+        Primitive prim = prims[gridIndices[i]];
+        dist = minID(vec2(lipschitzDistance(evalPrimitive(prim, pos), primitiveLipschitz(prim)), float(prim.info.y)), dist);
+    }
+    return dist;
+}
+
+// Only the primitives listed in the cell containing pos are evaluated. Every
+// other primitive is at least (distance to the cell exit + margin) away, so
+// that is returned instead when it is closer, with material 0.
+vec2 calcSceneSDF(vec3 pos) {
+    vec2 dist = evalPrimitives(0u, uint(gridDims.w), pos, vec2(MAX_DIST_TO_TRAVEL * 2.0, 0.0));
+    if (gridDims.x == 0) {
+        return dist;
+    }
+
+    float margin = gridMin.w;
+    vec3 local = (pos - gridMin.xyz) / gridCellSize.xyz;
+    ivec3 cell = ivec3(floor(local));
+    float bound;
+    if (all(greaterThanEqual(cell, ivec3(0))) && all(lessThan(cell, gridDims.xyz))) {
+        uvec2 range = gridCells[cell.x + gridDims.x * (cell.y + gridDims.y * cell.z)];
+        dist = evalPrimitives(range.x, range.y, pos, dist);
+        vec3 f = (local - vec3(cell)) * gridCellSize.xyz;
+        bound = min(vmin(f), vmin(gridCellSize.xyz - f)) + margin;
+    } else {
+        // Outside the grid, which is already padded by the margin
+        vec3 halfSize = 0.5 * gridCellSize.xyz * vec3(gridDims.xyz);
+        bound = length(max(abs(pos - gridMin.xyz - halfSize) - halfSize, vec3(0.0))) + margin;
+    }
+    if (bound < dist.x) {
+        dist = vec2(bound, 0.0);
+    }
+    return dist;
+}
@@ -0,0 +1,84 @@
+#version 430 core
+
+// Batched scene queries from the CPU (src/sdf_query.h), one invocation per
+// query. A query is either a point, answered with the signed distance there,
+// or a ray, marched until it hits; both report the normal and the minID()
+// material at the point. Built like the scene shaders, so the distances are
+// the ones the frame is drawn with.
+
+#include "hg_sdf.glsl"
+
+#define QUERY_WORKGROUP 64  // SDF_QUERY_WORKGROUP in src/sdf_query.h
+
+layout (local_size_x = QUERY_WORKGROUP) in;
+
+struct Query {
+    vec4 origin;     // xyz point or ray origin
+    vec4 direction;  // xyz ray direction, w its length, 0 for a point query
+};
+
+struct Result {
+    vec4 position;   // xyz point or hit, w distance (along the ray, -1 on a miss)
+    vec4 normal;     // xyz normal, w material
+};
+
+layout (std430, binding = 9) readonly buffer queryBuffer {
+    Query queries[];
+};
+
+layout (std430, binding = 10) writeonly buffer resultBuffer {
+    Result results[];
+};
+
+uniform int u_queryCount;
+
+const float MAX_DIST_TO_TRAVEL = 100.0; // as in fragment.glsl
+const int QUERY_STEPS = 256;
+const float QUERY_HIT_DIST = 0.0005;    // a ray hits once it is this close
+const float EPSILON = 0.001;            // getNormal() in primary_rays.glsl
+
+vec2 minID(vec2 res1, vec2 res2) {
+    return (res1.x < res2.x) ? res1 : res2;
+}
+
+#include "baked_sdf.glsl"
+#include "scene.glsl"
+
+// getNormal() given the distance at pos
+vec4 queryNormal(vec3 pos, vec2 dist) {
+    vec2 e = vec2(EPSILON, 0.0);
+    vec3 normal = dist.x - vec3(
+        calcSceneSDF(pos - e.xyy).x,
+        calcSceneSDF(pos - e.yxy).x,
+        calcSceneSDF(pos - e.yyx).x);
+    float len = length(normal);
+    return vec4(len > 0.0 ? normal / len : vec3(0.0), dist.y);
+}
+
+void main() {
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= uint(u_queryCount)) return;
+
+    Query query = queries[index];
+    vec3 pos = query.origin.xyz;
+    vec2 dist = calcSceneSDF(pos);
+    float reported = dist.x;
+
+    if (query.direction.w > 0.0) {
+        vec3 dir = query.direction.xyz;
+        float maxDist = min(query.direction.w, MAX_DIST_TO_TRAVEL);
+        float t = 0.0;
+        for (int i = 0; i < QUERY_STEPS && dist.x >= QUERY_HIT_DIST; i++) {
+            t += dist.x;
+            if (t > maxDist) break;
+            pos = query.origin.xyz + dir * t;
+            dist = calcSceneSDF(pos);
+        }
+        if (dist.x >= QUERY_HIT_DIST) {
+            results[index] = Result(vec4(query.origin.xyz + dir * maxDist, -1.0), vec4(0.0));
+            return;
+        }
+        reported = t;
+    }
+    results[index] = Result(vec4(pos, reported), queryNormal(pos, dist));
+}
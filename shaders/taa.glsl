@@ -0,0 +1,68 @@
+#version 430 core
+
+// Temporal resolve (src/temporal_aa.h). The scene shader traces one ray per
+// pixel with a different subpixel jitter every frame; this pass reprojects
+// last frame's result onto the current one and blends them, so the image
+// converges to the supersampled result while the camera is still.
+//
+// A pixel's hit distance gives its world position, the previous camera gives
+// where that position was on screen. History from pixels that were occluded
+// or moved is kept from ghosting by clamping it to the colours around the
+// pixel in the current frame.
+
+#include "camera.glsl"
+
+layout (location = 0) out vec4 FragColor;
+
+// Units 2-4, unit 1 is the baked SDF atlas of the scene shader
+layout (binding = 2) uniform sampler2D u_current;
+layout (binding = 3) uniform sampler2D u_hitDistance;
+layout (binding = 4) uniform sampler2D u_history;
+
+uniform vec2 u_size;         // rendered pixels, the lower left part of each texture
+uniform vec2 u_historySize;  // same for u_history, the previous frame may differ
+uniform vec2 u_jitter;
+uniform float u_historyWeight; // 0 when there is no history
+
+uniform vec3 u_camPos;
+uniform vec3 u_camTarget;
+uniform float u_scroll;
+uniform vec3 u_prevCamPos;
+uniform vec3 u_prevCamTarget;
+uniform float u_prevScroll;
+
+const float SKY_DISTANCE = 100.0; // MAX_DIST_TO_TRAVEL in fragment.glsl
+
+void main() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    ivec2 last = ivec2(u_size) - 1;
+    vec3 current = texelFetch(u_current, pixel, 0).rgb;
+
+    // Range of the 3x3 neighbourhood, the history is trusted inside it
+    vec3 lo = current, hi = current;
+    for (int y = -1; y <= 1; y++) {
+        for (int x = -1; x <= 1; x++) {
+            vec3 c = texelFetch(u_current, clamp(pixel + ivec2(x, y), ivec2(0), last), 0).rgb;
+            lo = min(lo, c);
+            hi = max(hi, c);
+        }
+    }
+
+    // The point the pixel's ray hit, or only its direction for the sky
+    vec2 uv = (gl_FragCoord.xy + u_jitter - 0.5*u_size)/u_size.y;
+    vec3 dir = cameraRay(uv, u_camTarget, u_scroll);
+    float dist = texelFetch(u_hitDistance, pixel, 0).r;
+    vec3 prevDir = dist >= SKY_DISTANCE ? dir
+                                        : u_camPos + dir*dist - u_prevCamPos;
+    vec3 prev = cameraProject(prevDir, u_prevCamTarget, u_prevScroll);
+
+    vec2 prevPixel = prev.xy*u_historySize.y + 0.5*u_historySize;
+    float weight = u_historyWeight;
+    if (prev.z <= 0.0 || any(lessThan(prevPixel, vec2(0.0))) || any(greaterThan(prevPixel, u_historySize))) {
+        weight = 0.0;
+    }
+
+    vec3 history = texture(u_history, prevPixel / vec2(textureSize(u_history, 0))).rgb;
+    history = clamp(history, lo, hi);
+    FragColor = vec4(mix(current, history, weight), 1.0);
+}
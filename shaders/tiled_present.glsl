@@ -0,0 +1,18 @@
+#version 430 core
+
+// Copies the images of the tiled compute path (raymarch_tiled.glsl) into
+// whatever target the scene pass would have drawn to, with the same outputs
+// as fragment.glsl.
+
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out float HitDistance;
+
+// Units 13-14, the lower left part of each is the frame
+layout (binding = 13) uniform sampler2D u_color;
+layout (binding = 14) uniform sampler2D u_hitDistance;
+
+void main() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    FragColor = texelFetch(u_color, pixel, 0);
+    HitDistance = texelFetch(u_hitDistance, pixel, 0).r;
+}
@@ -0,0 +1,52 @@
+#version 430 core
+
+// Upscales the dynamic resolution render target (src/dynamic_resolution.h)
+// to the window. Catmull-Rom bicubic in 9 bilinear taps, clamped to the four
+// nearest source pixels like FSR1's EASU so the negative lobes can't ring.
+
+layout (location = 0) out vec4 FragColor;
+
+uniform sampler2D u_source;
+uniform vec2 u_sourceSize;  // rendered pixels, the lower left part of u_source
+uniform vec2 u_outputSize;
+
+// Bilinear sample at a position in source pixels, kept inside the rendered area
+vec3 sampleSource(vec2 pos) {
+    pos = clamp(pos, vec2(0.5), u_sourceSize - 0.5);
+    return texture(u_source, pos / vec2(textureSize(u_source, 0))).rgb;
+}
+
+void main() {
+    vec2 pos = gl_FragCoord.xy / u_outputSize * u_sourceSize;
+    vec2 center = floor(pos - 0.5) + 0.5;
+    vec2 f = pos - center;
+
+    vec2 w0 = f * (-0.5 + f * (1.0 - 0.5 * f));
+    vec2 w1 = 1.0 + f * f * (-2.5 + 1.5 * f);
+    vec2 w2 = f * (0.5 + f * (2.0 - 1.5 * f));
+    vec2 w3 = f * f * (-0.5 + 0.5 * f);
+
+    // The two middle taps per axis share one bilinear fetch
+    vec2 w12 = w1 + w2;
+    vec2 p0 = center - 1.0;
+    vec2 p12 = center + w2 / w12;
+    vec2 p3 = center + 2.0;
+
+    vec3 col = sampleSource(vec2(p0.x, p0.y)) * w0.x * w0.y
+             + sampleSource(vec2(p12.x, p0.y)) * w12.x * w0.y
+             + sampleSource(vec2(p3.x, p0.y)) * w3.x * w0.y
+             + sampleSource(vec2(p0.x, p12.y)) * w0.x * w12.y
+             + sampleSource(vec2(p12.x, p12.y)) * w12.x * w12.y
+             + sampleSource(vec2(p3.x, p12.y)) * w3.x * w12.y
+             + sampleSource(vec2(p0.x, p3.y)) * w0.x * w3.y
+             + sampleSource(vec2(p12.x, p3.y)) * w12.x * w3.y
+             + sampleSource(vec2(p3.x, p3.y)) * w3.x * w3.y;
+
+    vec3 a = sampleSource(center);
+    vec3 b = sampleSource(center + vec2(1.0, 0.0));
+    vec3 c = sampleSource(center + vec2(0.0, 1.0));
+    vec3 d = sampleSource(center + vec2(1.0, 1.0));
+    col = clamp(col, min(min(a, b), min(c, d)), max(max(a, b), max(c, d)));
+
+    FragColor = vec4(col, 1.0);
+}
@@ -0,0 +1,230 @@
+#include "benchmark.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <vector>
+
+// Number of timer queries in flight; results are read back this many frames
+// late so reading them never waits on the GPU.
+#define QUERY_RING_SIZE 8
+
+// Blank lines and lines starting with '#' are ignored.
+bool loadCameraPath(const std::string& path, std::vector<CameraKey>& keys) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open camera path: " << path << std::endl;
+        return false;
+    }
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#') continue;
+
+        std::istringstream in(line);
+        CameraKey key;
+        if (!(in >> key.time >> key.camPos.x >> key.camPos.y >> key.camPos.z >> key.theta >> key.phi >> key.scroll >> key.renderMode)) {
+            std::cerr << path << ":" << lineNumber << ": expected 'time camX camY camZ theta phi scroll renderMode [flashlight]'\n";
+            return false;
+        }
+        if (!(in >> key.flashlight)) key.flashlight = 0;
+        keys.push_back(key);
+    }
+
+    if (keys.empty()) {
+        std::cerr << "Camera path has no frames: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+CameraKey cameraPathAt(const std::vector<CameraKey>& keys, float time) {
+    // Keys are in file order, which is expected to be by time
+    size_t next = 0;
+    while (next < keys.size() && keys[next].time <= time) next++;
+    if (next == 0) return keys.front();
+    if (next == keys.size()) return keys.back();
+
+    const CameraKey& a = keys[next - 1];
+    const CameraKey& b = keys[next];
+    float t = (time - a.time) / std::max(b.time - a.time, 1e-6f);
+    CameraKey key = a;
+    key.time = time;
+    key.camPos = glm::mix(a.camPos, b.camPos, t);
+    key.theta = glm::mix(a.theta, b.theta, t);
+    key.phi = glm::mix(a.phi, b.phi, t);
+    key.scroll = glm::mix(a.scroll, b.scroll, t);
+    return key;
+}
+
+void drawBenchmarkFrame(GLuint program, const BenchmarkOptions& options, const CameraKey& key) {
+    double theta = glm::radians((double)key.theta);
+    double phi = glm::radians((double)key.phi);
+    glm::vec3 camTarget = glm::normalize(glm::vec3(sin(theta) * cos(phi), cos(theta), sin(theta) * sin(phi)));
+
+    BenchmarkFrame frame = { key.time, key.camPos, camTarget, key.scroll, key.renderMode, key.flashlight != 0 };
+    FrameState state;
+    state.resolution = glm::vec2((float)options.width, (float)options.height);
+    state.camPos = key.camPos;
+    state.time = key.time;
+    state.camTarget = camTarget;
+    state.scroll = key.scroll;
+    state.flashlight = key.flashlight;
+    state.renderMode = key.renderMode;
+    if (options.prepareFrame) {
+        options.prepareFrame(frame, state);
+    }
+    options.frameState->update(0, &state, sizeof(state));
+    options.frameState->upload();
+    glUseProgram(program); // the hooks may have left another program bound
+    glClear(GL_COLOR_BUFFER_BIT);
+    if (options.drawScene) {
+        options.drawScene(frame);
+    } else {
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+    }
+    if (options.finishFrame) options.finishFrame(frame);
+    options.frameState->fence();
+}
+
+struct ModeStats {
+    double minMs, medianMs, p99Ms, meanMs;
+    size_t frames;
+};
+
+static ModeStats computeStats(std::vector<double> samples) {
+    std::sort(samples.begin(), samples.end());
+    ModeStats s;
+    s.frames = samples.size();
+    s.minMs = samples.front();
+    size_t n = samples.size();
+    s.medianMs = (n % 2) ? samples[n / 2] : 0.5 * (samples[n / 2 - 1] + samples[n / 2]);
+    // nearest-rank percentile
+    size_t rank = (size_t)std::ceil(0.99 * n);
+    s.p99Ms = samples[std::max<size_t>(rank, 1) - 1];
+    double sum = 0.0;
+    for (double v : samples) sum += v;
+    s.meanMs = sum / n;
+    return s;
+}
+
+static std::string jsonEscape(const char* s) {
+    std::string out;
+    for (; s && *s; s++) {
+        if (*s == '"' || *s == '\\') out += '\\';
+        out += *s;
+    }
+    return out;
+}
+
+bool runBenchmark(GLuint program, const BenchmarkOptions& options) {
+    std::vector<CameraKey> keys;
+    if (!loadCameraPath(options.cameraPath, keys)) {
+        return false;
+    }
+
+    // Offscreen target at the requested resolution, independent of the window size
+    GLuint fbo, colorTexture;
+    glGenTextures(1, &colorTexture);
+    glBindTexture(GL_TEXTURE_2D, colorTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, options.width, options.height);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Benchmark framebuffer is incomplete\n";
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteTextures(1, &colorTexture);
+        return false;
+    }
+    glViewport(0, 0, options.width, options.height);
+
+    for (int i = 0; i < options.warmupFrames; i++) {
+        drawBenchmarkFrame(program, options, keys[i % keys.size()]);
+    }
+    glFinish();
+
+    GLuint queries[QUERY_RING_SIZE];
+    int queryFrame[QUERY_RING_SIZE];
+    glGenQueries(QUERY_RING_SIZE, queries);
+    std::fill(queryFrame, queryFrame + QUERY_RING_SIZE, -1);
+
+    std::vector<double> frameMs(keys.size(), 0.0);
+    auto collect = [&](int slot) {
+        if (queryFrame[slot] < 0) return;
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &ns);
+        frameMs[queryFrame[slot]] = ns / 1.0e6;
+        queryFrame[slot] = -1;
+    };
+
+    for (size_t i = 0; i < keys.size(); i++) {
+        int slot = (int)(i % QUERY_RING_SIZE);
+        collect(slot);
+
+        glBeginQuery(GL_TIME_ELAPSED, queries[slot]);
+        drawBenchmarkFrame(program, options, keys[i]);
+        glEndQuery(GL_TIME_ELAPSED);
+        queryFrame[slot] = (int)i;
+        glFlush();
+    }
+    for (int slot = 0; slot < QUERY_RING_SIZE; slot++) {
+        collect(slot);
+    }
+
+    glDeleteQueries(QUERY_RING_SIZE, queries);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteTextures(1, &colorTexture);
+
+    std::map<int, std::vector<double>> byMode;
+    for (size_t i = 0; i < keys.size(); i++) {
+        byMode[keys[i].renderMode].push_back(frameMs[i]);
+    }
+
+    std::ostringstream json;
+    json << "{\n";
+    json << "  \"renderer\": \"" << jsonEscape((const char*)glGetString(GL_RENDERER)) << "\",\n";
+    json << "  \"version\": \"" << jsonEscape((const char*)glGetString(GL_VERSION)) << "\",\n";
+    json << "  \"camera_path\": \"" << jsonEscape(options.cameraPath.c_str()) << "\",\n";
+    json << "  \"width\": " << options.width << ",\n";
+    json << "  \"height\": " << options.height << ",\n";
+    json << "  \"frames\": " << keys.size() << ",\n";
+    json << "  \"modes\": {";
+    bool firstMode = true;
+    char buf[256];
+    for (const auto& entry : byMode) {
+        ModeStats s = computeStats(entry.second);
+        snprintf(buf, sizeof(buf),
+                 "%s\n    \"%d\": { \"frames\": %zu, \"min_ms\": %.3f, \"median_ms\": %.3f, \"p99_ms\": %.3f, \"mean_ms\": %.3f }",
+                 firstMode ? "" : ",", entry.first, s.frames, s.minMs, s.medianMs, s.p99Ms, s.meanMs);
+        json << buf;
+        firstMode = false;
+    }
+    json << "\n  }\n}\n";
+
+    if (options.outputPath.empty()) {
+        std::cout << json.str();
+    } else {
+        std::ofstream out(options.outputPath);
+        if (!out.is_open()) {
+            std::cerr << "Failed to write benchmark results: " << options.outputPath << std::endl;
+            return false;
+        }
+        out << json.str();
+        std::cout << "Benchmark results written to " << options.outputPath << std::endl;
+    }
+    return true;
+}
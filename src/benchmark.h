@@ -0,0 +1,65 @@
+#pragma once
+
+#include "frame_state.h"
+#include "stream_buffer.h"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// One line of a camera path file, see loadCameraPath()
+struct CameraKey {
+    float time;
+    glm::vec3 camPos;
+    float theta;    // degrees, same convention as calc_camdir()
+    float phi;      // degrees
+    float scroll;
+    int renderMode;
+    int flashlight;
+};
+
+// What drawFrame renders, for the hooks
+struct BenchmarkFrame {
+    float time;
+    glm::vec3 camPos;
+    glm::vec3 camTarget;
+    float scroll;
+    int renderMode;
+    bool flashlight;
+};
+
+struct BenchmarkOptions {
+    std::string cameraPath;  // camera path to play back, see loadCameraPath() in benchmark.cpp
+    std::string outputPath;  // JSON report, written to stdout when empty
+    int width = 1920;
+    int height = 1080;
+    int warmupFrames = 10;   // untimed frames so shader compilation doesn't skew the first samples
+    // The scene program's FrameState block (frame_state.h), written before each draw
+    StreamBuffer* frameState = nullptr;
+    // Optional, before each draw. May change the bound program and the
+    // frame's state, and the draw goes to whatever framebuffer it leaves bound.
+    std::function<void(const BenchmarkFrame& frame, FrameState& state)> prepareFrame;
+    // Optional, replaces drawing `program` on the quad (the tiled compute path).
+    // Draws into the framebuffer and viewport that are bound.
+    std::function<void(const BenchmarkFrame& frame)> drawScene;
+    // Optional, after each draw. Has to leave the benchmark framebuffer bound.
+    std::function<void(const BenchmarkFrame& frame)> finishFrame;
+};
+
+// One frame per line: time camX camY camZ theta phi scroll renderMode [flashlight]
+bool loadCameraPath(const std::string& path, std::vector<CameraKey>& keys);
+// The camera at `time`: position, angles and scroll interpolated linearly
+// between the keys around it, render mode and flashlight of the key before it
+CameraKey cameraPathAt(const std::vector<CameraKey>& keys, float time);
+
+// Writes the frame state for the key and draws `program` with the hooks of
+// `options`, into the framebuffer and viewport that are bound
+void drawBenchmarkFrame(GLuint program, const BenchmarkOptions& options, const CameraKey& key);
+
+// Renders every frame of the camera path into an offscreen FBO, times each draw
+// with GL_TIME_ELAPSED queries and reports min/median/p99 per u_renderMode.
+// Expects `program` to be in use with the fullscreen quad VAO, SSBO and textures bound.
+bool runBenchmark(GLuint program, const BenchmarkOptions& options);
@@ -0,0 +1,157 @@
+// Headless CPU reference renderer for the raymarched scene in shaders/fragment.glsl.
+// Renders a single frame without any GPU or GL context and writes it as a PNG,
+// or with --mesh writes the scene's surfaces as a triangle mesh instead.
+
+#include "mesher.h"
+#include "png.h"
+#include "renderer.h"
+#include "thread_pool.h"
+
+#include <glm/glm.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+static void usage(const char* exe) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --out <file.png>        output image (default: frame.png)\n"
+        "  --size <W>x<H>          resolution (default: 1080x720)\n"
+        "  --mode <0-4>            u_renderMode / supersampling level (default: 1)\n"
+        "  --time <seconds>        u_time (default: 0)\n"
+        "  --scroll <value>        u_scroll zoom (default: 0)\n"
+        "  --cam <x>,<y>,<z>       camera position (default: 0,2,-4)\n"
+        "  --theta <degrees>       camera polar angle (default: 45)\n"
+        "  --phi <degrees>         camera azimuth (default: 30)\n"
+        "  --flashlight            enable the camera flashlight\n"
+        "  --scene <file>          scene description (default: ../../scenes/default.scene)\n"
+        "  --texture <file.png>    texture for triPlanar (default: ../../textures/test.png)\n"
+        "  --threads <n>           worker threads (default: all cores)\n"
+        "  --tile <n>              tile size in pixels (default: 32)\n"
+        "  --mesh <file.obj|.ply>  mesh the scene at --time instead of rendering it\n"
+        "  --mesh-depth <n>        octree depth, 2^n cells across the bounds (default: 9)\n"
+        "  --mesh-bounds <x0>,<y0>,<z0>,<x1>,<y1>,<z1>\n"
+        "                          region to mesh (default: the bounded primitives)\n",
+        exe);
+}
+
+int main(int argc, char** argv) {
+    RenderSettings settings;
+    std::string outPath = "frame.png";
+    std::string texturePath = "../../textures/test.png";
+    std::string scenePath = "../../scenes/default.scene";
+    double theta = 45.0, phi = 30.0;
+    unsigned threads = 0;
+    int tileSize = 32;
+    std::string meshPath;
+    MeshOptions meshOptions;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--flashlight") {
+            settings.flashlight = true;
+        } else if (arg == "--out" && hasValue) {
+            outPath = argv[++i];
+        } else if (arg == "--size" && hasValue) {
+            if (sscanf(argv[++i], "%dx%d", &settings.width, &settings.height) != 2 || settings.width <= 0 || settings.height <= 0) {
+                std::cerr << "Invalid --size, expected <W>x<H>\n";
+                return EXIT_FAILURE;
+            }
+        } else if (arg == "--mode" && hasValue) {
+            settings.renderMode = atoi(argv[++i]);
+        } else if (arg == "--time" && hasValue) {
+            settings.time = (float)atof(argv[++i]);
+        } else if (arg == "--scroll" && hasValue) {
+            settings.scroll = (float)atof(argv[++i]);
+        } else if (arg == "--cam" && hasValue) {
+            glm::vec3& p = settings.camPos;
+            if (sscanf(argv[++i], "%f,%f,%f", &p.x, &p.y, &p.z) != 3) {
+                std::cerr << "Invalid --cam, expected <x>,<y>,<z>\n";
+                return EXIT_FAILURE;
+            }
+        } else if (arg == "--theta" && hasValue) {
+            theta = atof(argv[++i]);
+        } else if (arg == "--phi" && hasValue) {
+            phi = atof(argv[++i]);
+        } else if (arg == "--scene" && hasValue) {
+            scenePath = argv[++i];
+        } else if (arg == "--texture" && hasValue) {
+            texturePath = argv[++i];
+        } else if (arg == "--threads" && hasValue) {
+            threads = (unsigned)atoi(argv[++i]);
+        } else if (arg == "--tile" && hasValue) {
+            tileSize = atoi(argv[++i]);
+        } else if (arg == "--mesh" && hasValue) {
+            meshPath = argv[++i];
+        } else if (arg == "--mesh-depth" && hasValue) {
+            meshOptions.depth = atoi(argv[++i]);
+        } else if (arg == "--mesh-bounds" && hasValue) {
+            glm::vec3& lo = meshOptions.boundsMin;
+            glm::vec3& hi = meshOptions.boundsMax;
+            if (sscanf(argv[++i], "%f,%f,%f,%f,%f,%f", &lo.x, &lo.y, &lo.z, &hi.x, &hi.y, &hi.z) != 6 ||
+                glm::any(glm::greaterThanEqual(lo, hi))) {
+                std::cerr << "Invalid --mesh-bounds, expected <x0>,<y0>,<z0>,<x1>,<y1>,<z1> with x0 < x1 etc.\n";
+                return EXIT_FAILURE;
+            }
+        } else {
+            usage(argv[0]);
+            return arg == "--help" ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    // Same spherical convention as calc_camdir() in the interactive app
+    double t = glm::radians(theta), p = glm::radians(phi);
+    settings.camTarget = glm::normalize(glm::vec3(sin(t) * cos(p), cos(t), sin(t) * sin(p)));
+
+    if (!loadScene(scenePath, settings.primitives, &settings.animations)) {
+        return EXIT_FAILURE;
+    }
+
+    if (!meshPath.empty()) {
+        ThreadPool pool(threads);
+        SceneSDF scene;
+        scene.primitives = settings.primitives;
+        animateScene(settings.animations, settings.time, scene.primitives);
+        buildSceneGrid(scene.primitives, scene.grid);
+
+        Mesh mesh;
+        auto start = std::chrono::steady_clock::now();
+        if (!extractMesh(scene, meshOptions, pool, mesh)) {
+            return EXIT_FAILURE;
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        printf("Meshed %zu triangles, %zu vertices (%zu octree cells at depth %d) in %.1f ms on %u threads\n",
+               mesh.triangles.size(), mesh.positions.size(), mesh.leafCells, meshOptions.depth,
+               std::chrono::duration<double, std::milli>(end - start).count(), pool.size());
+        return writeMesh(meshPath, mesh) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    Texture texture;
+    if (texture.load(texturePath)) {
+        settings.texture = &texture;
+    } else {
+        std::cerr << "Continuing without texture, textured materials render white\n";
+    }
+
+    ThreadPool pool(threads);
+    std::vector<unsigned char> rgb;
+
+    auto start = std::chrono::steady_clock::now();
+    renderImage(settings, pool, tileSize, rgb);
+    auto end = std::chrono::steady_clock::now();
+
+    printf("Rendered %dx%d (mode %d) in %.1f ms on %u threads\n", settings.width, settings.height, settings.renderMode,
+           std::chrono::duration<double, std::milli>(end - start).count(), pool.size());
+
+    if (!writePNG(outPath, settings.width, settings.height, rgb)) {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,430 @@
+#include "mesher.h"
+
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+
+#define KEY_BITS 21
+#define KEY_MASK ((1ull << KEY_BITS) - 1)
+
+// Pull of a cell's vertex towards the mean of its edge crossings, keeps the
+// fit stable where the tangent planes are (nearly) parallel
+static const float QEF_BIAS = 0.05f;
+// Headroom on the distance bound when culling octree nodes: fBlob and the
+// mandelbulb's distance estimate overshoot near the surface, and culling on
+// the plain bound leaves holes in them
+static const float CULL_SLACK = 1.5f;
+// Gradient step relative to the finest cell size
+static const float NORMAL_STEP = 0.05f;
+
+static float longestSide(glm::vec3 lo, glm::vec3 hi) {
+    glm::vec3 size = hi - lo;
+    return std::max(size.x, std::max(size.y, size.z));
+}
+
+// Octree node or cell corner at integer coordinates of its level
+static uint64_t packKey(glm::uvec3 k) {
+    return (uint64_t)k.x | ((uint64_t)k.y << KEY_BITS) | ((uint64_t)k.z << (2 * KEY_BITS));
+}
+
+static glm::uvec3 unpackKey(uint64_t key) {
+    return glm::uvec3(key & KEY_MASK, (key >> KEY_BITS) & KEY_MASK, key >> (2 * KEY_BITS));
+}
+
+// Runs body(begin, end) over [0, count) in MESH_BATCH slices across the pool
+static void parallelBatches(ThreadPool& pool, size_t count, const std::function<void(size_t, size_t)>& body) {
+    int batches = (int)((count + MESH_BATCH - 1) / MESH_BATCH);
+    pool.parallelFor(batches, [&](int b) {
+        size_t begin = (size_t)b * MESH_BATCH;
+        body(begin, std::min(begin + MESH_BATCH, count));
+    });
+}
+
+// calcSceneSDF() at count points, SIMD_WIDTH at a time; id may be null
+static void evalPoints(const SceneSDF& scene, const glm::vec3* points, size_t count, float* dist, float* id) {
+    for (size_t i = 0; i < count; i += SIMD_WIDTH) {
+        float x[SIMD_WIDTH], y[SIMD_WIDTH], z[SIMD_WIDTH];
+        for (int l = 0; l < SIMD_WIDTH; l++) {
+            // lanes past the end repeat the last point
+            const glm::vec3& p = points[std::min(i + l, count - 1)];
+            x[l] = p.x;
+            y[l] = p.y;
+            z[l] = p.z;
+        }
+        SceneHit hit = calcSceneSDF(scene, vfloat3(vfloat::load(x), vfloat::load(y), vfloat::load(z)));
+        float d[SIMD_WIDTH], m[SIMD_WIDTH];
+        hit.dist.store(d);
+        hit.id.store(m);
+        for (int l = 0; l < SIMD_WIDTH && i + l < count; l++) {
+            dist[i + l] = d[l];
+            if (id) id[i + l] = m[l];
+        }
+    }
+}
+
+// calcNormal() with the tetrahedron technique, 4 evaluations per point
+static void evalNormals(const SceneSDF& scene, const glm::vec3* points, size_t count, float step, glm::vec3* normals) {
+    static const glm::vec3 k[4] = { glm::vec3(1, -1, -1), glm::vec3(-1, -1, 1), glm::vec3(-1, 1, -1), glm::vec3(1, 1, 1) };
+    glm::vec3 offset[SIMD_WIDTH];
+    float d[SIMD_WIDTH];
+    for (size_t i = 0; i < count; i += SIMD_WIDTH) {
+        size_t n = std::min((size_t)SIMD_WIDTH, count - i);
+        glm::vec3 sum[SIMD_WIDTH] = {};
+        for (int t = 0; t < 4; t++) {
+            for (size_t l = 0; l < n; l++) offset[l] = points[i + l] + k[t] * step;
+            evalPoints(scene, offset, n, d, nullptr);
+            for (size_t l = 0; l < n; l++) sum[l] += k[t] * d[l];
+        }
+        for (size_t l = 0; l < n; l++) {
+            float len = glm::length(sum[l]);
+            normals[i + l] = len > 0.0f ? sum[l] / len : glm::vec3(0.0f);
+        }
+    }
+}
+
+namespace {
+
+// Finest octree cell with corners on both sides of the surface
+struct Cell {
+    uint64_t key;
+    uint32_t corners[8]; // into the corner arrays, bit 0 of the index is +x, bit 1 +y, bit 2 +z
+};
+
+} // namespace
+
+bool extractMesh(const SceneSDF& scene, const MeshOptions& options, ThreadPool& pool, Mesh& mesh) {
+    mesh = Mesh();
+    int depth = options.depth;
+    if (depth < 1 || depth > MESH_MAX_DEPTH) {
+        std::cerr << "Mesh depth must be between 1 and " << MESH_MAX_DEPTH << std::endl;
+        return false;
+    }
+
+    glm::vec3 lo = options.boundsMin, hi = options.boundsMax;
+    if (glm::any(glm::greaterThan(lo, hi))) {
+        lo = glm::vec3(std::numeric_limits<float>::max());
+        hi = -lo;
+        for (const ScenePrimitive& prim : scene.primitives) {
+            if (!isBounded(prim)) continue;
+            glm::vec3 pmin, pmax;
+            primitiveBounds(prim, pmin, pmax);
+            lo = glm::min(lo, pmin);
+            hi = glm::max(hi, pmax);
+        }
+        if (lo.x > hi.x) {
+            std::cerr << "The scene has no bounded primitives, the region to mesh must be given" << std::endl;
+            return false;
+        }
+        // two finest cells of room so closed surfaces are not cut open at the bounds
+        glm::vec3 pad(2.0f * longestSide(lo, hi) / (float)(1u << depth));
+        lo -= pad;
+        hi += pad;
+    }
+
+    // The octree root is the cube around the bounds
+    float side = std::max(longestSide(lo, hi), 1e-6f);
+    glm::vec3 origin = 0.5f * (lo + hi) - glm::vec3(0.5f * side);
+    float cellSize = side / (float)(1u << depth);
+
+    // Breadth first: a node is kept when the surface may pass through it,
+    // i.e. its centre is no further from the surface than its corners are
+    std::vector<uint64_t> nodes(1, 0), leaves;
+    std::vector<uint8_t> keep;
+    for (int level = 0; level <= depth; level++) {
+        float size = side / (float)(1u << level);
+        float reach = CULL_SLACK * 0.5f * std::sqrt(3.0f) * size;
+        keep.assign(nodes.size(), 0);
+        parallelBatches(pool, nodes.size(), [&](size_t begin, size_t end) {
+            glm::vec3 centers[MESH_BATCH] = {};
+            float dist[MESH_BATCH];
+            for (size_t i = begin; i < end; i++) {
+                centers[i - begin] = origin + (glm::vec3(unpackKey(nodes[i])) + 0.5f) * size;
+            }
+            evalPoints(scene, centers, end - begin, dist, nullptr);
+            for (size_t i = begin; i < end; i++) {
+                glm::vec3 nodeMin = centers[i - begin] - 0.5f * size;
+                bool overlaps = glm::all(glm::lessThanEqual(nodeMin, hi)) && glm::all(glm::greaterThanEqual(nodeMin + size, lo));
+                keep[i] = overlaps && std::abs(dist[i - begin]) <= reach;
+            }
+        });
+
+        std::vector<uint64_t> next;
+        for (size_t i = 0; i < nodes.size(); i++) {
+            if (!keep[i]) continue;
+            if (level == depth) {
+                next.push_back(nodes[i]);
+                continue;
+            }
+            glm::uvec3 k = unpackKey(nodes[i]) * 2u;
+            for (unsigned c = 0; c < 8; c++) {
+                next.push_back(packKey(k + glm::uvec3(c & 1, (c >> 1) & 1, c >> 2)));
+            }
+        }
+        nodes.swap(next);
+    }
+    leaves.swap(nodes);
+    std::sort(leaves.begin(), leaves.end());
+    mesh.leafCells = leaves.size();
+
+    // Corners shared by neighbouring leaves are evaluated once
+    std::vector<uint64_t> corners;
+    corners.reserve(leaves.size() * 8);
+    for (uint64_t leaf : leaves) {
+        glm::uvec3 k = unpackKey(leaf);
+        for (unsigned c = 0; c < 8; c++) {
+            corners.push_back(packKey(k + glm::uvec3(c & 1, (c >> 1) & 1, c >> 2)));
+        }
+    }
+    std::sort(corners.begin(), corners.end());
+    corners.erase(std::unique(corners.begin(), corners.end()), corners.end());
+
+    std::vector<float> cornerDist(corners.size()), cornerId(corners.size());
+    parallelBatches(pool, corners.size(), [&](size_t begin, size_t end) {
+        glm::vec3 points[MESH_BATCH];
+        for (size_t i = begin; i < end; i++) {
+            points[i - begin] = origin + glm::vec3(unpackKey(corners[i])) * cellSize;
+        }
+        evalPoints(scene, points, end - begin, &cornerDist[begin], &cornerId[begin]);
+    });
+    auto inside = [&](uint32_t corner) { return cornerDist[corner] < 0.0f; };
+
+    // Leaves the surface actually crosses, still sorted by key
+    size_t batchCount = (leaves.size() + MESH_BATCH - 1) / MESH_BATCH;
+    std::vector<std::vector<Cell>> batchCells(batchCount);
+    parallelBatches(pool, leaves.size(), [&](size_t begin, size_t end) {
+        std::vector<Cell>& out = batchCells[begin / MESH_BATCH];
+        for (size_t i = begin; i < end; i++) {
+            Cell cell;
+            cell.key = leaves[i];
+            glm::uvec3 k = unpackKey(leaves[i]);
+            int insideCount = 0;
+            for (unsigned c = 0; c < 8; c++) {
+                uint64_t key = packKey(k + glm::uvec3(c & 1, (c >> 1) & 1, c >> 2));
+                cell.corners[c] = (uint32_t)(std::lower_bound(corners.begin(), corners.end(), key) - corners.begin());
+                insideCount += inside(cell.corners[c]);
+            }
+            if (insideCount > 0 && insideCount < 8) out.push_back(cell);
+        }
+    });
+    std::vector<uint64_t>().swap(leaves);
+
+    std::vector<Cell> cells;
+    for (std::vector<Cell>& batch : batchCells) {
+        cells.insert(cells.end(), batch.begin(), batch.end());
+        std::vector<Cell>().swap(batch);
+    }
+    std::vector<uint64_t> cellKeys(cells.size());
+    for (size_t i = 0; i < cells.size(); i++) cellKeys[i] = cells[i].key;
+
+    // One vertex per cell, minimising the squared distances to the tangent
+    // planes at the cell's edge crossings
+    std::vector<glm::vec3> positions(cells.size()), normals(cells.size());
+    parallelBatches(pool, cells.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            const Cell& cell = cells[i];
+            glm::vec3 base = origin + glm::vec3(unpackKey(cell.key)) * cellSize;
+            glm::vec3 points[12], planeNormals[12];
+            size_t count = 0;
+            for (unsigned axis = 0; axis < 3; axis++) {
+                unsigned bit = 1u << axis;
+                for (unsigned c = 0; c < 8; c++) {
+                    if (c & bit) continue;
+                    uint32_t a = cell.corners[c], b = cell.corners[c | bit];
+                    if (inside(a) == inside(b)) continue;
+                    float t = cornerDist[a] / (cornerDist[a] - cornerDist[b]);
+                    glm::vec3 pa = base + glm::vec3(c & 1, (c >> 1) & 1, c >> 2) * cellSize;
+                    glm::vec3 pb = pa;
+                    pb[axis] += cellSize;
+                    points[count++] = glm::mix(pa, pb, t);
+                }
+            }
+            evalNormals(scene, points, count, NORMAL_STEP * cellSize, planeNormals);
+
+            glm::vec3 mass(0.0f), normal(0.0f);
+            for (size_t p = 0; p < count; p++) {
+                mass += points[p];
+                normal += planeNormals[p];
+            }
+            mass /= (float)count;
+
+            // Solved around the mass point, which also keeps the numbers small
+            glm::mat3 ata(QEF_BIAS);
+            glm::vec3 atb(0.0f);
+            for (size_t p = 0; p < count; p++) {
+                const glm::vec3& n = planeNormals[p];
+                ata += glm::outerProduct(n, n);
+                atb += n * glm::dot(n, points[p] - mass);
+            }
+            glm::vec3 vertex = mass + glm::inverse(ata) * atb;
+            positions[i] = glm::clamp(vertex, base, base + cellSize);
+
+            float len = glm::length(normal);
+            normals[i] = len > 0.0f ? normal / len : glm::vec3(0.0f, 1.0f, 0.0f);
+        }
+    });
+
+    // A quad around every crossed edge, each edge is handled by the cell at
+    // its low end. Cells missing around an edge (at the bounds) leave a hole.
+    auto findCell = [&](glm::ivec3 k) -> int64_t {
+        if (glm::any(glm::lessThan(k, glm::ivec3(0)))) return -1;
+        uint64_t key = packKey(glm::uvec3(k));
+        auto it = std::lower_bound(cellKeys.begin(), cellKeys.end(), key);
+        return it != cellKeys.end() && *it == key ? it - cellKeys.begin() : -1;
+    };
+    batchCount = (cells.size() + MESH_BATCH - 1) / MESH_BATCH;
+    std::vector<std::vector<glm::uvec3>> batchTriangles(batchCount);
+    std::vector<std::vector<int>> batchMaterials(batchCount);
+    parallelBatches(pool, cells.size(), [&](size_t begin, size_t end) {
+        std::vector<glm::uvec3>& triangles = batchTriangles[begin / MESH_BATCH];
+        std::vector<int>& materials = batchMaterials[begin / MESH_BATCH];
+        for (size_t i = begin; i < end; i++) {
+            const Cell& cell = cells[i];
+            glm::ivec3 k(unpackKey(cell.key));
+            uint32_t c0 = cell.corners[0];
+            for (int axis = 0; axis < 3; axis++) {
+                uint32_t c1 = cell.corners[1 << axis];
+                if (inside(c0) == inside(c1)) continue;
+
+                // The four cells around the edge, counter-clockwise about +axis
+                glm::ivec3 u(0), v(0);
+                u[(axis + 1) % 3] = 1;
+                v[(axis + 2) % 3] = 1;
+                int64_t quad[4] = { (int64_t)i, findCell(k - u), findCell(k - u - v), findCell(k - v) };
+                if (quad[1] < 0 || quad[2] < 0 || quad[3] < 0) continue;
+                // the outside is where the edge leaves the solid
+                if (!inside(c0)) std::swap(quad[1], quad[3]);
+
+                int material = (int)cornerId[inside(c0) ? c0 : c1];
+                glm::vec3 p[4];
+                for (int q = 0; q < 4; q++) p[q] = positions[quad[q]];
+                // split along the shorter diagonal
+                if (glm::length(p[0] - p[2]) <= glm::length(p[1] - p[3])) {
+                    triangles.emplace_back(quad[0], quad[1], quad[2]);
+                    triangles.emplace_back(quad[0], quad[2], quad[3]);
+                } else {
+                    triangles.emplace_back(quad[0], quad[1], quad[3]);
+                    triangles.emplace_back(quad[1], quad[2], quad[3]);
+                }
+                materials.push_back(material);
+                materials.push_back(material);
+            }
+        }
+    });
+
+    // Drop the vertices no quad uses and number the rest in order of first use
+    std::vector<uint32_t> remap(cells.size(), UINT32_MAX);
+    for (size_t b = 0; b < batchCount; b++) {
+        for (glm::uvec3 tri : batchTriangles[b]) {
+            for (int j = 0; j < 3; j++) {
+                uint32_t& index = remap[tri[j]];
+                if (index == UINT32_MAX) {
+                    index = (uint32_t)mesh.positions.size();
+                    mesh.positions.push_back(positions[tri[j]]);
+                    mesh.normals.push_back(normals[tri[j]]);
+                }
+                tri[j] = index;
+            }
+            mesh.triangles.push_back(tri);
+        }
+        mesh.materials.insert(mesh.materials.end(), batchMaterials[b].begin(), batchMaterials[b].end());
+    }
+    return true;
+}
+
+static bool writeOBJ(const std::string& path, const Mesh& mesh) {
+    std::ofstream file(path);
+    if (!file) {
+        std::cerr << "Failed to open output mesh: " << path << std::endl;
+        return false;
+    }
+
+    // usemtl groups, triangles keep their order within a material
+    std::vector<uint32_t> order(mesh.triangles.size());
+    for (uint32_t i = 0; i < order.size(); i++) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return mesh.materials[a] < mesh.materials[b]; });
+
+    char line[128];
+    file << "# Sangatsu scene mesh, " << mesh.positions.size() << " vertices, " << mesh.triangles.size() << " triangles\n";
+    for (const glm::vec3& p : mesh.positions) {
+        snprintf(line, sizeof(line), "v %.6g %.6g %.6g\n", p.x, p.y, p.z);
+        file << line;
+    }
+    for (const glm::vec3& n : mesh.normals) {
+        snprintf(line, sizeof(line), "vn %.4f %.4f %.4f\n", n.x, n.y, n.z);
+        file << line;
+    }
+    int material = -1;
+    for (uint32_t t : order) {
+        if (mesh.materials[t] != material) {
+            material = mesh.materials[t];
+            file << "usemtl material" << material << "\n";
+        }
+        glm::uvec3 tri = mesh.triangles[t] + 1u; // OBJ indices start at 1
+        snprintf(line, sizeof(line), "f %u//%u %u//%u %u//%u\n", tri.x, tri.x, tri.y, tri.y, tri.z, tri.z);
+        file << line;
+    }
+    if (!file) {
+        std::cerr << "Failed to write output mesh: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static bool writePLY(const std::string& path, const Mesh& mesh) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Failed to open output mesh: " << path << std::endl;
+        return false;
+    }
+
+    file << "ply\n"
+            "format binary_little_endian 1.0\n"
+            "comment Sangatsu scene mesh\n"
+            "element vertex " << mesh.positions.size() << "\n"
+            "property float x\n"
+            "property float y\n"
+            "property float z\n"
+            "property float nx\n"
+            "property float ny\n"
+            "property float nz\n"
+            "element face " << mesh.triangles.size() << "\n"
+            "property list uchar int vertex_indices\n"
+            "property int material\n"
+            "end_header\n";
+
+    // x86 is little endian like the format, the records are copied as they are
+    std::vector<unsigned char> data;
+    data.reserve(mesh.positions.size() * 24 + mesh.triangles.size() * 17);
+    auto put = [&](const void* p, size_t n) {
+        const unsigned char* bytes = (const unsigned char*)p;
+        data.insert(data.end(), bytes, bytes + n);
+    };
+    for (size_t i = 0; i < mesh.positions.size(); i++) {
+        put(&mesh.positions[i], sizeof(glm::vec3));
+        put(&mesh.normals[i], sizeof(glm::vec3));
+    }
+    for (size_t i = 0; i < mesh.triangles.size(); i++) {
+        unsigned char count = 3;
+        int32_t record[4] = { (int32_t)mesh.triangles[i].x, (int32_t)mesh.triangles[i].y, (int32_t)mesh.triangles[i].z, mesh.materials[i] };
+        put(&count, 1);
+        put(record, sizeof(record));
+    }
+    file.write((const char*)data.data(), (std::streamsize)data.size());
+    if (!file) {
+        std::cerr << "Failed to write output mesh: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool writeMesh(const std::string& path, const Mesh& mesh) {
+    bool ply = path.size() >= 4 && path.compare(path.size() - 4, 4, ".ply") == 0;
+    return ply ? writePLY(path, mesh) : writeOBJ(path, mesh);
+}
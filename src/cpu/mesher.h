@@ -0,0 +1,53 @@
+#pragma once
+
+#include "scene_sdf.h"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+// Deepest octree level; cell corners are packed into 21 bits per axis
+#define MESH_MAX_DEPTH 20
+// Octree nodes or cells per pool task
+#define MESH_BATCH 4096
+
+struct MeshOptions {
+    int depth = 9; // octree levels, the finest cells are 2^-depth of the bounds' longest side
+    // Region to mesh, surfaces are cut open at its faces. When min > max the
+    // bounded primitives' AABBs are used, so unbounded planes get trimmed to them.
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(-1.0f);
+};
+
+// Indexed triangle mesh, counter-clockwise seen from outside
+struct Mesh {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;     // per vertex, from the SDF gradient
+    std::vector<glm::uvec3> triangles;
+    std::vector<int> materials;         // per triangle, the minID() material of the solid behind it
+    size_t leafCells = 0;               // finest octree cells the surface may pass through
+};
+
+// Meshes the zero isosurface of calcSceneSDF() with dual contouring.
+//
+// The octree is walked breadth first and a node is only split when its
+// centre is within about half a diagonal of the surface, so the nodes kept
+// at each level, the finest cells and their corners all scale with the
+// surface area rather than the volume of the bounds; nothing is ever stored
+// per voxel of the full grid. Every level's nodes, the cell corners and the cells' vertices
+// are evaluated in SIMD packets spread over the pool.
+//
+// Each cell with corners on both sides of the surface gets one vertex, placed
+// by a least squares fit to the tangent planes at its edge crossings so the
+// boxes' and the Menger sponge's sharp edges survive, and each edge crossing
+// becomes a quad between the four cells around it. Detail below the cell size
+// (a deep Menger sponge at low depth) comes out as a noisy, partly non-manifold shell.
+bool extractMesh(const SceneSDF& scene, const MeshOptions& options, ThreadPool& pool, Mesh& mesh);
+
+// Writes .ply files as binary PLY with a per face material property and
+// anything else as Wavefront OBJ with one usemtl group per material.
+bool writeMesh(const std::string& path, const Mesh& mesh);
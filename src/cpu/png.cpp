@@ -0,0 +1,360 @@
+#include "png.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+
+static uint32_t crc32(const unsigned char* data, size_t len, uint32_t crc = 0) {
+    // Frame export writes PNGs from several encoder threads at once
+    static uint32_t table[256];
+    static std::once_flag tableReady;
+    std::call_once(tableReady, [] {
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+    });
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void putU32(std::vector<unsigned char>& out, uint32_t v) {
+    out.push_back((unsigned char)(v >> 24));
+    out.push_back((unsigned char)(v >> 16));
+    out.push_back((unsigned char)(v >> 8));
+    out.push_back((unsigned char)v);
+}
+
+static uint32_t getU32(const unsigned char* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void writeChunk(std::ofstream& file, const char* type, const std::vector<unsigned char>& data) {
+    std::vector<unsigned char> chunk;
+    putU32(chunk, (uint32_t)data.size());
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    putU32(chunk, crc32(chunk.data() + 4, chunk.size() - 4));
+    file.write((const char*)chunk.data(), chunk.size());
+}
+
+bool writePNG(const std::string& path, int width, int height, const std::vector<unsigned char>& rgb) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open output image: " << path << std::endl;
+        return false;
+    }
+
+    static const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+    file.write((const char*)signature, 8);
+
+    std::vector<unsigned char> header;
+    putU32(header, (uint32_t)width);
+    putU32(header, (uint32_t)height);
+    header.insert(header.end(), { 8, 2, 0, 0, 0 }); // 8-bit, RGB, deflate, no filter, no interlace
+    writeChunk(file, "IHDR", header);
+
+    // Raw scanlines, each prefixed with filter type 0
+    size_t stride = (size_t)width * 3;
+    std::vector<unsigned char> raw;
+    raw.reserve((stride + 1) * height);
+    for (int y = 0; y < height; y++) {
+        raw.push_back(0);
+        raw.insert(raw.end(), rgb.begin() + y * stride, rgb.begin() + (y + 1) * stride);
+    }
+
+    std::vector<unsigned char> zlib = { 0x78, 0x01 };
+    uint32_t a = 1, b = 0;
+    for (unsigned char c : raw) {
+        a = (a + c) % 65521;
+        b = (b + a) % 65521;
+    }
+    size_t pos = 0;
+    do {
+        size_t len = std::min<size_t>(65535, raw.size() - pos);
+        bool last = pos + len == raw.size();
+        zlib.push_back(last ? 1 : 0);
+        zlib.push_back((unsigned char)len);
+        zlib.push_back((unsigned char)(len >> 8));
+        zlib.push_back((unsigned char)~len);
+        zlib.push_back((unsigned char)(~len >> 8));
+        zlib.insert(zlib.end(), raw.begin() + pos, raw.begin() + pos + len);
+        pos += len;
+    } while (pos < raw.size());
+    putU32(zlib, (b << 16) | a);
+    writeChunk(file, "IDAT", zlib);
+    writeChunk(file, "IEND", {});
+
+    return file.good();
+}
+
+// Inflate (RFC 1951), enough to read what common encoders produce.
+namespace {
+
+struct BitReader {
+    const unsigned char* data;
+    size_t size;
+    size_t pos = 0;
+    uint32_t bitBuf = 0;
+    int bitCount = 0;
+    bool overrun = false;
+
+    int bits(int n) {
+        while (bitCount < n) {
+            uint32_t byte = 0;
+            if (pos < size) byte = data[pos++];
+            else overrun = true;
+            bitBuf |= byte << bitCount;
+            bitCount += 8;
+        }
+        int v = bitBuf & ((1u << n) - 1);
+        bitBuf >>= n;
+        bitCount -= n;
+        return v;
+    }
+};
+
+struct Huffman {
+    uint16_t counts[16];
+    uint16_t symbols[288];
+
+    void build(const uint8_t* lengths, int n) {
+        memset(counts, 0, sizeof(counts));
+        for (int i = 0; i < n; i++) counts[lengths[i]]++;
+        counts[0] = 0;
+        uint16_t offsets[16];
+        offsets[1] = 0;
+        for (int i = 1; i < 15; i++) offsets[i + 1] = offsets[i] + counts[i];
+        for (int i = 0; i < n; i++) {
+            if (lengths[i]) symbols[offsets[lengths[i]]++] = (uint16_t)i;
+        }
+    }
+
+    int decode(BitReader& br) const {
+        int code = 0, first = 0, index = 0;
+        for (int len = 1; len < 16; len++) {
+            code |= br.bits(1);
+            int count = counts[len];
+            if (code - count < first) return symbols[index + (code - first)];
+            index += count;
+            first += count;
+            first <<= 1;
+            code <<= 1;
+        }
+        return -1;
+    }
+};
+
+const uint16_t lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+const uint8_t lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+const uint16_t distBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+const uint8_t distExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+bool inflateBlock(BitReader& br, const Huffman& lit, const Huffman& dist, std::vector<unsigned char>& out) {
+    for (;;) {
+        int sym = lit.decode(br);
+        if (sym < 0 || br.overrun) return false;
+        if (sym < 256) {
+            out.push_back((unsigned char)sym);
+        } else if (sym == 256) {
+            return true;
+        } else {
+            sym -= 257;
+            if (sym >= 29) return false;
+            int len = lengthBase[sym] + br.bits(lengthExtra[sym]);
+            int dsym = dist.decode(br);
+            if (dsym < 0 || dsym >= 30) return false;
+            size_t d = distBase[dsym] + br.bits(distExtra[dsym]);
+            if (d > out.size()) return false;
+            size_t from = out.size() - d;
+            for (int i = 0; i < len; i++) out.push_back(out[from + i]);
+        }
+    }
+}
+
+bool inflate(const unsigned char* data, size_t size, std::vector<unsigned char>& out) {
+    if (size < 2) return false;
+    BitReader br{ data + 2, size - 2 }; // skip the zlib header
+    int last;
+    do {
+        last = br.bits(1);
+        int type = br.bits(2);
+        if (type == 0) {
+            br.bitBuf = 0;
+            br.bitCount = 0;
+            if (br.pos + 4 > br.size) return false;
+            size_t len = br.data[br.pos] | (br.data[br.pos + 1] << 8);
+            br.pos += 4;
+            if (br.pos + len > br.size) return false;
+            out.insert(out.end(), br.data + br.pos, br.data + br.pos + len);
+            br.pos += len;
+        } else if (type == 1) {
+            uint8_t lengths[288];
+            int i = 0;
+            for (; i < 144; i++) lengths[i] = 8;
+            for (; i < 256; i++) lengths[i] = 9;
+            for (; i < 280; i++) lengths[i] = 7;
+            for (; i < 288; i++) lengths[i] = 8;
+            Huffman lit, dist;
+            lit.build(lengths, 288);
+            for (i = 0; i < 30; i++) lengths[i] = 5;
+            dist.build(lengths, 30);
+            if (!inflateBlock(br, lit, dist, out)) return false;
+        } else if (type == 2) {
+            int hlit = br.bits(5) + 257;
+            int hdist = br.bits(5) + 1;
+            int hclen = br.bits(4) + 4;
+            static const uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+            uint8_t codeLengths[19] = { 0 };
+            for (int i = 0; i < hclen; i++) codeLengths[order[i]] = (uint8_t)br.bits(3);
+            Huffman lenCode;
+            lenCode.build(codeLengths, 19);
+
+            uint8_t lengths[320] = { 0 };
+            int n = 0;
+            while (n < hlit + hdist) {
+                int sym = lenCode.decode(br);
+                if (sym < 0 || br.overrun) return false;
+                if (sym < 16) {
+                    lengths[n++] = (uint8_t)sym;
+                    continue;
+                }
+                int repeat;
+                uint8_t value = 0;
+                if (sym == 16) {
+                    if (n == 0) return false;
+                    value = lengths[n - 1];
+                    repeat = 3 + br.bits(2);
+                } else if (sym == 17) {
+                    repeat = 3 + br.bits(3);
+                } else {
+                    repeat = 11 + br.bits(7);
+                }
+                if (n + repeat > hlit + hdist) return false;
+                while (repeat--) lengths[n++] = value;
+            }
+            Huffman lit, dist;
+            lit.build(lengths, hlit);
+            dist.build(lengths + hlit, hdist);
+            if (!inflateBlock(br, lit, dist, out)) return false;
+        } else {
+            return false;
+        }
+    } while (!last);
+    return true;
+}
+
+int paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    if (pa <= pb && pa <= pc) return a;
+    if (pb <= pc) return b;
+    return c;
+}
+
+} // namespace
+
+bool loadPNG(const std::string& path, int& width, int& height, std::vector<unsigned char>& rgba) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open image: " << path << std::endl;
+        return false;
+    }
+    std::vector<unsigned char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (bytes.size() < 8 || memcmp(bytes.data(), "\x89PNG\r\n\x1a\n", 8) != 0) {
+        std::cerr << "Not a PNG file: " << path << std::endl;
+        return false;
+    }
+
+    int bitDepth = 0, colorType = 0, interlace = 0;
+    std::vector<unsigned char> idat, palette;
+    size_t pos = 8;
+    while (pos + 8 <= bytes.size()) {
+        uint32_t len = getU32(&bytes[pos]);
+        const unsigned char* type = &bytes[pos + 4];
+        const unsigned char* data = &bytes[pos + 8];
+        if (pos + 12 + len > bytes.size()) break;
+        if (!memcmp(type, "IHDR", 4)) {
+            width = (int)getU32(data);
+            height = (int)getU32(data + 4);
+            bitDepth = data[8];
+            colorType = data[9];
+            interlace = data[12];
+        } else if (!memcmp(type, "PLTE", 4)) {
+            palette.assign(data, data + len);
+        } else if (!memcmp(type, "IDAT", 4)) {
+            idat.insert(idat.end(), data, data + len);
+        } else if (!memcmp(type, "IEND", 4)) {
+            break;
+        }
+        pos += 12 + len;
+    }
+
+    int channels = colorType == 0 ? 1 : colorType == 2 ? 3 : colorType == 3 ? 1 : colorType == 4 ? 2 : colorType == 6 ? 4 : 0;
+    if (bitDepth != 8 || interlace != 0 || channels == 0) {
+        std::cerr << "Unsupported PNG format (only 8-bit non-interlaced): " << path << std::endl;
+        return false;
+    }
+
+    std::vector<unsigned char> raw;
+    if (!inflate(idat.data(), idat.size(), raw)) {
+        std::cerr << "Corrupt PNG data: " << path << std::endl;
+        return false;
+    }
+
+    size_t stride = (size_t)width * channels;
+    if (raw.size() < (stride + 1) * height) {
+        std::cerr << "Truncated PNG data: " << path << std::endl;
+        return false;
+    }
+
+    std::vector<unsigned char> pixels(stride * height);
+    for (int y = 0; y < height; y++) {
+        int filter = raw[y * (stride + 1)];
+        const unsigned char* src = &raw[y * (stride + 1) + 1];
+        unsigned char* dst = &pixels[y * stride];
+        const unsigned char* prev = y > 0 ? &pixels[(y - 1) * stride] : nullptr;
+        for (size_t x = 0; x < stride; x++) {
+            int a = x >= (size_t)channels ? dst[x - channels] : 0;
+            int b = prev ? prev[x] : 0;
+            int c = (prev && x >= (size_t)channels) ? prev[x - channels] : 0;
+            int p = 0;
+            switch (filter) {
+                case 1: p = a; break;
+                case 2: p = b; break;
+                case 3: p = (a + b) / 2; break;
+                case 4: p = paeth(a, b, c); break;
+                default: break;
+            }
+            dst[x] = (unsigned char)(src[x] + p);
+        }
+    }
+
+    rgba.resize((size_t)width * height * 4);
+    for (size_t i = 0; i < (size_t)width * height; i++) {
+        const unsigned char* s = &pixels[i * channels];
+        unsigned char* d = &rgba[i * 4];
+        switch (colorType) {
+            case 0: d[0] = d[1] = d[2] = s[0]; d[3] = 255; break;
+            case 2: d[0] = s[0]; d[1] = s[1]; d[2] = s[2]; d[3] = 255; break;
+            case 3:
+                if ((size_t)s[0] * 3 + 2 < palette.size()) {
+                    d[0] = palette[s[0] * 3]; d[1] = palette[s[0] * 3 + 1]; d[2] = palette[s[0] * 3 + 2];
+                } else {
+                    d[0] = d[1] = d[2] = 0;
+                }
+                d[3] = 255;
+                break;
+            case 4: d[0] = d[1] = d[2] = s[0]; d[3] = s[1]; break;
+            case 6: memcpy(d, s, 4); break;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Minimal self-contained PNG support for the CPU renderer, so it builds on
+// machines without SOIL or a system libpng.
+
+// Writes 8-bit RGB rows, top row first. The zlib stream uses stored
+// (uncompressed) deflate blocks.
+bool writePNG(const std::string& path, int width, int height, const std::vector<unsigned char>& rgb);
+
+// Reads a non-interlaced 8-bit gray/gray+alpha/RGB/RGBA/palette PNG and
+// expands it to RGBA, top row first.
+bool loadPNG(const std::string& path, int& width, int& height, std::vector<unsigned char>& rgba);
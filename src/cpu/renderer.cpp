@@ -0,0 +1,411 @@
+#include "renderer.h"
+
+#include "png.h"
+#include "scene_sdf.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+// Mirrors the constants at the top of shaders/fragment.glsl
+static const float MAX_STEPS = 500.0f;
+static const float MIN_DIST_TO_SDF = 0.000001f;
+static const float MAX_DIST_TO_TRAVEL = 100.0f;
+static const float EPSILON = 0.001f;
+static const float LOD_MULTIPLIER = 60.0f;
+
+// Pixels covered by one ray packet: 2x2 quads for SSE, 4x2 for AVX
+#define PACKET_W (SIMD_WIDTH / 2)
+#define PACKET_H 2
+
+bool Texture::load(const std::string& path) {
+    return loadPNG(path, width, height, rgba);
+}
+
+glm::vec3 Texture::sample(glm::vec2 uv) const {
+    if (rgba.empty()) return glm::vec3(1.0f);
+
+    float fx = uv.x * width - 0.5f;
+    float fy = uv.y * height - 0.5f;
+    float x0f = std::floor(fx), y0f = std::floor(fy);
+    float tx = fx - x0f, ty = fy - y0f;
+    auto wrap = [](int i, int n) { i %= n; return i < 0 ? i + n : i; };
+    int x0 = wrap((int)x0f, width), x1 = wrap((int)x0f + 1, width);
+    int y0 = wrap((int)y0f, height), y1 = wrap((int)y0f + 1, height);
+    auto texel = [&](int x, int y) {
+        const unsigned char* p = &rgba[((size_t)y * width + x) * 4];
+        return glm::vec3(p[0], p[1], p[2]) / 255.0f;
+    };
+    return glm::mix(glm::mix(texel(x0, y0), texel(x1, y0), tx),
+                    glm::mix(texel(x0, y1), texel(x1, y1), tx), ty);
+}
+
+struct Light {
+    float size;
+    glm::vec3 pos;
+    glm::vec3 col;
+    glm::vec3 dir;
+    float focus;
+    float spread;
+};
+
+// Per-frame constants derived from RenderSettings, shared by all tiles
+struct Frame {
+    const RenderSettings* settings;
+    SceneSDF scene; // primitives animated to settings->time
+    glm::vec3 forward, right, up;
+    float zoom;
+    Light lights[3];
+    int lightCount;
+};
+
+static void toLanes(const vfloat3& v, glm::vec3 out[SIMD_WIDTH]) {
+    float x[SIMD_WIDTH], y[SIMD_WIDTH], z[SIMD_WIDTH];
+    v.x.store(x);
+    v.y.store(y);
+    v.z.store(z);
+    for (int i = 0; i < SIMD_WIDTH; i++) out[i] = glm::vec3(x[i], y[i], z[i]);
+}
+
+static vfloat3 normalize(const vfloat3& v) {
+    return v / length(v);
+}
+
+static SceneHit calcSDF(const Frame& f, const vfloat3& pos) {
+    return calcSceneSDF(f.scene, pos);
+}
+
+static vfloat calcAO(const Frame& f, const vfloat3& pos, const vfloat3& normal) {
+    vfloat occ(0.0f);
+    float sca = 1.0f;
+
+    for (int i = 0; i < 5; i++) {
+        float hrconst = 0.03f; // larger values = AO
+        float hr = hrconst + 0.15f * float(i) / 4.0f;
+        vfloat3 aopos = normal * vfloat(hr) + pos;
+        vfloat dd = calcSDF(f, aopos).dist;
+        occ = occ + (vfloat(hr) - dd) * vfloat(sca);
+        sca *= 0.95f;
+    }
+    return clamp(vfloat(1.0f) - occ * vfloat(1.5f), vfloat(0.0f), vfloat(1.0f));
+}
+
+// Lanes outside `active` are not traced and report 1 (unshadowed).
+static vfloat calcSoftshadowV3(const Frame& f, const vfloat3& ro, const vfloat3& rd, float mint, float maxt, float w, vfloat active) {
+    vfloat res(1.0f);
+    vfloat ph(1e20f);
+    vfloat t(mint);
+    for (int i = 0; i < 256; i++) {
+        active = active & (t < vfloat(maxt));
+        if (!any(active)) break;
+
+        vfloat h = calcSDF(f, ro + rd * t).dist;
+        vfloat blocked = active & (h < vfloat(0.001f));
+        res = select(blocked, vfloat(0.0f), res);
+        active = andnot(blocked, active);
+
+        vfloat y = h * h / (vfloat(2.0f) * ph);
+        vfloat d = sqrt(h * h - y * y);
+        // min(candidate, res) keeps res when the candidate is NaN
+        vfloat candidate = d / (vfloat(w) * vmax(vfloat(0.0f), t - y));
+        res = select(active, vmin(candidate, res), res);
+        ph = select(active, h, ph);
+        t = select(active, t + h, t);
+    }
+    return res;
+}
+
+static vfloat rMarch(const Frame& f, const vfloat3& rOrig, const vfloat3& rDir) {
+    vfloat dOrig(0.0f); // distance from ray origin
+    vfloat active = allLanes();
+
+    const vfloat maxLod(MAX_DIST_TO_TRAVEL * MAX_DIST_TO_TRAVEL * LOD_MULTIPLIER);
+    for (int i = 0; i < MAX_STEPS; i++) {
+        vfloat3 rPos = rOrig + rDir * dOrig;
+        vfloat dSurf = calcSDF(f, rPos).dist;
+        dOrig = select(active, dOrig + dSurf, dOrig);
+        vfloat threshold = vfloat(MIN_DIST_TO_SDF) * clamp((dOrig * dOrig - vfloat(3.0f)) * vfloat(LOD_MULTIPLIER), vfloat(1.0f), maxLod);
+        vfloat done = (dOrig > vfloat(MAX_DIST_TO_TRAVEL)) | (abs(dSurf) < threshold);
+        active = andnot(done, active);
+        if (!any(active)) break;
+    }
+
+    return dOrig;
+}
+
+static glm::vec3 triPlanar(const Texture* tex, glm::vec3 p, glm::vec3 normal, float size) {
+    if (!tex) return glm::vec3(1.0f);
+    p *= (1.0f / size);
+    normal = glm::abs(normal);
+    normal = glm::pow(normal, glm::vec3(5.0f));
+    normal /= normal.x + normal.y + normal.z;
+    return tex->sample(glm::vec2(p.x, p.y) * 0.5f + 0.5f) * normal.z +
+           tex->sample(glm::vec2(p.x, p.z) * 0.5f + 0.5f) * normal.y +
+           tex->sample(glm::vec2(p.y, p.z) * 0.5f + 0.5f) * normal.x;
+}
+
+static glm::vec3 getMaterial(const Frame& f, glm::vec3 p, float id, glm::vec3 normal, float size) {
+    switch ((int)id) {
+        case 1: return glm::vec3(1.0f, 0.0f, 0.0f);
+        case 2: return triPlanar(f.settings->texture, p, normal, size);
+        case 3: return glm::vec3(0.0f, 0.0f, 1.0f);
+        case 4: return glm::vec3(1.0f, 1.0f, 0.0f);
+        case 5: return glm::vec3(1.0f, 0.0f, 1.0f);
+        case 6: return glm::vec3(0.0f, 1.0f, 1.0f);
+        case 7: return glm::vec3(1.0f, 1.0f, 1.0f);
+        default: return glm::vec3(1.0f);
+    }
+}
+
+static vfloat smoothstep(float edge0, float edge1, vfloat x) {
+    vfloat t = clamp((x - vfloat(edge0)) / vfloat(edge1 - edge0), vfloat(0.0f), vfloat(1.0f));
+    return t * t * (vfloat(3.0f) - vfloat(2.0f) * t);
+}
+
+// Adds calcLight() of one light to col for every lane in `hit`. The spotlight
+// cone and the soft shadow march run on the whole packet, the Phong terms per lane.
+static void calcLight(const Frame& f, const Light& lightSource, const vfloat3& pos,
+                      const glm::vec3 nLanes[], const glm::vec3 refLanes[], const float aoLanes[],
+                      const glm::vec3 material[], vfloat hit, float kSpecular, glm::vec3 col[]) {
+    float kDiffuse = 0.4f,
+        kAmbient = 0.005f;
+
+    glm::vec3 iSpecular = 6.0f * lightSource.col, // intensity
+        iDiffuse = 2.0f * lightSource.col,
+        iAmbient = 1.5f * lightSource.col;
+
+    float alpha_phong = 20.0f; // phong alpha component
+
+    vfloat3 lRay = normalize(broadcast(lightSource.pos) - pos);
+
+    // calcDirLight(): the light "looks at" lightSource.dir
+    glm::vec3 coneAxis = glm::normalize(lightSource.pos - lightSource.dir);
+    vfloat light = smoothstep(cosf(lightSource.spread), cosf(lightSource.focus), dot(lRay, broadcast(coneAxis)));
+
+    // no need to calculate shadow if we're in the dark
+    vfloat lit = hit & (light > vfloat(0.001f));
+    vfloat shadow = calcSoftshadowV3(f, pos, lRay, 0.01f, 3.0f, lightSource.size, lit);
+
+    glm::vec3 lRays[SIMD_WIDTH];
+    toLanes(lRay, lRays);
+    float lights[SIMD_WIDTH], shadows[SIMD_WIDTH];
+    light.store(lights);
+    shadow.store(shadows);
+    int hitMask = movemask(hit);
+    for (int i = 0; i < SIMD_WIDTH; i++) {
+        if (!(hitMask & (1 << i))) continue;
+        glm::vec3 dif = lights[i] * kDiffuse * iDiffuse * std::max(glm::dot(lRays[i], nLanes[i]), 0.0f) * shadows[i];
+        glm::vec3 spec = lights[i] * kSpecular * iSpecular * std::pow(std::max(glm::dot(lRays[i], refLanes[i]), 0.0f), alpha_phong) * shadows[i];
+        glm::vec3 amb = lights[i] * kAmbient * iAmbient * aoLanes[i];
+        col[i] += material[i] * (amb + dif + spec);
+    }
+}
+
+static void render(const Frame& f, const vfloat3& rDir, glm::vec3 col[SIMD_WIDTH]) {
+    for (int i = 0; i < SIMD_WIDTH; i++) col[i] = glm::vec3(0.005f);
+
+    vfloat3 rOrig = broadcast(f.settings->camPos);
+    vfloat dist = rMarch(f, rOrig, rDir);
+    vfloat hit = dist < vfloat(MAX_DIST_TO_TRAVEL);
+
+    if (any(hit)) {
+        vfloat3 pos = rOrig + rDir * dist; // surface point location
+
+        // getNormal()
+        SceneHit center = calcSDF(f, pos);
+        vfloat3 normal(center.dist - calcSDF(f, pos - vfloat3(vfloat(EPSILON), vfloat(0.0f), vfloat(0.0f))).dist,
+                       center.dist - calcSDF(f, pos - vfloat3(vfloat(0.0f), vfloat(EPSILON), vfloat(0.0f))).dist,
+                       center.dist - calcSDF(f, pos - vfloat3(vfloat(0.0f), vfloat(0.0f), vfloat(EPSILON))).dist);
+        normal = normalize(normal);
+        vfloat3 rDirRef = rDir - normal * (vfloat(2.0f) * dot(normal, rDir)); // reflected ray
+
+        vfloat ambientOcc = calcAO(f, pos, normal);
+
+        glm::vec3 posLanes[SIMD_WIDTH], nLanes[SIMD_WIDTH], refLanes[SIMD_WIDTH], material[SIMD_WIDTH];
+        float ids[SIMD_WIDTH], aoLanes[SIMD_WIDTH];
+        toLanes(pos, posLanes);
+        toLanes(normal, nLanes);
+        toLanes(rDirRef, refLanes);
+        center.id.store(ids);
+        ambientOcc.store(aoLanes);
+        for (int i = 0; i < SIMD_WIDTH; i++) {
+            material[i] = getMaterial(f, posLanes[i], ids[i], nLanes[i], 0.5f);
+        }
+
+        // misses keep the background colour
+        glm::vec3 lit[SIMD_WIDTH];
+        for (int i = 0; i < SIMD_WIDTH; i++) lit[i] = col[i];
+        for (int l = 0; l < f.lightCount; l++) {
+            calcLight(f, f.lights[l], pos, nLanes, refLanes, aoLanes, material, hit, 0.5f, lit);
+        }
+        int hitMask = movemask(hit);
+        for (int i = 0; i < SIMD_WIDTH; i++) {
+            if (hitMask & (1 << i)) col[i] = lit[i];
+        }
+    }
+    for (int i = 0; i < SIMD_WIDTH; i++) col[i] = glm::clamp(col[i], 0.0f, 1.0f);
+}
+
+// rCam() for every lane: fragCoord is gl_FragCoord.xy, offset the supersample offset
+static vfloat3 rCam(const Frame& f, const glm::vec2 fragCoord[], const glm::vec2 offset[]) {
+    float x[SIMD_WIDTH], y[SIMD_WIDTH], z[SIMD_WIDTH];
+    glm::vec2 res((float)f.settings->width, (float)f.settings->height);
+    for (int i = 0; i < SIMD_WIDTH; i++) {
+        glm::vec2 uv = ((fragCoord[i] + offset[i]) - 0.5f * res) / res.y;
+        glm::vec3 intersection = f.forward * f.zoom + uv.x * f.right + uv.y * f.up;
+        glm::vec3 dir = glm::normalize(intersection);
+        x[i] = dir.x;
+        y[i] = dir.y;
+        z[i] = dir.z;
+    }
+    return vfloat3(vfloat::load(x), vfloat::load(y), vfloat::load(z));
+}
+
+static void accumulate(const Frame& f, const glm::vec2 fragCoord[], const glm::vec2 offset[], glm::vec3 col[]) {
+    glm::vec3 sample[SIMD_WIDTH];
+    render(f, rCam(f, fragCoord, offset), sample);
+    for (int i = 0; i < SIMD_WIDTH; i++) col[i] += sample[i];
+}
+
+// superSample(): same offsets and checkerboard pattern as the shader
+static void superSample(const Frame& f, const glm::vec2 fragCoord[], glm::vec3 col[]) {
+    int AA = f.settings->renderMode;
+    glm::vec2 offset[SIMD_WIDTH];
+    float bxy[SIMD_WIDTH], nbxy[SIMD_WIDTH];
+    for (int i = 0; i < SIMD_WIDTH; i++) {
+        col[i] = glm::vec3(0.0f);
+        bxy[i] = (float)((int)(fragCoord[i].x + fragCoord[i].y) & 1);
+        nbxy[i] = 1.0f - bxy[i];
+    }
+    auto offsets = [&](auto fn) {
+        for (int i = 0; i < SIMD_WIDTH; i++) offset[i] = fn(i);
+        accumulate(f, fragCoord, offset, col);
+    };
+
+    switch (AA) {
+        case 0: {
+            glm::vec2 res((float)f.settings->width, (float)f.settings->height);
+            for (int i = 0; i < SIMD_WIDTH; i++) {
+                glm::vec2 uv = (fragCoord[i] - 0.5f * res) / res.y;
+                col[i] = glm::vec3(uv, 0.0f);
+            }
+            break;
+        }
+        case 1:
+            offsets([&](int) { return glm::vec2(0.0f); });
+            break;
+        case 2:
+            offsets([&](int i) { return glm::vec2(0.33f * nbxy[i], 0.0f); });
+            offsets([&](int i) { return glm::vec2(0.33f * bxy[i], 0.66f); });
+            for (int i = 0; i < SIMD_WIDTH; i++) col[i] /= 2.0f;
+            break;
+        case 3:
+            offsets([&](int i) { return glm::vec2(0.66f * nbxy[i], 0.0f); });
+            offsets([&](int i) { return glm::vec2(0.66f * bxy[i], 0.66f); });
+            offsets([&](int) { return glm::vec2(0.33f, 0.33f); });
+            for (int i = 0; i < SIMD_WIDTH; i++) col[i] /= 3.0f;
+            break;
+        case 4: {
+            glm::vec4 e(0.125f, -0.125f, 0.375f, -0.375f);
+            offsets([&](int) { return glm::vec2(e.x, e.z); });
+            offsets([&](int) { return glm::vec2(e.y, e.w); });
+            offsets([&](int) { return glm::vec2(e.w, e.x); });
+            offsets([&](int) { return glm::vec2(e.z, e.y); });
+            for (int i = 0; i < SIMD_WIDTH; i++) col[i] /= 4.0f;
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static unsigned char toUnorm8(float c) {
+    if (!(c > 0.0f)) return 0; // also catches NaN from pow() of negative uv in mode 0
+    if (c >= 1.0f) return 255;
+    return (unsigned char)std::lround(c * 255.0f);
+}
+
+static void renderTile(const Frame& f, int x0, int y0, int x1, int y1, unsigned char* rgb) {
+    int width = f.settings->width, height = f.settings->height;
+    for (int py = y0; py < y1; py += PACKET_H) {
+        for (int px = x0; px < x1; px += PACKET_W) {
+            glm::vec2 fragCoord[SIMD_WIDTH];
+            int rows[SIMD_WIDTH], cols[SIMD_WIDTH];
+            for (int i = 0; i < SIMD_WIDTH; i++) {
+                // lanes past the tile edge duplicate the last pixel and are not written
+                cols[i] = std::min(px + i % PACKET_W, x1 - 1);
+                rows[i] = std::min(py + i / PACKET_W, y1 - 1);
+                // gl_FragCoord has its origin at the bottom left and samples pixel centres
+                fragCoord[i] = glm::vec2(cols[i] + 0.5f, (height - 1 - rows[i]) + 0.5f);
+            }
+
+            glm::vec3 col[SIMD_WIDTH];
+            superSample(f, fragCoord, col);
+
+            for (int i = 0; i < SIMD_WIDTH; i++) {
+                if (px + i % PACKET_W >= x1 || py + i / PACKET_W >= y1) continue;
+                glm::vec3 c = glm::pow(col[i], glm::vec3(1.0f / 2.2f)); // gamma correction
+                unsigned char* out = rgb + ((size_t)rows[i] * width + cols[i]) * 3;
+                out[0] = toUnorm8(c.r);
+                out[1] = toUnorm8(c.g);
+                out[2] = toUnorm8(c.b);
+            }
+        }
+    }
+}
+
+void renderImage(const RenderSettings& settings, ThreadPool& pool, int tileSize, std::vector<unsigned char>& rgb) {
+    Frame f;
+    f.settings = &settings;
+    // Same as the GL app: the grid is built for the scene file positions and the animation stays within its slack
+    buildSceneGrid(settings.primitives, f.scene.grid, sceneMotionExtent(settings.animations));
+    f.scene.primitives = settings.primitives;
+    animateScene(settings.animations, settings.time, f.scene.primitives);
+
+    // rCam(): lookat = u_camPos + u_camTarget
+    f.zoom = std::max(0.5f, (settings.scroll * 0.05f) + 0.5f);
+    f.forward = glm::normalize(settings.camTarget);
+    f.right = glm::normalize(glm::cross(f.forward, glm::vec3(0.0f, 1.0f, 0.0f)));
+    f.up = glm::cross(f.right, f.forward);
+
+    // light 1
+    Light& light1 = f.lights[0];
+    light1.size = 0.01f;
+    light1.pos = glm::vec3(5.0f * cosf(-settings.time), 4.0f, 5.0f * sinf(-settings.time));
+    light1.col = glm::vec3(0.6157f, 0.0f, 0.0f);
+    light1.dir = glm::vec3(0.5f, 0.0f, 0.0f);
+    light1.focus = glm::radians(15.0f);
+    light1.spread = glm::radians(30.0f);
+
+    Light& light2 = f.lights[1];
+    light2.size = 0.01f;
+    light2.col = glm::vec3(1.0f);
+    light2.dir = glm::vec3(-15.0f, 20.0f, -25.0f);
+    light2.pos = glm::vec3(100.0f, 50.0f, 20.0f);
+    light2.focus = glm::radians(10.0f);
+    light2.spread = glm::radians(20.0f);
+
+    // flashlight
+    Light& fLight = f.lights[2];
+    fLight.size = 0.0001f;
+    fLight.pos = settings.camPos;
+    fLight.col = glm::vec3(0.6431f, 0.6118f, 0.498f);
+    fLight.dir = settings.camPos + settings.camTarget;
+    fLight.focus = glm::radians(15.0f);
+    fLight.spread = glm::radians(30.0f);
+
+    f.lightCount = settings.flashlight ? 3 : 2;
+
+    rgb.assign((size_t)settings.width * settings.height * 3, 0);
+
+    // keep tiles a multiple of the packet footprint so packets never straddle tiles
+    tileSize = std::max(PACKET_W * PACKET_H, tileSize - tileSize % (PACKET_W * PACKET_H));
+    int tilesX = (settings.width + tileSize - 1) / tileSize;
+    int tilesY = (settings.height + tileSize - 1) / tileSize;
+    pool.parallelFor(tilesX * tilesY, [&](int tile) {
+        int x0 = (tile % tilesX) * tileSize;
+        int y0 = (tile / tilesX) * tileSize;
+        renderTile(f, x0, y0, std::min(x0 + tileSize, settings.width), std::min(y0 + tileSize, settings.height), rgb.data());
+    });
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "scene.h"
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+// RGBA8 image sampled with GL_REPEAT / GL_LINEAR semantics (mip level 0 only).
+struct Texture {
+    int width = 0;
+    int height = 0;
+    std::vector<unsigned char> rgba;
+
+    bool load(const std::string& path);
+    glm::vec3 sample(glm::vec2 uv) const;
+};
+
+// Everything the fragment shader reads from uniforms and the scene SSBOs.
+struct RenderSettings {
+    int width = 1080;
+    int height = 720;
+    float time = 0.0f;        // u_time
+    float scroll = 0.0f;      // u_scroll
+    glm::vec3 camPos = glm::vec3(0.0f, 2.0f, -4.0f); // u_camPos
+    glm::vec3 camTarget = glm::vec3(0.0f, 0.0f, 1.0f); // u_camTarget (normalized view direction)
+    bool flashlight = false;  // u_flashlight
+    int renderMode = 1;       // u_renderMode, i.e. the superSample level
+    std::vector<ScenePrimitive> primitives; // primitives SSBO at their scene file positions, the grid is rebuilt by renderImage()
+    std::vector<SceneAnimation> animations; // applied at `time`
+    const Texture* texture = nullptr; // programTexture1
+};
+
+// Renders the fragment.glsl scene into tightly packed RGB8 rows, top row first.
+// The image is cut into tileSize x tileSize tiles that are spread over the pool.
+void renderImage(const RenderSettings& settings, ThreadPool& pool, int tileSize, std::vector<unsigned char>& rgb);
@@ -0,0 +1,130 @@
+#include "scene_sdf.h"
+
+#include "sdf.h"
+
+#include <algorithm>
+#include <utility>
+
+// MAX_DIST_TO_TRAVEL in shaders/fragment.glsl
+static const float MAX_DIST_TO_TRAVEL = 100.0f;
+
+static SceneHit minID(const SceneHit& res1, const SceneHit& res2) {
+    vfloat pick = res1.dist < res2.dist;
+    return { select(pick, res1.dist, res2.dist), select(pick, res1.id, res2.id) };
+}
+
+static vfloat3 cross(const vfloat3& a, const vfloat3& b) {
+    return vfloat3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+
+// Mask with the lanes set in `bits`
+static vfloat laneMask(int bits) {
+    float tmp[SIMD_WIDTH];
+    for (int i = 0; i < SIMD_WIDTH; i++) tmp[i] = ((bits >> i) & 1) ? 1.0f : 0.0f;
+    return vfloat::load(tmp) > vfloat(0.5f);
+}
+
+vfloat evalPrimitive(const ScenePrimitive& prim, const vfloat3& pos) {
+    float scale = prim.positionScale.w;
+    vfloat3 p = pos - broadcast(glm::vec3(prim.positionScale));
+    if (prim.rotation != glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)) {
+        vfloat3 q = broadcast(-glm::vec3(prim.rotation));
+        vfloat3 t = cross(q, p) * vfloat(2.0f);
+        p = p + t * vfloat(prim.rotation.w) + cross(q, t);
+    }
+    p = p / vfloat(scale);
+
+    const glm::vec4& a = prim.params;
+    vfloat d;
+    switch (prim.info.x) {
+        case PRIM_PLANE: d = fPlane(p, a.x, a.y, a.z, a.w); break;
+        case PRIM_BOX: d = fBox(p, a.x, a.y, a.z); break;
+        case PRIM_SPHERE: d = fSphere(p, a.x); break;
+        case PRIM_BLOB: d = fBlob(p); break;
+        case PRIM_TORUS: d = fTorus(p, a.x, a.y); break;
+        case PRIM_CYLINDER: d = fCylinder(p, a.x, a.y); break;
+        case PRIM_MENGER: d = fMenger(p, prim.info.z, a.x); break;
+        case PRIM_MANDELBULB: d = mandelbulb(p); break;
+        default: d = vfloat(MAX_DIST_TO_TRAVEL); break;
+    }
+    return d * vfloat(scale);
+}
+
+// Lanes can sit in different grid cells, so the packet walks the union of
+// their cell lists and each primitive only counts for the lanes whose cell lists it.
+SceneHit calcSceneSDF(const SceneSDF& scene, const vfloat3& pos) {
+    const std::vector<ScenePrimitive>& prims = scene.primitives;
+    const SceneGrid& grid = scene.grid;
+
+    SceneHit dist = { vfloat(MAX_DIST_TO_TRAVEL * 2.0f), vfloat(0.0f) };
+    for (uint32_t i = 0; i < grid.globalCount; i++) {
+        const ScenePrimitive& prim = prims[grid.indices[i]];
+        dist = minID({ evalPrimitive(prim, pos), vfloat((float)prim.info.y) }, dist);
+    }
+    if (grid.dims.x == 0) {
+        return dist;
+    }
+
+    vfloat3 cellSize = broadcast(grid.cellSize);
+    vfloat3 local = (pos - broadcast(grid.min));
+    local = vfloat3(local.x / cellSize.x, local.y / cellSize.y, local.z / cellSize.z);
+    vfloat3 cell(floor(local.x), floor(local.y), floor(local.z));
+    vfloat inside = (cell.x >= vfloat(0.0f)) & (cell.y >= vfloat(0.0f)) & (cell.z >= vfloat(0.0f)) &
+                    (cell.x < vfloat((float)grid.dims.x)) & (cell.y < vfloat((float)grid.dims.y)) & (cell.z < vfloat((float)grid.dims.z));
+
+    vfloat3 fr = local - cell;
+    fr = vfloat3(fr.x * cellSize.x, fr.y * cellSize.y, fr.z * cellSize.z);
+    vfloat insideBound = vmin(vmin3(fr), vmin3(cellSize - fr));
+    vfloat3 halfSize = broadcast(0.5f * grid.cellSize * glm::vec3(grid.dims));
+    vfloat3 outside = abs(pos - broadcast(grid.min) - halfSize) - halfSize;
+    vfloat bound = select(inside, insideBound, length(vmax(outside, vfloat(0.0f)))) + vfloat(grid.margin - grid.motionSlack);
+
+    int insideBits = movemask(inside);
+    if (insideBits) {
+        float cx[SIMD_WIDTH], cy[SIMD_WIDTH], cz[SIMD_WIDTH];
+        cell.x.store(cx);
+        cell.y.store(cy);
+        cell.z.store(cz);
+
+        // (primitive, lanes) pairs; cell lists are sorted, so merging keeps the shader's evaluation order
+        thread_local std::vector<std::pair<uint32_t, int>> entries;
+        entries.clear();
+        int cellOfLane[SIMD_WIDTH];
+        for (int l = 0; l < SIMD_WIDTH; l++) {
+            cellOfLane[l] = ((insideBits >> l) & 1) ? (int)cx[l] + grid.dims.x * ((int)cy[l] + grid.dims.y * (int)cz[l]) : -1;
+        }
+        for (int l = 0; l < SIMD_WIDTH; l++) {
+            if (cellOfLane[l] < 0) continue;
+            bool seen = false;
+            for (int k = 0; k < l; k++) seen |= cellOfLane[k] == cellOfLane[l];
+            if (seen) continue;
+
+            int bits = 0;
+            for (int k = l; k < SIMD_WIDTH; k++) {
+                if (cellOfLane[k] == cellOfLane[l]) bits |= 1 << k;
+            }
+            glm::uvec2 range = grid.cells[cellOfLane[l]];
+            for (uint32_t i = range.x; i < range.x + range.y; i++) {
+                entries.emplace_back(grid.indices[i], bits);
+            }
+        }
+        std::sort(entries.begin(), entries.end());
+
+        for (size_t e = 0; e < entries.size();) {
+            uint32_t index = entries[e].first;
+            int bits = 0;
+            for (; e < entries.size() && entries[e].first == index; e++) bits |= entries[e].second;
+
+            const ScenePrimitive& prim = prims[index];
+            vfloat d = evalPrimitive(prim, pos);
+            vfloat pick = laneMask(bits) & (d < dist.dist);
+            dist.dist = select(pick, d, dist.dist);
+            dist.id = select(pick, vfloat((float)prim.info.y), dist.id);
+        }
+    }
+
+    vfloat useBound = bound < dist.dist;
+    dist.dist = select(useBound, bound, dist.dist);
+    dist.id = select(useBound, vfloat(0.0f), dist.id);
+    return dist;
+}
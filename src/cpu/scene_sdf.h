@@ -0,0 +1,31 @@
+#pragma once
+
+// The scene's distance field on the CPU, shared by the renderer and the mesher.
+
+#include "scene.h"
+#include "simd.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// What calcSceneSDF() reads: the primitives SSBO and the grid binned over it
+struct SceneSDF {
+    std::vector<ScenePrimitive> primitives;
+    SceneGrid grid;
+};
+
+struct SceneHit {
+    vfloat dist;
+    vfloat id; // minID() material, 0 where the grid bound was closer than any primitive
+};
+
+inline vfloat3 broadcast(glm::vec3 v) {
+    return vfloat3(vfloat(v.x), vfloat(v.y), vfloat(v.z));
+}
+
+// evalPrimitive() in shaders/primitives.glsl
+vfloat evalPrimitive(const ScenePrimitive& prim, const vfloat3& pos);
+
+// calcSceneSDF() in shaders/scene.glsl for SIMD_WIDTH points at once
+SceneHit calcSceneSDF(const SceneSDF& scene, const vfloat3& pos);
@@ -0,0 +1,132 @@
+#pragma once
+
+// Packet ports of the hg_sdf.glsl primitives evaluated by evalPrimitive in
+// shaders/primitives.glsl. Every function evaluates SIMD_WIDTH sample points at
+// once and mirrors its GLSL counterpart line by line, so the CPU renderer and
+// the shader agree on the scene.
+
+#include "simd.h"
+
+#define SDF_PI 3.14159265f
+#define SDF_PHI (sqrtf(5.0f) * 0.5f + 0.5f)
+
+inline vfloat vmax3(const vfloat3& v) { return vmax(vmax(v.x, v.y), v.z); }
+inline vfloat vmin3(const vfloat3& v) { return vmin(vmin(v.x, v.y), v.z); }
+
+inline vfloat fSphere(const vfloat3& p, float r) {
+    return length(p) - vfloat(r);
+}
+
+// Plane with normal n (n is normalized) at some distance from the origin
+inline vfloat fPlane(const vfloat3& p, float nx, float ny, float nz, float distanceFromOrigin) {
+    return p.x * vfloat(nx) + p.y * vfloat(ny) + p.z * vfloat(nz) + vfloat(distanceFromOrigin);
+}
+
+// Box: correct distance to corners
+inline vfloat fBox(const vfloat3& p, float bx, float by, float bz) {
+    vfloat3 a = abs(p);
+    vfloat3 d(a.x - vfloat(bx), a.y - vfloat(by), a.z - vfloat(bz));
+    return length(vmax(d, vfloat(0.0f))) + vmax3(vmin(d, vfloat(0.0f)));
+}
+
+// Cylinder standing upright on the xz plane
+inline vfloat fCylinder(const vfloat3& p, float r, float height) {
+    vfloat d = sqrt(p.x * p.x + p.z * p.z) - vfloat(r);
+    return vmax(d, abs(p.y) - vfloat(height));
+}
+
+// Torus in the XZ-plane
+inline vfloat fTorus(const vfloat3& p, float smallRadius, float largeRadius) {
+    vfloat q = sqrt(p.x * p.x + p.z * p.z) - vfloat(largeRadius);
+    return sqrt(q * q + p.y * p.y) - vfloat(smallRadius);
+}
+
+// Blobby ball object. This is not a correct distance bound, beware.
+inline vfloat fBlob(vfloat3 p) {
+    p = abs(p);
+    vfloat rot = p.x < vmax(p.y, p.z);
+    p = select(rot, vfloat3(p.y, p.z, p.x), p);
+    rot = p.x < vmax(p.y, p.z);
+    p = select(rot, vfloat3(p.y, p.z, p.x), p);
+
+    const float n3 = 1.0f / sqrtf(3.0f);
+    const float la = sqrtf((SDF_PHI + 1) * (SDF_PHI + 1) + 1);
+    const float lb = sqrtf(1 + SDF_PHI * SDF_PHI);
+    vfloat b = vmax(vmax(vmax(
+        (p.x + p.y + p.z) * vfloat(n3),
+        p.x * vfloat((SDF_PHI + 1) / la) + p.z * vfloat(1 / la)),
+        p.y * vfloat(1 / lb) + p.x * vfloat(SDF_PHI / lb)),
+        p.x * vfloat(1 / lb) + p.z * vfloat(SDF_PHI / lb));
+    vfloat l = length(p);
+    vfloat arg = vmin(sqrt(vfloat(1.01f) - b / l) * vfloat(SDF_PI / 0.25f), vfloat(SDF_PI));
+    return l - vfloat(1.5f) - vfloat(0.2f * (1.5f / 2)) * lanewise(arg, [](float x) { return cosf(x); });
+}
+
+inline vfloat fMenger(const vfloat3& point, int degree, float size) {
+    vfloat3 p = point / vfloat(size);
+    vfloat d = fBox(p, 1.0f, 1.0f, 1.0f);
+
+    vfloat s(1.0f);
+    for (int m = 0; m < degree; m++) {
+        vfloat3 a(mod(p.x * s, vfloat(2.0f)) - vfloat(1.0f),
+                  mod(p.y * s, vfloat(2.0f)) - vfloat(1.0f),
+                  mod(p.z * s, vfloat(2.0f)) - vfloat(1.0f));
+        s = s * vfloat(3.0f);
+        vfloat3 r = abs(vfloat3(vfloat(1.0f) - vfloat(3.0f) * abs(a.x),
+                                vfloat(1.0f) - vfloat(3.0f) * abs(a.y),
+                                vfloat(1.0f) - vfloat(3.0f) * abs(a.z)));
+
+        vfloat da = vmax(r.x, r.y);
+        vfloat db = vmax(r.y, r.z);
+        vfloat dc = vmax(r.z, r.x);
+        vfloat c = (vmin(da, vmin(db, dc)) - vfloat(1.0f)) / s;
+
+        d = vmax(d, c);
+    }
+    return d * vfloat(size);
+}
+
+// Trigonometric mandelbulb; the orbit trap output of the GLSL version is not
+// needed by calcSDF and is dropped. Lanes that escape stop iterating, exactly
+// like the per-pixel `break` in the shader.
+inline vfloat mandelbulb(const vfloat3& p) {
+    vfloat3 w = p;
+    vfloat m = dot(w, w);
+    vfloat dz(1.0f);
+    vfloat active = allLanes();
+
+    for (int i = 0; i < 4; i++) {
+        // dz = 8*z^7*dz
+        vfloat m3 = m * m * m * sqrt(m);
+        vfloat ndz = vfloat(8.0f) * m3 * dz + vfloat(1.0f);
+
+        // z = z^8+c
+        vfloat r = sqrt(m);
+        float ry[SIMD_WIDTH], wx[SIMD_WIDTH], wz[SIMD_WIDTH];
+        (w.y / r).store(ry);
+        w.x.store(wx);
+        w.z.store(wz);
+        float sb[SIMD_WIDTH], cb[SIMD_WIDTH], sa[SIMD_WIDTH], ca[SIMD_WIDTH];
+        for (int l = 0; l < SIMD_WIDTH; l++) {
+            float b = 8.0f * acosf(ry[l]);
+            float a = 8.0f * atan2f(wx[l], wz[l]);
+            sb[l] = sinf(b); cb[l] = cosf(b);
+            sa[l] = sinf(a); ca[l] = cosf(a);
+        }
+        vfloat r8 = m * m * m * m;
+        vfloat vsb = vfloat::load(sb);
+        vfloat3 nw(p.x + r8 * vsb * vfloat::load(sa),
+                   p.y + r8 * vfloat::load(cb),
+                   p.z + r8 * vsb * vfloat::load(ca));
+
+        dz = select(active, ndz, dz);
+        w = select(active, nw, w);
+        m = select(active, dot(w, w), m);
+        active = active & (m <= vfloat(256.0f));
+        if (!any(active))
+            break;
+    }
+
+    // distance estimation (through the Hubbard-Douady potential)
+    return vfloat(0.25f) * lanewise(m, [](float x) { return logf(x); }) * sqrt(m) / dz;
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+// Thin SIMD wrapper used by the CPU renderer to march several rays at once.
+// vfloat holds SIMD_WIDTH lanes: 8 with AVX, 4 with SSE2 and 4 plain floats
+// otherwise. Comparisons return a vfloat whose lanes are all-ones/all-zeros
+// bit masks, which can be fed to select() and any()/all().
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define SIMD_WIDTH 8
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SIMD_WIDTH 4
+#else
+#define SIMD_WIDTH 4
+#define SIMD_SCALAR
+#endif
+
+struct vfloat {
+#if defined(__AVX__)
+    __m256 v;
+    vfloat() = default;
+    vfloat(__m256 x) : v(x) {}
+    vfloat(float x) : v(_mm256_set1_ps(x)) {}
+#elif !defined(SIMD_SCALAR)
+    __m128 v;
+    vfloat() = default;
+    vfloat(__m128 x) : v(x) {}
+    vfloat(float x) : v(_mm_set1_ps(x)) {}
+#else
+    float v[SIMD_WIDTH];
+    vfloat() = default;
+    vfloat(float x) { for (int i = 0; i < SIMD_WIDTH; i++) v[i] = x; }
+#endif
+
+    static vfloat load(const float* p) {
+#if defined(__AVX__)
+        return _mm256_loadu_ps(p);
+#elif !defined(SIMD_SCALAR)
+        return _mm_loadu_ps(p);
+#else
+        vfloat r; memcpy(r.v, p, sizeof(r.v)); return r;
+#endif
+    }
+
+    void store(float* p) const {
+#if defined(__AVX__)
+        _mm256_storeu_ps(p, v);
+#elif !defined(SIMD_SCALAR)
+        _mm_storeu_ps(p, v);
+#else
+        memcpy(p, v, sizeof(v));
+#endif
+    }
+
+    float operator[](int i) const {
+        float tmp[SIMD_WIDTH];
+        store(tmp);
+        return tmp[i];
+    }
+};
+
+#if defined(__AVX__)
+inline vfloat operator+(vfloat a, vfloat b) { return _mm256_add_ps(a.v, b.v); }
+inline vfloat operator-(vfloat a, vfloat b) { return _mm256_sub_ps(a.v, b.v); }
+inline vfloat operator*(vfloat a, vfloat b) { return _mm256_mul_ps(a.v, b.v); }
+inline vfloat operator/(vfloat a, vfloat b) { return _mm256_div_ps(a.v, b.v); }
+inline vfloat operator&(vfloat a, vfloat b) { return _mm256_and_ps(a.v, b.v); }
+inline vfloat operator|(vfloat a, vfloat b) { return _mm256_or_ps(a.v, b.v); }
+inline vfloat andnot(vfloat a, vfloat b) { return _mm256_andnot_ps(a.v, b.v); } // ~a & b
+inline vfloat vmin(vfloat a, vfloat b) { return _mm256_min_ps(a.v, b.v); }
+inline vfloat vmax(vfloat a, vfloat b) { return _mm256_max_ps(a.v, b.v); }
+inline vfloat sqrt(vfloat a) { return _mm256_sqrt_ps(a.v); }
+inline vfloat floor(vfloat a) { return _mm256_floor_ps(a.v); }
+inline vfloat operator<(vfloat a, vfloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+inline vfloat operator>(vfloat a, vfloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+inline vfloat operator<=(vfloat a, vfloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ); }
+inline vfloat operator>=(vfloat a, vfloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ); }
+inline vfloat select(vfloat mask, vfloat a, vfloat b) { return _mm256_blendv_ps(b.v, a.v, mask.v); }
+inline int movemask(vfloat mask) { return _mm256_movemask_ps(mask.v); }
+#elif !defined(SIMD_SCALAR)
+inline vfloat operator+(vfloat a, vfloat b) { return _mm_add_ps(a.v, b.v); }
+inline vfloat operator-(vfloat a, vfloat b) { return _mm_sub_ps(a.v, b.v); }
+inline vfloat operator*(vfloat a, vfloat b) { return _mm_mul_ps(a.v, b.v); }
+inline vfloat operator/(vfloat a, vfloat b) { return _mm_div_ps(a.v, b.v); }
+inline vfloat operator&(vfloat a, vfloat b) { return _mm_and_ps(a.v, b.v); }
+inline vfloat operator|(vfloat a, vfloat b) { return _mm_or_ps(a.v, b.v); }
+inline vfloat andnot(vfloat a, vfloat b) { return _mm_andnot_ps(a.v, b.v); } // ~a & b
+inline vfloat vmin(vfloat a, vfloat b) { return _mm_min_ps(a.v, b.v); }
+inline vfloat vmax(vfloat a, vfloat b) { return _mm_max_ps(a.v, b.v); }
+inline vfloat sqrt(vfloat a) { return _mm_sqrt_ps(a.v); }
+inline vfloat operator<(vfloat a, vfloat b) { return _mm_cmplt_ps(a.v, b.v); }
+inline vfloat operator>(vfloat a, vfloat b) { return _mm_cmpgt_ps(a.v, b.v); }
+inline vfloat operator<=(vfloat a, vfloat b) { return _mm_cmple_ps(a.v, b.v); }
+inline vfloat operator>=(vfloat a, vfloat b) { return _mm_cmpge_ps(a.v, b.v); }
+inline vfloat select(vfloat mask, vfloat a, vfloat b) { return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)); }
+inline int movemask(vfloat mask) { return _mm_movemask_ps(mask.v); }
+inline vfloat floor(vfloat a) {
+    // SSE2 has no floor: truncate, then step down where truncation rounded up
+    __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a.v));
+    return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a.v), _mm_set1_ps(1.0f)));
+}
+#else
+#define SIMD_SCALAR_OP(name, expr) \
+    inline vfloat name(vfloat a, vfloat b) { vfloat r; for (int i = 0; i < SIMD_WIDTH; i++) { float x = a.v[i], y = b.v[i]; r.v[i] = (expr); } return r; }
+#define SIMD_SCALAR_MASK(name, expr) \
+    inline vfloat name(vfloat a, vfloat b) { vfloat r; for (int i = 0; i < SIMD_WIDTH; i++) { uint32_t m = (a.v[i] expr b.v[i]) ? 0xffffffffu : 0u; memcpy(&r.v[i], &m, 4); } return r; }
+#define SIMD_SCALAR_BITS(name, expr) \
+    inline vfloat name(vfloat a, vfloat b) { vfloat r; for (int i = 0; i < SIMD_WIDTH; i++) { uint32_t x, y, m; memcpy(&x, &a.v[i], 4); memcpy(&y, &b.v[i], 4); m = (expr); memcpy(&r.v[i], &m, 4); } return r; }
+SIMD_SCALAR_OP(operator+, x + y)
+SIMD_SCALAR_OP(operator-, x - y)
+SIMD_SCALAR_OP(operator*, x * y)
+SIMD_SCALAR_OP(operator/, x / y)
+SIMD_SCALAR_OP(vmin, x < y ? x : y) // same NaN behaviour as minps/maxps
+SIMD_SCALAR_OP(vmax, x > y ? x : y)
+SIMD_SCALAR_MASK(operator<, <)
+SIMD_SCALAR_MASK(operator>, >)
+SIMD_SCALAR_MASK(operator<=, <=)
+SIMD_SCALAR_MASK(operator>=, >=)
+SIMD_SCALAR_BITS(operator&, x & y)
+SIMD_SCALAR_BITS(operator|, x | y)
+SIMD_SCALAR_BITS(andnot, ~x & y)
+#undef SIMD_SCALAR_OP
+#undef SIMD_SCALAR_MASK
+#undef SIMD_SCALAR_BITS
+inline vfloat sqrt(vfloat a) { vfloat r; for (int i = 0; i < SIMD_WIDTH; i++) r.v[i] = std::sqrt(a.v[i]); return r; }
+inline vfloat floor(vfloat a) { vfloat r; for (int i = 0; i < SIMD_WIDTH; i++) r.v[i] = std::floor(a.v[i]); return r; }
+inline vfloat select(vfloat mask, vfloat a, vfloat b) { return (mask & a) | andnot(mask, b); }
+inline int movemask(vfloat mask) {
+    int m = 0;
+    for (int i = 0; i < SIMD_WIDTH; i++) { uint32_t x; memcpy(&x, &mask.v[i], 4); m |= (x >> 31) << i; }
+    return m;
+}
+#endif
+
+inline vfloat operator-(vfloat a) { return vfloat(0.0f) - a; }
+inline vfloat allLanes() { vfloat z(0.0f); return z <= z; }
+inline vfloat abs(vfloat a) { return andnot(vfloat(-0.0f), a); }
+inline bool any(vfloat mask) { return movemask(mask) != 0; }
+inline bool all(vfloat mask) { return movemask(mask) == (1 << SIMD_WIDTH) - 1; }
+inline vfloat clamp(vfloat x, vfloat lo, vfloat hi) { return vmin(vmax(x, lo), hi); }
+// GLSL mod(): x - y * floor(x / y)
+inline vfloat mod(vfloat x, vfloat y) { return x - y * floor(x / y); }
+
+// Transcendentals have no SSE/AVX instruction, so they run lane by lane.
+template <typename F>
+inline vfloat lanewise(vfloat a, F f) {
+    float tmp[SIMD_WIDTH];
+    a.store(tmp);
+    for (int i = 0; i < SIMD_WIDTH; i++) tmp[i] = f(tmp[i]);
+    return vfloat::load(tmp);
+}
+
+struct vfloat3 {
+    vfloat x, y, z;
+    vfloat3() = default;
+    vfloat3(vfloat x, vfloat y, vfloat z) : x(x), y(y), z(z) {}
+    explicit vfloat3(float s) : x(s), y(s), z(s) {}
+};
+
+inline vfloat3 operator+(const vfloat3& a, const vfloat3& b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+inline vfloat3 operator-(const vfloat3& a, const vfloat3& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+inline vfloat3 operator*(const vfloat3& a, vfloat s) { return { a.x * s, a.y * s, a.z * s }; }
+inline vfloat3 operator/(const vfloat3& a, vfloat s) { return { a.x / s, a.y / s, a.z / s }; }
+inline vfloat3 abs(const vfloat3& a) { return { abs(a.x), abs(a.y), abs(a.z) }; }
+inline vfloat3 vmax(const vfloat3& a, vfloat b) { return { vmax(a.x, b), vmax(a.y, b), vmax(a.z, b) }; }
+inline vfloat3 vmin(const vfloat3& a, vfloat b) { return { vmin(a.x, b), vmin(a.y, b), vmin(a.z, b) }; }
+inline vfloat3 select(vfloat mask, const vfloat3& a, const vfloat3& b) {
+    return { select(mask, a.x, b.x), select(mask, a.y, b.y), select(mask, a.z, b.z) };
+}
+inline vfloat dot(const vfloat3& a, const vfloat3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline vfloat length(const vfloat3& a) { return sqrt(dot(a, a)); }
@@ -0,0 +1,98 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(unsigned threadCount) {
+    if (threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+        if (threadCount == 0) threadCount = 1;
+    }
+
+    for (unsigned i = 0; i < threadCount; i++) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    idleWorkers = threadCount;
+    for (unsigned i = 0; i < threadCount; i++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(batchMutex);
+        stopping = true;
+    }
+    batchStart.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::parallelFor(int count, const std::function<void(int)>& body) {
+    if (count <= 0) return;
+
+    // Contiguous blocks keep neighbouring tiles on the same core until stealing kicks in
+    unsigned n = size();
+    for (unsigned w = 0; w < n; w++) {
+        int begin = (int)((long long)count * w / n);
+        int end = (int)((long long)count * (w + 1) / n);
+        std::lock_guard<std::mutex> lock(queues[w]->mutex);
+        for (int i = begin; i < end; i++) {
+            queues[w]->tasks.push_back(i);
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(batchMutex);
+    remaining = count;
+    batchBody = &body;
+    batchId++;
+    idleWorkers = 0;
+    batchStart.notify_all();
+    batchDone.wait(lock, [&] { return idleWorkers == n; });
+    batchBody = nullptr;
+}
+
+bool ThreadPool::popLocal(unsigned index, int& task) {
+    std::lock_guard<std::mutex> lock(queues[index]->mutex);
+    if (queues[index]->tasks.empty()) return false;
+    task = queues[index]->tasks.back();
+    queues[index]->tasks.pop_back();
+    return true;
+}
+
+bool ThreadPool::steal(unsigned thief, int& task) {
+    unsigned n = size();
+    for (unsigned offset = 1; offset < n; offset++) {
+        Queue& victim = *queues[(thief + offset) % n];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(unsigned index) {
+    unsigned seenBatch = 0;
+    for (;;) {
+        const std::function<void(int)>* body;
+        {
+            std::unique_lock<std::mutex> lock(batchMutex);
+            batchStart.wait(lock, [&] { return stopping || batchId != seenBatch; });
+            if (stopping) return;
+            seenBatch = batchId;
+            body = batchBody;
+        }
+
+        int task;
+        while (remaining.load() > 0 && (popLocal(index, task) || steal(index, task))) {
+            (*body)(task);
+            remaining--;
+        }
+
+        std::lock_guard<std::mutex> lock(batchMutex);
+        if (++idleWorkers == size()) {
+            batchDone.notify_one();
+        }
+    }
+}
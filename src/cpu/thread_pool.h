@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing pool for tile rendering. parallelFor() deals the task indices
+// out to every worker's deque in contiguous blocks; a worker pops from the back
+// of its own deque and, once it runs dry, steals from the front of another
+// worker's, so expensive tiles (fractals, shadowed areas) don't leave the
+// other cores idle at the end of a frame.
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned size() const { return (unsigned)workers.size(); }
+
+    // Runs body(0) .. body(count - 1) across the pool and blocks until all are done.
+    void parallelFor(int count, const std::function<void(int)>& body);
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<int> tasks;
+    };
+
+    void workerLoop(unsigned index);
+    bool popLocal(unsigned index, int& task);
+    bool steal(unsigned thief, int& task);
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<Queue>> queues;
+
+    std::mutex batchMutex;
+    std::condition_variable batchStart;
+    std::condition_variable batchDone;
+    const std::function<void(int)>* batchBody = nullptr;
+    unsigned batchId = 0;
+    std::atomic<int> remaining{ 0 };
+    unsigned idleWorkers = 0;
+    bool stopping = false;
+};
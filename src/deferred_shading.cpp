@@ -0,0 +1,137 @@
+#include "deferred_shading.h"
+
+#include "scene.h"
+#include "temporal_aa.h"
+
+#include <algorithm>
+#include <iostream>
+
+// uints per tile, one bit per light (LIGHT_MASK_WORDS in shaders/lights.glsl)
+#define DEFERRED_MASK_WORDS (MAX_SCENE_LIGHTS / 32)
+
+bool DeferredShading::create(GLuint cull, GLuint lighting, OcclusionPasses* occlusionPasses) {
+    destroy();
+    cullProgram = cull;
+    lightingProgram = lighting;
+    occlusion = occlusionPasses;
+    cullSizeLoc = glGetUniformLocation(cullProgram, "u_size");
+    cullLightCountLoc = glGetUniformLocation(cullProgram, "u_lightCount");
+    camPosLoc = glGetUniformLocation(lightingProgram, "u_camPos");
+    camTargetLoc = glGetUniformLocation(lightingProgram, "u_camTarget");
+    flashlightLoc = glGetUniformLocation(lightingProgram, "u_flashlight");
+    lightCountLoc = glGetUniformLocation(lightingProgram, "u_lightCount");
+    tilesXLoc = glGetUniformLocation(lightingProgram, "u_tilesX");
+    sizeLoc = glGetUniformLocation(lightingProgram, "u_size");
+    aoScaleLoc = glGetUniformLocation(lightingProgram, "u_aoScale");
+    shadowScaleLoc = glGetUniformLocation(lightingProgram, "u_shadowScale");
+    shadowLightsLoc = glGetUniformLocation(lightingProgram, "u_shadowLights");
+
+    glGenFramebuffers(1, &fbo);
+    glGenBuffers(1, &tileMasks);
+    return true;
+}
+
+void DeferredShading::destroy() {
+    if (!fbo) return;
+
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteTextures(3, gbuffer);
+    glDeleteBuffers(1, &tileMasks);
+    fbo = tileMasks = 0;
+    std::fill(gbuffer, gbuffer + 3, 0);
+    tileMaskSize = 0;
+    textureWidth = textureHeight = 0;
+}
+
+bool DeferredShading::supports(int renderMode) {
+    return renderMode == 1 || renderMode == TAA_RENDER_MODE;
+}
+
+int DeferredShading::sceneMode() const {
+    return occlusion && occlusion->aoScale() > 1 ? 2 : 1;
+}
+
+bool DeferredShading::resize(int newWidth, int newHeight) {
+    static const GLenum formats[3] = { GL_RGBA16F, GL_R32F, GL_RGBA32F };
+    glDeleteTextures(3, gbuffer);
+    glGenTextures(3, gbuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    for (int i = 0; i < 3; i++) {
+        glBindTexture(GL_TEXTURE_2D, gbuffer[i]);
+        glTexStorage2D(GL_TEXTURE_2D, 1, formats[i], newWidth, newHeight);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, gbuffer[i], 0);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // Same locations as the outputs of fragment.glsl
+    static const GLenum drawBuffers[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+    glDrawBuffers(3, drawBuffers);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Deferred shading framebuffer is incomplete\n";
+        return false;
+    }
+    textureWidth = newWidth;
+    textureHeight = newHeight;
+    return true;
+}
+
+void DeferredShading::begin(int frameWidth, int frameHeight) {
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &targetFBO);
+    glGetIntegerv(GL_VIEWPORT, targetViewport);
+
+    width = std::max(frameWidth, 1);
+    height = std::max(frameHeight, 1);
+    if (width > textureWidth || height > textureHeight) {
+        resize(std::max(width, textureWidth), std::max(height, textureHeight));
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, width, height);
+}
+
+void DeferredShading::shade(const glm::vec3& camPos, const glm::vec3& camTarget, bool flashlight, int lightCount,
+                            bool unchanged) {
+    // The G-buffer can't stay attached to the draw framebuffer while it is read
+    glBindFramebuffer(GL_FRAMEBUFFER, targetFBO);
+    glViewport(targetViewport[0], targetViewport[1], targetViewport[2], targetViewport[3]);
+    for (int i = 0; i < 3; i++) {
+        glActiveTexture(GL_TEXTURE0 + DEFERRED_TEXTURE_UNIT + i);
+        glBindTexture(GL_TEXTURE_2D, gbuffer[i]);
+    }
+    glActiveTexture(GL_TEXTURE0);
+
+    int tilesX = (width + DEFERRED_TILE - 1) / DEFERRED_TILE;
+    int tilesY = (height + DEFERRED_TILE - 1) / DEFERRED_TILE;
+    size_t maskSize = (size_t)tilesX * tilesY * DEFERRED_MASK_WORDS * sizeof(uint32_t);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, tileMasks);
+    if (maskSize > tileMaskSize) {
+        glBufferData(GL_SHADER_STORAGE_BUFFER, maskSize, nullptr, GL_DYNAMIC_COPY);
+        tileMaskSize = maskSize;
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DEFERRED_MASK_BINDING, tileMasks);
+
+    glUseProgram(cullProgram);
+    glUniform2i(cullSizeLoc, width, height);
+    glUniform1i(cullLightCountLoc, lightCount);
+    glDispatchCompute(tilesX, tilesY, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    if (occlusion) {
+        occlusion->render(width, height, camPos, camTarget, flashlight, lightCount, unchanged);
+    }
+
+    glUseProgram(lightingProgram);
+    glUniform3fv(camPosLoc, 1, &camPos[0]);
+    glUniform3fv(camTargetLoc, 1, &camTarget[0]);
+    glUniform1i(flashlightLoc, flashlight);
+    glUniform1i(lightCountLoc, lightCount);
+    glUniform1i(tilesXLoc, tilesX);
+    glUniform2i(sizeLoc, width, height);
+    glUniform1i(aoScaleLoc, occlusion ? occlusion->aoScale() : 1);
+    glUniform1i(shadowScaleLoc, occlusion ? occlusion->shadowScale() : 1);
+    glUniform1i(shadowLightsLoc, occlusion ? occlusion->shadowLights(lightCount) : 0);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+}
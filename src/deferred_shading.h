@@ -0,0 +1,74 @@
+#pragma once
+
+#include "occlusion_passes.h"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// Pixels per light culling tile along each axis, must match LIGHT_TILE in shaders/lights.glsl
+#define DEFERRED_TILE 16
+// First of the three texture units the G-buffer is read from, matches the
+// bindings in light_cull.glsl and deferred_lighting.glsl
+#define DEFERRED_TEXTURE_UNIT 6
+// SSBO binding of the per-tile light masks
+#define DEFERRED_MASK_BINDING 8
+
+// Deferred shading for the one ray per pixel modes. The scene pass runs with
+// u_deferred set and writes the surface it hits into a G-buffer (normal and
+// material, hit distance, position and AO) instead of lighting it. Then
+//   - shaders/light_cull.glsl, a compute shader with one work group per
+//     DEFERRED_TILE x DEFERRED_TILE tile, keeps the lights from the
+//     `sceneLights` SSBO whose range and spot cone reach the tile's surfaces
+//   - shaders/deferred_lighting.glsl shades every pixel with its tile's lights
+//     into the framebuffer that was bound before begin(), writing the same
+//     outputs as the forward pass.
+// So the expensive part, shadow rays, is only paid for lights that can reach
+// a pixel, and the march no longer runs in the same shader as the lighting.
+// With OcclusionPasses, AO and shadows come from reduced resolution buffers.
+//
+// The textures only grow, like the DynamicResolution target.
+class DeferredShading {
+public:
+    DeferredShading() = default;
+    DeferredShading(const DeferredShading&) = delete;
+    DeferredShading& operator=(const DeferredShading&) = delete;
+    ~DeferredShading() { destroy(); }
+
+    // The linked light_cull.glsl and deferred_lighting.glsl programs, and
+    // optionally the reduced resolution passes (none of them owned)
+    bool create(GLuint cullProgram, GLuint lightingProgram, OcclusionPasses* occlusion = nullptr);
+    void destroy();
+
+    // Render modes the scene pass can write a G-buffer for
+    static bool supports(int renderMode);
+    // u_deferred for the scene pass: 2 when the AO pass replaces its AO
+    int sceneMode() const;
+
+    // Remembers the bound framebuffer and viewport, then binds the G-buffer
+    // for a width x height scene pass
+    void begin(int width, int height);
+    // Culls and shades into the framebuffer begin() found, using the currently
+    // bound vertex array (the fullscreen quad, 6 vertices). Leaves the
+    // lighting program bound. `unchanged` is passed on to OcclusionPasses::render().
+    void shade(const glm::vec3& camPos, const glm::vec3& camTarget, bool flashlight, int lightCount,
+               bool unchanged = false);
+
+private:
+    bool resize(int width, int height);
+
+    GLuint cullProgram = 0, lightingProgram = 0;
+    GLint cullSizeLoc = -1, cullLightCountLoc = -1;
+    GLint camPosLoc = -1, camTargetLoc = -1, flashlightLoc = -1, lightCountLoc = -1, tilesXLoc = -1;
+    GLint sizeLoc = -1, aoScaleLoc = -1, shadowScaleLoc = -1, shadowLightsLoc = -1;
+    OcclusionPasses* occlusion = nullptr;
+
+    GLuint fbo = 0;
+    GLuint gbuffer[3] = {}; // normal and material ID, hit distance, position and AO
+    GLuint tileMasks = 0;
+    size_t tileMaskSize = 0;
+    int textureWidth = 0, textureHeight = 0;
+
+    int width = 0, height = 0; // this frame
+    GLint targetFBO = 0;
+    GLint targetViewport[4] = {};
+};
@@ -0,0 +1,77 @@
+#include "depth_prepass.h"
+
+#include <algorithm>
+#include <iostream>
+
+bool DepthPrepass::create(GLuint prepassProgram) {
+    destroy();
+    program = prepassProgram;
+    resolutionLoc = glGetUniformLocation(program, "u_resolution");
+    scrollLoc = glGetUniformLocation(program, "u_scroll");
+    camPosLoc = glGetUniformLocation(program, "u_camPos");
+    camTargetLoc = glGetUniformLocation(program, "u_camTarget");
+    tileLoc = glGetUniformLocation(program, "u_tile");
+
+    glGenFramebuffers(1, &fbo);
+    return true;
+}
+
+void DepthPrepass::destroy() {
+    if (!fbo) return;
+
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteTextures(1, &distanceTexture);
+    fbo = distanceTexture = 0;
+    textureWidth = textureHeight = 0;
+}
+
+bool DepthPrepass::resize(int tilesX, int tilesY) {
+    glDeleteTextures(1, &distanceTexture);
+    glGenTextures(1, &distanceTexture);
+    glBindTexture(GL_TEXTURE_2D, distanceTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32F, tilesX, tilesY);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, distanceTexture, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Depth prepass framebuffer is incomplete\n";
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        return false;
+    }
+    textureWidth = tilesX;
+    textureHeight = tilesY;
+    return true;
+}
+
+void DepthPrepass::render(int width, int height, const glm::vec3& camPos, const glm::vec3& camTarget, float scroll) {
+    // Whatever target the scene pass goes to is already bound
+    GLint previousFBO, previousViewport[4];
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFBO);
+    glGetIntegerv(GL_VIEWPORT, previousViewport);
+
+    // Partial tiles at the top and right edges still get a texel
+    int tilesX = (std::max(width, 1) + PREPASS_TILE - 1) / PREPASS_TILE;
+    int tilesY = (std::max(height, 1) + PREPASS_TILE - 1) / PREPASS_TILE;
+    if (tilesX > textureWidth || tilesY > textureHeight) {
+        resize(std::max(tilesX, textureWidth), std::max(tilesY, textureHeight));
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, tilesX, tilesY);
+    glUseProgram(program);
+    glUniform2f(resolutionLoc, (float)width, (float)height);
+    glUniform1f(scrollLoc, scroll);
+    glUniform3fv(camPosLoc, 1, &camPos[0]);
+    glUniform3fv(camTargetLoc, 1, &camTarget[0]);
+    glUniform1i(tileLoc, PREPASS_TILE);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFBO);
+    glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+
+    glActiveTexture(GL_TEXTURE0 + PREPASS_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, distanceTexture);
+    glActiveTexture(GL_TEXTURE0);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// Scene pass pixels per prepass texel along each axis
+#define PREPASS_TILE 8
+// Texture unit of the result, matches u_prepassDistance in fragment.glsl
+#define PREPASS_TEXTURE_UNIT 5
+
+// Low resolution depth prepass: shaders/depth_prepass.glsl cone-marches one
+// texel per PREPASS_TILE x PREPASS_TILE tile of the scene pass and writes the
+// distance every primary ray of the tile can skip. The scene pass reads it
+// when u_prepassTile is set and starts its rays there.
+//
+// The texture only grows, like the DynamicResolution target, and a frame uses
+// its lower left corner.
+class DepthPrepass {
+public:
+    DepthPrepass() = default;
+    DepthPrepass(const DepthPrepass&) = delete;
+    DepthPrepass& operator=(const DepthPrepass&) = delete;
+    ~DepthPrepass() { destroy(); }
+
+    // prepassProgram is the linked shaders/depth_prepass.glsl program (not owned)
+    bool create(GLuint prepassProgram);
+    void destroy();
+
+    // Renders the prepass for a scene pass of width x height pixels using the
+    // currently bound vertex array (the fullscreen quad, 6 vertices) and binds
+    // the result to PREPASS_TEXTURE_UNIT. The framebuffer and viewport bound
+    // before are restored, the prepass program is left bound.
+    void render(int width, int height, const glm::vec3& camPos, const glm::vec3& camTarget, float scroll);
+
+private:
+    bool resize(int tilesX, int tilesY);
+
+    GLuint program = 0;
+    GLint resolutionLoc = -1, scrollLoc = -1, camPosLoc = -1, camTargetLoc = -1, tileLoc = -1;
+    GLuint fbo = 0;
+    GLuint distanceTexture = 0;
+    int textureWidth = 0, textureHeight = 0;
+};
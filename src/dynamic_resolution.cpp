@@ -0,0 +1,129 @@
+#include "dynamic_resolution.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+bool DynamicResolution::create(GLuint upscaleProgram, float frameBudgetMs) {
+    destroy();
+    program = upscaleProgram;
+    sourceSizeLoc = glGetUniformLocation(program, "u_sourceSize");
+    outputSizeLoc = glGetUniformLocation(program, "u_outputSize");
+    targetMs = frameBudgetMs * DYNRES_HEADROOM;
+    currentScale = 1.0f;
+    lastSceneMs = 0.0;
+
+    glGenFramebuffers(1, &fbo);
+    glGenQueries(DYNRES_QUERIES, queries);
+    std::fill(queryPending, queryPending + DYNRES_QUERIES, false);
+    nextQuery = 0;
+    timing = false;
+    return true;
+}
+
+void DynamicResolution::destroy() {
+    if (!fbo) return;
+
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteTextures(1, &colorTexture);
+    glDeleteQueries(DYNRES_QUERIES, queries);
+    fbo = colorTexture = 0;
+    textureWidth = textureHeight = 0;
+}
+
+bool DynamicResolution::resize(int windowWidth, int windowHeight) {
+    // Immutable storage, so a new texture for every window size
+    glDeleteTextures(1, &colorTexture);
+    glGenTextures(1, &colorTexture);
+    glBindTexture(GL_TEXTURE_2D, colorTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, windowWidth, windowHeight);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Dynamic resolution framebuffer is incomplete\n";
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        return false;
+    }
+    textureWidth = windowWidth;
+    textureHeight = windowHeight;
+    return true;
+}
+
+void DynamicResolution::readQueries() {
+    // Oldest first; stop at the first one the GPU hasn't finished
+    for (int i = 0; i < DYNRES_QUERIES; i++) {
+        int slot = (nextQuery + i) % DYNRES_QUERIES;
+        if (!queryPending[slot]) continue;
+
+        GLint available = GL_FALSE;
+        glGetQueryObjectiv(queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) break;
+
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &ns);
+        queryPending[slot] = false;
+        if (ns == 0) continue; // some drivers report nothing for frames they merged
+        lastSceneMs = ns / 1.0e6;
+
+        // Frame time is roughly proportional to the pixel count, i.e. to scale^2.
+        // The estimate starts from the scale that frame was rendered at.
+        float desired = queryScale[slot] * sqrtf(targetMs / (float)std::max(lastSceneMs, 0.01));
+        desired = std::min(std::max(desired, DYNRES_MIN_SCALE), 1.0f);
+        currentScale += (desired - currentScale) * DYNRES_RESPONSE;
+    }
+}
+
+void DynamicResolution::begin(int windowWidth, int windowHeight, int& width, int& height) {
+    readQueries();
+
+    windowWidth = std::max(windowWidth, 1);
+    windowHeight = std::max(windowHeight, 1);
+    if (windowWidth != textureWidth || windowHeight != textureHeight) {
+        resize(windowWidth, windowHeight);
+    }
+
+    // Multiples of 8 pixels, so the size doesn't change on every small scale adjustment
+    if (currentScale >= 1.0f) {
+        renderWidth = windowWidth;
+        renderHeight = windowHeight;
+    } else {
+        renderWidth = std::min(windowWidth, std::max(8, (int)(windowWidth * currentScale) / 8 * 8));
+        renderHeight = std::min(windowHeight, std::max(8, (int)(windowHeight * currentScale) / 8 * 8));
+    }
+    width = renderWidth;
+    height = renderHeight;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, renderWidth, renderHeight);
+
+    // A slot whose result hasn't arrived yet is skipped rather than waited for
+    timing = !queryPending[nextQuery];
+    if (timing) {
+        queryScale[nextQuery] = (float)renderWidth / windowWidth;
+        glBeginQuery(GL_TIME_ELAPSED, queries[nextQuery]);
+    }
+}
+
+void DynamicResolution::present(GLuint source) {
+    if (timing) {
+        glEndQuery(GL_TIME_ELAPSED);
+        queryPending[nextQuery] = true;
+        nextQuery = (nextQuery + 1) % DYNRES_QUERIES;
+        timing = false;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, textureWidth, textureHeight);
+    glUseProgram(program);
+    glUniform2f(sourceSizeLoc, (float)renderWidth, (float)renderHeight);
+    glUniform2f(outputSizeLoc, (float)textureWidth, (float)textureHeight);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, source ? source : colorTexture);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+}
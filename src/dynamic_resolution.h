@@ -0,0 +1,68 @@
+#pragma once
+
+#include <glad/glad.h>
+
+// Timer queries in flight; a result is read once the GPU has it, never waited for
+#define DYNRES_QUERIES 4
+// Lowest render scale per axis (a quarter of the pixels)
+#define DYNRES_MIN_SCALE 0.5f
+// Share of the frame budget the scene pass aims for, the rest is upscaling and slack
+#define DYNRES_HEADROOM 0.85f
+// Fraction of the way to the estimated scale moved each frame
+#define DYNRES_RESPONSE 0.25f
+
+// Dynamic resolution: the scene is rendered into an offscreen texture at a
+// fraction of the window size, then upscaled to the window by
+// shaders/upscale.glsl. The fraction comes from the GPU time of the scene
+// pass (GL_TIME_ELAPSED queries, read a few frames late) so it settles where
+// the scene fits the frame budget.
+//
+// The texture is allocated at the full window size and the scene only draws
+// into its lower left corner, so changing the scale never reallocates.
+class DynamicResolution {
+public:
+    DynamicResolution() = default;
+    DynamicResolution(const DynamicResolution&) = delete;
+    DynamicResolution& operator=(const DynamicResolution&) = delete;
+    ~DynamicResolution() { destroy(); }
+
+    // upscaleProgram is the linked shaders/upscale.glsl program (not owned)
+    bool create(GLuint upscaleProgram, float frameBudgetMs);
+    void destroy();
+
+    // Binds the offscreen target and viewport for a window of the given size
+    // and starts timing. The scene should be rendered at renderWidth x renderHeight.
+    void begin(int windowWidth, int windowHeight, int& renderWidth, int& renderHeight);
+    // Stops timing, then draws the upscaled image into the default framebuffer
+    // using the currently bound vertex array (the fullscreen quad, 6 vertices).
+    // `source` replaces the offscreen target when the frame went through another
+    // pass first; it must hold the image in its lower left corner as well.
+    // Leaves the upscale program bound.
+    void present(GLuint source = 0);
+
+    float scale() const { return currentScale; }
+    // Latest measured GPU time of the scene pass, 0 until the first result arrives
+    double sceneMs() const { return lastSceneMs; }
+
+private:
+    void readQueries();
+    bool resize(int windowWidth, int windowHeight);
+
+    GLuint program = 0;
+    GLint sourceSizeLoc = -1;
+    GLint outputSizeLoc = -1;
+    GLuint fbo = 0;
+    GLuint colorTexture = 0;
+    int textureWidth = 0, textureHeight = 0;
+    int renderWidth = 0, renderHeight = 0;
+
+    GLuint queries[DYNRES_QUERIES] = {};
+    bool queryPending[DYNRES_QUERIES] = {};
+    float queryScale[DYNRES_QUERIES] = {}; // scale the timed frame was rendered at
+    int nextQuery = 0;
+    bool timing = false; // a query was started by begin()
+
+    float targetMs = 16.0f;
+    float currentScale = 1.0f;
+    double lastSceneMs = 0.0;
+};
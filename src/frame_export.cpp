@@ -0,0 +1,376 @@
+#include "frame_export.h"
+
+#include "cpu/png.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Frames waiting for an encoder per thread before the GL thread holds off
+#define EXPORT_QUEUED_FRAMES_PER_ENCODER 2
+
+static std::string framePath(const std::string& pattern, int frame) {
+    char path[4096];
+    snprintf(path, sizeof(path), pattern.c_str(), frame);
+    return path;
+}
+
+static bool isEXRPath(const std::string& path) {
+    std::string extension = std::filesystem::path(path).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+    return extension == ".exr";
+}
+
+// Half float bits of a non-negative float, rounded to nearest
+static uint16_t toHalf(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, 4);
+    int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+    if (exponent >= 31) return 0x7c00;
+    if (exponent <= 0) {
+        if (exponent < -10) return 0;
+        mantissa |= 0x800000; // subnormal half, the implicit bit becomes explicit
+        int shift = 14 - exponent;
+        return (uint16_t)((mantissa + (1u << (shift - 1))) >> shift);
+    }
+    return (uint16_t)(((uint32_t)exponent << 10) + ((mantissa + 0x1000) >> 13));
+}
+
+static void putBytes(std::vector<unsigned char>& out, const void* data, size_t size) {
+    out.insert(out.end(), (const unsigned char*)data, (const unsigned char*)data + size);
+}
+
+static void putAttribute(std::vector<unsigned char>& out, const char* name, const char* type, const std::vector<unsigned char>& value) {
+    putBytes(out, name, strlen(name) + 1);
+    putBytes(out, type, strlen(type) + 1);
+    int32_t size = (int32_t)value.size();
+    putBytes(out, &size, 4);
+    putBytes(out, value.data(), value.size());
+}
+
+template <typename T>
+static std::vector<unsigned char> attributeValue(std::initializer_list<T> values) {
+    std::vector<unsigned char> out;
+    for (T v : values) putBytes(out, &v, sizeof(T));
+    return out;
+}
+
+// Uncompressed single part scanline OpenEXR with half float B, G and R
+// channels, from RGBA8 rows bottom row first. The scene shaders write
+// gamma 2.2 colour, which is undone so the file holds linear values.
+static bool writeEXR(const std::string& path, int width, int height, const std::vector<unsigned char>& rgba) {
+    static uint16_t linear[256];
+    static std::once_flag linearReady;
+    std::call_once(linearReady, [] {
+        for (int i = 0; i < 256; i++) linear[i] = toHalf(std::pow(i / 255.0f, 2.2f));
+    });
+
+    std::vector<unsigned char> out = { 0x76, 0x2f, 0x31, 0x01, 2, 0, 0, 0 }; // magic, version 2, scanline
+
+    std::vector<unsigned char> channels;
+    for (const char* name : { "B", "G", "R" }) { // alphabetical, as the format requires
+        putBytes(channels, name, 2);
+        int32_t channel[4] = { 1, 0, 1, 1 }; // HALF, not linear and 3 reserved bytes, x and y sampling
+        putBytes(channels, channel, sizeof(channel));
+    }
+    channels.push_back(0);
+    putAttribute(out, "channels", "chlist", channels);
+    putAttribute(out, "compression", "compression", { 0 });
+    putAttribute(out, "dataWindow", "box2i", attributeValue<int32_t>({ 0, 0, width - 1, height - 1 }));
+    putAttribute(out, "displayWindow", "box2i", attributeValue<int32_t>({ 0, 0, width - 1, height - 1 }));
+    putAttribute(out, "lineOrder", "lineOrder", { 0 }); // increasing y, top row first
+    putAttribute(out, "pixelAspectRatio", "float", attributeValue<float>({ 1.0f }));
+    putAttribute(out, "screenWindowCenter", "v2f", attributeValue<float>({ 0.0f, 0.0f }));
+    putAttribute(out, "screenWindowWidth", "float", attributeValue<float>({ 1.0f }));
+    out.push_back(0);
+
+    // Offset table, then one block per scanline: y, byte count, then each channel's row
+    int32_t lineBytes = width * 3 * 2;
+    uint64_t offset = out.size() + (uint64_t)height * 8;
+    for (int y = 0; y < height; y++) {
+        putBytes(out, &offset, 8);
+        offset += 8 + lineBytes;
+    }
+    std::vector<uint16_t> line((size_t)width * 3);
+    for (int y = 0; y < height; y++) {
+        const unsigned char* row = rgba.data() + (size_t)(height - 1 - y) * width * 4;
+        for (int x = 0; x < width; x++) {
+            line[x] = linear[row[x * 4 + 2]];
+            line[width + x] = linear[row[x * 4 + 1]];
+            line[2 * width + x] = linear[row[x * 4]];
+        }
+        int32_t header[2] = { y, lineBytes };
+        putBytes(out, header, 8);
+        putBytes(out, line.data(), lineBytes);
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open output image: " << path << std::endl;
+        return false;
+    }
+    file.write((const char*)out.data(), out.size());
+    return file.good();
+}
+
+namespace {
+
+// Encoder threads and the frames queued for them. Frame buffers are recycled,
+// and acquire() holds the GL thread off while the queue is full, which bounds
+// the memory when the disk can't keep up.
+class FrameEncoders {
+public:
+    FrameEncoders(const std::string& pattern, int width, int height, int threadCount)
+        : pattern(pattern), width(width), height(height),
+          maxQueued((size_t)threadCount * EXPORT_QUEUED_FRAMES_PER_ENCODER) {
+        for (int i = 0; i < threadCount; i++) {
+            threads.emplace_back(&FrameEncoders::worker, this);
+        }
+    }
+    FrameEncoders(const FrameEncoders&) = delete;
+    FrameEncoders& operator=(const FrameEncoders&) = delete;
+    ~FrameEncoders() { finish(); }
+
+    // A buffer for one RGBA8 frame, bottom row first
+    std::vector<unsigned char> acquire() {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return queue.size() < maxQueued; });
+        if (spare.empty()) return std::vector<unsigned char>((size_t)width * height * 4);
+        std::vector<unsigned char> buffer = std::move(spare.back());
+        spare.pop_back();
+        return buffer;
+    }
+
+    void submit(int frame, std::vector<unsigned char> rgba) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back({ frame, std::move(rgba) });
+        }
+        wake.notify_one();
+    }
+
+    // Waits for every submitted frame; false if any couldn't be written
+    bool finish() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& thread : threads) thread.join();
+        threads.clear();
+        return !failed;
+    }
+
+private:
+    struct Job {
+        int frame;
+        std::vector<unsigned char> rgba;
+    };
+
+    void worker() {
+        std::vector<unsigned char> rgb;
+        for (;;) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stopping || !queue.empty(); });
+                if (queue.empty()) return;
+                job = std::move(queue.front());
+                queue.pop_front();
+            }
+            done.notify_one();
+
+            std::string path = framePath(pattern, job.frame);
+            bool ok;
+            if (isEXRPath(path)) {
+                ok = writeEXR(path, width, height, job.rgba);
+            } else {
+                // writePNG wants RGB, top row first
+                rgb.resize((size_t)width * height * 3);
+                for (int y = 0; y < height; y++) {
+                    const unsigned char* src = job.rgba.data() + (size_t)(height - 1 - y) * width * 4;
+                    unsigned char* dst = rgb.data() + (size_t)y * width * 3;
+                    for (int x = 0; x < width; x++) {
+                        memcpy(dst + x * 3, src + x * 4, 3);
+                    }
+                }
+                ok = writePNG(path, width, height, rgb);
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!ok) {
+                if (!failed) std::cerr << "Failed to write frame " << job.frame << ": " << path << std::endl;
+                failed = true;
+            }
+            spare.push_back(std::move(job.rgba));
+        }
+    }
+
+    std::string pattern;
+    int width, height;
+    size_t maxQueued;
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake;  // workers wait for frames
+    std::condition_variable done;  // acquire() waits for room in the queue
+    std::deque<Job> queue;
+    std::vector<std::vector<unsigned char>> spare;
+    bool stopping = false;
+    bool failed = false;
+};
+
+}
+
+bool runExport(GLuint program, const BenchmarkOptions& frameOptions, const ExportOptions& options) {
+    std::vector<CameraKey> keys;
+    if (!loadCameraPath(options.cameraPath, keys)) {
+        return false;
+    }
+    float endTime = options.endTime < 0.0f ? keys.back().time : options.endTime;
+    if (options.fps <= 0.0f || endTime < options.startTime) {
+        std::cerr << "Export time range is empty: " << options.startTime << " to " << endTime << " s at " << options.fps << " fps\n";
+        return false;
+    }
+    int frameCount = (int)std::floor((endTime - options.startTime) * options.fps + 1e-3f) + 1;
+
+    int width = frameOptions.width, height = frameOptions.height;
+    GLint maxTextureSize = 0, maxViewport[2] = { 0, 0 };
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    glGetIntegerv(GL_MAX_VIEWPORT_DIMS, maxViewport);
+    if (width > std::min(maxTextureSize, maxViewport[0]) || height > std::min(maxTextureSize, maxViewport[1])) {
+        std::cerr << "Export size " << width << "x" << height << " exceeds the driver's limit of "
+                  << std::min(maxTextureSize, maxViewport[0]) << "x" << std::min(maxTextureSize, maxViewport[1]) << "\n";
+        return false;
+    }
+
+    std::filesystem::path directory = std::filesystem::path(framePath(options.outputPattern, 0)).parent_path();
+    std::error_code error;
+    if (!directory.empty()) std::filesystem::create_directories(directory, error);
+
+    GLuint fbo, colorTexture;
+    glGenTextures(1, &colorTexture);
+    glBindTexture(GL_TEXTURE_2D, colorTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Export framebuffer is incomplete\n";
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteTextures(1, &colorTexture);
+        return false;
+    }
+    glViewport(0, 0, width, height);
+
+    size_t frameBytes = (size_t)width * height * 4;
+    GLuint packBuffers[EXPORT_READBACK_BUFFERS];
+    GLsync fences[EXPORT_READBACK_BUFFERS] = {};
+    int bufferFrame[EXPORT_READBACK_BUFFERS];
+    std::fill(bufferFrame, bufferFrame + EXPORT_READBACK_BUFFERS, -1);
+    glGenBuffers(EXPORT_READBACK_BUFFERS, packBuffers);
+    for (GLuint buffer : packBuffers) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, frameBytes, nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    // Tiles are scissored out of the fullscreen quad; the tiled compute path is always dispatched whole
+    BenchmarkOptions drawOptions = frameOptions;
+    if (options.tileSize > 0 && !drawOptions.drawScene) {
+        int tileSize = options.tileSize;
+        drawOptions.drawScene = [tileSize](const BenchmarkFrame&) {
+            GLint viewport[4];
+            glGetIntegerv(GL_VIEWPORT, viewport);
+            glEnable(GL_SCISSOR_TEST);
+            for (int y = 0; y < viewport[3]; y += tileSize) {
+                for (int x = 0; x < viewport[2]; x += tileSize) {
+                    glScissor(viewport[0] + x, viewport[1] + y, tileSize, tileSize);
+                    glDrawArrays(GL_TRIANGLES, 0, 6);
+                    glFlush();
+                }
+            }
+            glDisable(GL_SCISSOR_TEST);
+        };
+    }
+
+    int threadCount = options.encoderThreads > 0
+        ? options.encoderThreads
+        : std::clamp((int)std::thread::hardware_concurrency() - 1, 1, EXPORT_MAX_ENCODERS);
+    FrameEncoders encoders(options.outputPattern, width, height, threadCount);
+
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+    double gpuWaitSeconds = 0.0, encoderWaitSeconds = 0.0;
+
+    // Hands the frame in a pack buffer to the encoders, waiting for its copy if it isn't done yet
+    auto retire = [&](int slot) {
+        if (bufferFrame[slot] < 0) return;
+        Clock::time_point waitStart = Clock::now();
+        while (glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {}
+        glDeleteSync(fences[slot]);
+        fences[slot] = nullptr;
+        Clock::time_point copyStart = Clock::now();
+        gpuWaitSeconds += std::chrono::duration<double>(copyStart - waitStart).count();
+
+        std::vector<unsigned char> pixels = encoders.acquire();
+        encoderWaitSeconds += std::chrono::duration<double>(Clock::now() - copyStart).count();
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, packBuffers[slot]);
+        const void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frameBytes, GL_MAP_READ_BIT);
+        if (data) {
+            memcpy(pixels.data(), data, frameBytes);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        } else {
+            std::cerr << "Failed to map the readback buffer of frame " << bufferFrame[slot] << "\n";
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        encoders.submit(bufferFrame[slot], std::move(pixels));
+        bufferFrame[slot] = -1;
+    };
+
+    for (int frame = 0; frame < frameCount; frame++) {
+        int slot = frame % EXPORT_READBACK_BUFFERS;
+        retire(slot);
+
+        drawBenchmarkFrame(program, drawOptions, cameraPathAt(keys, options.startTime + frame / options.fps));
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, packBuffers[slot]);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        bufferFrame[slot] = frame;
+        glFlush();
+    }
+    for (int i = 0; i < EXPORT_READBACK_BUFFERS; i++) {
+        retire((frameCount + i) % EXPORT_READBACK_BUFFERS);
+    }
+    double renderSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+    bool ok = encoders.finish();
+    double totalSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    glDeleteBuffers(EXPORT_READBACK_BUFFERS, packBuffers);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteTextures(1, &colorTexture);
+
+    printf("Exported %d frames of %dx%d to %s in %.2f s (%.2f frames/s). Rendering took %.2f s, "
+           "of which %.2f s waiting for the GPU and %.2f s for the %d encoders.\n",
+           frameCount, width, height, options.outputPattern.c_str(), totalSeconds, frameCount / totalSeconds,
+           renderSeconds, gpuWaitSeconds, encoderWaitSeconds, threadCount);
+    return ok;
+}
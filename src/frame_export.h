@@ -0,0 +1,42 @@
+#pragma once
+
+#include "benchmark.h"
+
+#include <glad/glad.h>
+
+#include <string>
+
+// Pixel pack buffers frames are read back through; a frame is copied out of
+// its buffer this many frames after it was drawn, when the GPU is long done
+#define EXPORT_READBACK_BUFFERS 3
+// Encoder threads at most when ExportOptions::encoderThreads is 0
+#define EXPORT_MAX_ENCODERS 8
+
+struct ExportOptions {
+    std::string cameraPath;     // camera path to fly through, see loadCameraPath()
+    // printf pattern for the file names, given the frame number. Files ending
+    // in .exr are written as OpenEXR (half float, linear), anything else as PNG.
+    std::string outputPattern = "frame_%05d.png";
+    float startTime = 0.0f;     // seconds
+    float endTime = -1.0f;      // the last key's time when negative
+    float fps = 30.0f;          // frames per second of the time range
+    int tileSize = 0;           // scene draws are split into squares this big, 0 draws them whole
+    int encoderThreads = 0;     // 0 uses the cores the GL thread leaves, up to EXPORT_MAX_ENCODERS
+};
+
+// Renders the camera path from startTime to endTime at a fixed timestep into
+// an offscreen FBO of frameOptions.width x frameOptions.height, which may be
+// larger than the window, and writes every frame to a numbered file.
+//
+// Frames are read back with glReadPixels into a ring of pixel pack buffers,
+// so the copy runs on the GPU behind the next frames' draws, and each buffer
+// is only mapped EXPORT_READBACK_BUFFERS frames later. A pool of encoder
+// threads compresses and writes the images, so as long as they keep up the
+// export runs as fast as the GPU renders. With tileSize the scene draw is
+// split into scissored tiles that are submitted one by one, so a single
+// large or supersampled frame doesn't turn into one GPU job long enough to
+// trip the driver's watchdog.
+//
+// Draws like runBenchmark() with the hooks of frameOptions; expects the same
+// state to be bound.
+bool runExport(GLuint program, const BenchmarkOptions& frameOptions, const ExportOptions& options);
@@ -0,0 +1,110 @@
+#include "frame_pacer.h"
+
+#include <algorithm>
+#include <initializer_list>
+#include <iostream>
+
+bool FramePacer::create(int framesInFlight) {
+    destroy();
+    maxFrames = framesInFlight > 0 ? std::min(framesInFlight, FRAME_PACER_FRAMES) : FRAME_PACER_FRAMES;
+    glGenQueries(FRAME_PACER_FRAMES, queries);
+    oldest = count = 0;
+    recent = session = FrameLatency();
+    calibrate();
+    created = true;
+    return true;
+}
+
+void FramePacer::destroy() {
+    if (!created) return;
+
+    for (Frame& frame : frames) {
+        if (frame.fence) glDeleteSync(frame.fence);
+        frame.fence = nullptr;
+    }
+    glDeleteQueries(FRAME_PACER_FRAMES, queries);
+    created = false;
+}
+
+void FramePacer::calibrate() {
+    // The GPU's clock now, without waiting for the commands before it
+    glGetInteger64v(GL_TIMESTAMP, &gpuBase);
+    cpuBase = Clock::now();
+}
+
+bool FramePacer::retire(bool wait) {
+    if (count == 0) return false;
+
+    Frame& frame = frames[oldest];
+    GLenum status = glClientWaitSync(frame.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if (status == GL_TIMEOUT_EXPIRED) {
+        if (!wait) return false;
+        Clock::time_point waitStart = Clock::now();
+        do {
+            status = glClientWaitSync(frame.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000); // 1 ms
+        } while (status == GL_TIMEOUT_EXPIRED);
+        double waitMs = std::chrono::duration<double, std::milli>(Clock::now() - waitStart).count();
+        recent.waitMs += waitMs;
+        session.waitMs += waitMs;
+    }
+    if (status == GL_WAIT_FAILED) {
+        std::cerr << "Error waiting for a frame fence\n";
+    }
+    glDeleteSync(frame.fence);
+    frame.fence = nullptr;
+
+    // The timestamp was queued right before the fence, so it is normally in;
+    // if the driver disagrees the frame counts as done now
+    Clock::time_point done = Clock::now();
+    GLint available = GL_FALSE;
+    glGetQueryObjectiv(queries[oldest], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available) {
+        GLuint64 timestamp = 0;
+        glGetQueryObjectui64v(queries[oldest], GL_QUERY_RESULT, &timestamp);
+        done = cpuBase + std::chrono::duration_cast<Clock::duration>(std::chrono::nanoseconds((GLint64)timestamp - gpuBase));
+    }
+    double latencyMs = std::chrono::duration<double, std::milli>(done - frame.inputTime).count();
+    for (FrameLatency* sums : { &recent, &session }) {
+        sums->frames++;
+        sums->latencyMs += latencyMs;
+        sums->maxLatencyMs = std::max(sums->maxLatencyMs, latencyMs);
+    }
+
+    oldest = (oldest + 1) % FRAME_PACER_FRAMES;
+    count--;
+    return true;
+}
+
+void FramePacer::beginFrame() {
+    if (!created) return;
+
+    while (retire(false)) {}
+    while (count >= maxFrames) {
+        retire(true);
+    }
+}
+
+void FramePacer::endFrame(Clock::time_point inputTime) {
+    if (!created) return;
+
+    int slot = (oldest + count) % FRAME_PACER_FRAMES;
+    glQueryCounter(queries[slot], GL_TIMESTAMP);
+    frames[slot].fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    frames[slot].inputTime = inputTime;
+    count++;
+
+    // The two clocks drift apart slowly
+    if (std::chrono::duration<double>(Clock::now() - cpuBase).count() > FRAME_PACER_CALIBRATION) {
+        calibrate();
+    }
+}
+
+FrameLatency FramePacer::takeAverages(FrameLatency& sums, bool reset) {
+    FrameLatency latency = sums;
+    if (latency.frames > 0) {
+        latency.latencyMs /= latency.frames;
+        latency.waitMs /= latency.frames;
+    }
+    if (reset) sums = FrameLatency();
+    return latency;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <chrono>
+
+// Frames the pacer keeps track of, the most --frames-in-flight can allow
+#define FRAME_PACER_FRAMES 8
+// How often the GPU clock is matched against the CPU clock again, in seconds
+#define FRAME_PACER_CALIBRATION 1.0
+
+// Averages over the frames a FramePacer retired
+struct FrameLatency {
+    int frames = 0;
+    double latencyMs = 0.0;    // from sampling the input a frame shows to the GPU finishing it
+    double maxLatencyMs = 0.0;
+    double waitMs = 0.0;       // CPU time spent waiting for the limit, per frame
+};
+
+// Keeps the CPU from running more than a few frames ahead of the GPU, so the
+// driver can't queue up frames whose input is already old, and measures how
+// old it is by the time the GPU is done with them.
+//
+// endFrame() fences each frame after the swap and puts a GL_TIMESTAMP query
+// next to the fence. beginFrame() waits on the oldest fence while the limit is
+// reached. A retired frame's latency is the GPU timestamp, converted to the
+// steady_clock, minus the time its input was sampled. Scanout comes on
+// top of that, up to a refresh interval with vsync.
+class FramePacer {
+public:
+    FramePacer() = default;
+    FramePacer(const FramePacer&) = delete;
+    FramePacer& operator=(const FramePacer&) = delete;
+    ~FramePacer() { destroy(); }
+
+    // framesInFlight 0 leaves the limit to the driver, only measuring
+    bool create(int framesInFlight);
+    void destroy();
+
+    // Call before the frame's CPU work: retires the finished frames and waits
+    // until fewer than the limit are in flight
+    void beginFrame();
+    // Call right after the swap, with the time the frame's input was sampled
+    void endFrame(std::chrono::steady_clock::time_point inputTime);
+
+    // Since the last collect()
+    FrameLatency collect() { return takeAverages(recent, true); }
+    // Since create()
+    FrameLatency overall() { return takeAverages(session, false); }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Frame {
+        GLsync fence = nullptr;
+        Clock::time_point inputTime;
+    };
+
+    void calibrate();
+    // Retires the oldest frame once the GPU has finished it, false if it hasn't and wait is false
+    bool retire(bool wait);
+    static FrameLatency takeAverages(FrameLatency& sums, bool reset);
+
+    Frame frames[FRAME_PACER_FRAMES];
+    GLuint queries[FRAME_PACER_FRAMES] = {};
+    int maxFrames = 0;
+    int oldest = 0, count = 0;
+    bool created = false;
+    // A GL_TIMESTAMP and the CPU time it was taken at
+    GLint64 gpuBase = 0;
+    Clock::time_point cpuBase;
+    FrameLatency recent, session; // sums
+};
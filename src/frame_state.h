@@ -0,0 +1,25 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// Uniform buffer binding point of the FrameState block in shaders/frame_state.glsl
+#define FRAME_STATE_BINDING 0
+
+// std140 layout of the FrameState block: what the scene and loading shaders
+// used to get as separate uniforms. It is streamed through a StreamBuffer, so
+// a frame's state is one memcpy into a persistently mapped buffer.
+struct FrameState {
+    glm::vec2 resolution;
+    glm::vec2 jitter = glm::vec2(0.0f);
+    glm::vec3 camPos;
+    float time;
+    glm::vec3 camTarget;
+    float scroll;
+    int flashlight;
+    int renderMode;
+    int prepassTile = 0;
+    int deferred = 0;
+    int relaxedMarch = 0;
+    int pad[3] = {}; // std140 rounds the block up to a multiple of 16 bytes
+};
+static_assert(sizeof(FrameState) == 80, "FrameState must match the std140 block in frame_state.glsl");
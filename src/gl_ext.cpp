@@ -0,0 +1,57 @@
+#include "gl_ext.h"
+
+#include <cstring>
+#include <iostream>
+
+PFNGLBUFFERSTORAGEPROC ext_glBufferStorage = nullptr;
+PFNGLMAXSHADERCOMPILERTHREADSKHRPROC ext_glMaxShaderCompilerThreadsKHR = nullptr;
+static bool s3tc = false;
+
+static bool hasExtension(const char* name) {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++) {
+        const char* ext = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if (ext && strcmp(ext, name) == 0) return true;
+    }
+    return false;
+}
+
+static bool hasVersion(int major, int minor) {
+    GLint glMajor = 0, glMinor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &glMajor);
+    glGetIntegerv(GL_MINOR_VERSION, &glMinor);
+    return glMajor > major || (glMajor == major && glMinor >= minor);
+}
+
+void loadGLExtensions(GLADloadproc load) {
+    if (hasVersion(4, 4) || hasExtension("GL_ARB_buffer_storage")) {
+        ext_glBufferStorage = (PFNGLBUFFERSTORAGEPROC)load("glBufferStorage");
+    }
+    if (!ext_glBufferStorage) {
+        std::cerr << "glBufferStorage not available, streaming buffers fall back to unsynchronized maps\n";
+    }
+
+    if (hasExtension("GL_KHR_parallel_shader_compile")) {
+        ext_glMaxShaderCompilerThreadsKHR = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)load("glMaxShaderCompilerThreadsKHR");
+    } else if (hasExtension("GL_ARB_parallel_shader_compile")) {
+        ext_glMaxShaderCompilerThreadsKHR = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)load("glMaxShaderCompilerThreadsARB");
+    }
+    if (ext_glMaxShaderCompilerThreadsKHR) {
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu); // let the driver pick
+    }
+
+    s3tc = hasExtension("GL_EXT_texture_compression_s3tc");
+}
+
+bool hasBufferStorage() {
+    return ext_glBufferStorage != nullptr;
+}
+
+bool hasParallelShaderCompile() {
+    return ext_glMaxShaderCompilerThreadsKHR != nullptr;
+}
+
+bool hasS3TC() {
+    return s3tc;
+}
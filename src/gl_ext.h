@@ -0,0 +1,44 @@
+#pragma once
+
+// Entry points and enums newer than the GL 4.3 core profile that glad was
+// generated for. They are loaded by loadGLExtensions() after gladLoadGLLoader
+// and stay null when the driver doesn't expose them, so check the has*()
+// queries before calling.
+
+#include <glad/glad.h>
+
+// GL 4.4 / ARB_buffer_storage
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#define GL_DYNAMIC_STORAGE_BIT 0x0100
+#define GL_CLIENT_STORAGE_BIT 0x0200
+#endif
+#ifndef GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT
+#define GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT 0x00004000
+#endif
+typedef void (APIENTRYP PFNGLBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+extern PFNGLBUFFERSTORAGEPROC ext_glBufferStorage;
+#define glBufferStorage ext_glBufferStorage
+
+// KHR_parallel_shader_compile (or the identical ARB extension)
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+extern PFNGLMAXSHADERCOMPILERTHREADSKHRPROC ext_glMaxShaderCompilerThreadsKHR;
+#define glMaxShaderCompilerThreadsKHR ext_glMaxShaderCompilerThreadsKHR
+
+// EXT_texture_compression_s3tc, block compressed textures (BC1-3)
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+
+void loadGLExtensions(GLADloadproc load);
+
+bool hasBufferStorage();
+// GL_COMPLETION_STATUS_KHR can be polled instead of blocking on compile/link status
+bool hasParallelShaderCompile();
+// GL_COMPRESSED_RGB_S3TC_DXT1_EXT textures can be uploaded
+bool hasS3TC();
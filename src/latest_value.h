@@ -0,0 +1,33 @@
+#pragma once
+
+#include <atomic>
+
+// Hands the newest value of something from one thread to another without
+// locks (a triple buffer): publish() never waits and read() always gets the
+// latest complete value, skipping any it missed. One writer, one reader.
+template <typename T>
+class LatestValue {
+public:
+    void publish(const T& value) {
+        slots[back] = value;
+        back = shared.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+
+    // Copies the latest value, returns whether it is new since the last read()
+    bool read(T& value) {
+        bool fresh = (shared.load(std::memory_order_acquire) & FRESH) != 0;
+        if (fresh) {
+            front = shared.exchange(front, std::memory_order_acq_rel) & INDEX;
+        }
+        value = slots[front];
+        return fresh;
+    }
+
+private:
+    enum { INDEX = 3, FRESH = 4 };
+
+    T slots[3] = {};
+    std::atomic<int> shared{1}; // the slot between the two threads, FRESH once written
+    int back = 0;               // the writer's
+    int front = 2;              // the reader's
+};
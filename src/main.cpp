@@ -7,9 +7,33 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
-#include<SOIL.H>
-
+#include "benchmark.h"
+#include "deferred_shading.h"
+#include "depth_prepass.h"
+#include "dynamic_resolution.h"
+#include "frame_export.h"
+#include "frame_pacer.h"
+#include "frame_state.h"
+#include "gl_ext.h"
+#include "latest_value.h"
+#include "march_stats.h"
+#include "pass_timers.h"
+#include "program_cache.h"
+#include "scene.h"
+#include "sdf_bake.h"
+#include "sdf_query.h"
+#include "shader_gen.h"
+#include "stream_buffer.h"
+#include "temporal_aa.h"
+#include "text_overlay.h"
+#include "texture_stream.h"
+#include "tiled_raymarch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstdlib>
+#include <cstring>
 #include <cstddef>
 #include <cstdio>
 #include <fstream>
@@ -17,6 +41,7 @@
 #include <iostream>
 #include <unordered_set>
 #include <filesystem>
+#include <thread>
 #include <vector>
 
 #define M_PI 3.14159265358979323846
@@ -73,47 +98,44 @@ std::string preprocessShader(const std::string& filePath) {
     return preprocessShader(filePath, includedFiles);
 }
 
-GLuint compileShader(GLenum type, const std::string& source) {
-    GLuint shader = glCreateShader(type);
-    const char* sourceCStr = source.c_str();
-    glShaderSource(shader, 1, &sourceCStr, nullptr);
-    glCompileShader(shader);
-
-    int success;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        char infoLog[512];
-        glGetShaderInfoLog(shader, 512, nullptr, infoLog);
-        fprintf(stderr, "ERROR::SHADER::COMPILATION_FAILED\n%s\n", infoLog);
-    }
-
-    return shader;
-}
-
-GLuint createShaderProgram(const char* vertexPath, const char* fragmentPath) {
+// Starts building the program from shader files, see program_cache.h
+void startShaderProgram(const char* vertexPath, const char* fragmentPath, const std::string& cacheDir, ProgramBuild& build) {
     std::string vertexCode = preprocessShader(vertexPath);
     std::string fragmentCode = preprocessShader(fragmentPath);
+    startProgramBuild(vertexCode, fragmentCode, cacheDir, build);
+}
 
-    GLuint vertexShader = compileShader(GL_VERTEX_SHADER, vertexCode);
-    GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, fragmentCode);
-
-    GLuint shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
-
-    int success;
-    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
-    if (!success) {
-        char infoLog[512];
-        glGetProgramInfoLog(shaderProgram, 512, nullptr, infoLog);
-        fprintf(stderr, "ERROR::PROGRAM::LINKING_FAILED\n%s\n", infoLog);
+// Include overrides for the scene programs, see buildShaderSource
+static std::map<std::string, std::string> sceneOverrides(const std::vector<ScenePrimitive>& primitives,
+                                                         const std::vector<SceneAnimation>& animations, bool specialize) {
+    std::map<std::string, std::string> overrides;
+    if (specialize && primitives.size() <= SPECIALIZE_MAX_PRIMITIVES) {
+        overrides["scene.glsl"] = generateSceneSDF(primitives, animations);
+        std::cout << "Specialized scene shader for " << primitives.size() << " primitives\n";
     }
+    return overrides;
+}
 
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
+// Same, but the fragment shader goes through buildShaderSource: unused functions
+// are dropped and, for small scenes, scene.glsl is replaced with code generated
+// for `primitives` (see shader_gen.h)
+bool startSceneProgram(const char* vertexPath, const char* fragmentPath, const std::string& cacheDir,
+                       const std::vector<ScenePrimitive>& primitives, const std::vector<SceneAnimation>& animations,
+                       bool specialize, ProgramBuild& build) {
+    ShaderSource fragment;
+    if (!buildShaderSource(fragmentPath, sceneOverrides(primitives, animations, specialize), fragment)) return false;
+    startProgramBuild(preprocessShader(vertexPath), fragment.code, cacheDir, build, fragment.files);
+    return true;
+}
 
-    return shaderProgram;
+// The same for a compute shader that evaluates the scene
+bool startSceneComputeProgram(const char* computePath, const std::string& cacheDir,
+                              const std::vector<ScenePrimitive>& primitives, const std::vector<SceneAnimation>& animations,
+                              bool specialize, ProgramBuild& build) {
+    ShaderSource compute;
+    if (!buildShaderSource(computePath, sceneOverrides(primitives, animations, specialize), compute)) return false;
+    startComputeProgramBuild(compute.code, cacheDir, build, compute.files);
+    return true;
 }
 
 void error_callback(int error, const char* description)
@@ -134,31 +156,14 @@ double dx = 0.0, dy = 0.0;
 float sensitivity = 0.5f; // Mouse sensitivity
 int renderMode = 1; // Placeholder for render mode
 bool flashlightOn = false; // Placeholder for flashlight state
+bool tiledCompute = false; // scene pass through the tiled compute shader instead of the quad, see tiled_raymarch.h
+bool relaxedMarch = false; // over-relaxed primary rays, see rMarch() in shaders/primary_rays.glsl
+bool overlayOn = false; // performance overlay, see text_overlay.h
+bool collisionOn = true; // keep the camera out of the scene, see collideCamera()
+unsigned pickCount = 0; // left clicks, each reports what the centre of the screen shows
+int framebufferWidth = 0, framebufferHeight = 0;
 int radius = 100.0;
 
-void loadTexture(const char* filePath, GLuint& textureID) {
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_2D, textureID);
-
-    int width, height;
-    unsigned char* image = SOIL_load_image(filePath, &width, &height, 0, SOIL_LOAD_RGBA);
-    if (image) {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-        glGenerateMipmap(GL_TEXTURE_2D);
-    } else {
-        std::cerr << "Failed to load texture: " << filePath << std::endl;
-        return; // Early return if texture loading fails
-    }
-    SOIL_free_image_data(image);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    glBindTexture(GL_TEXTURE_2D, 0);
-}
-
 float clamp(float value, float min, float max) {
     if (value < min) return min;
     if (value > max) return max;
@@ -224,6 +229,14 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
         case GLFW_KEY_F:
           flashlightOn = !flashlightOn; // Toggle flashlight state
           break;
+        case GLFW_KEY_C:
+          tiledCompute = !tiledCompute; // Toggle the tiled compute path
+          printf("Scene pass: %s\n", tiledCompute ? "tiled compute" : "fragment");
+          break;
+        case GLFW_KEY_R:
+          relaxedMarch = !relaxedMarch; // Toggle the relaxed march
+          printf("Primary rays: %s\n", relaxedMarch ? "relaxed march" : "sphere tracing");
+          break;
         case GLFW_KEY_1:
           renderMode = 1; // Set render mode 1
           break;
@@ -236,9 +249,25 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
         case GLFW_KEY_4:
           renderMode = 4; // Set render mode 4
           break;
+        case GLFW_KEY_5:
+          renderMode = TAA_RENDER_MODE; // One jittered ray, accumulated over frames
+          break;
+        case GLFW_KEY_6:
+          renderMode = HEATMAP_STEPS_MODE; // Primary ray march steps per pixel
+          break;
+        case GLFW_KEY_7:
+          renderMode = HEATMAP_CALLS_MODE; // calcSDF calls per pixel
+          break;
         case GLFW_KEY_0:
           renderMode = 0; // Set render mode 0
           break;
+        case GLFW_KEY_O:
+          overlayOn = !overlayOn; // Toggle the performance overlay
+          break;
+        case GLFW_KEY_N:
+          collisionOn = !collisionOn; // Toggle camera collision
+          printf("Camera collision %s\n", collisionOn ? "on" : "off");
+          break;
         default:
           break;
       }
@@ -258,6 +287,17 @@ void mouse_position_callback(GLFWwindow* window, double xpos, double ypos) {
     calc_camdir(dx, dy);
 }
 
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods) {
+    if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
+        pickCount++; // the cursor is captured, so this picks through the centre of the screen
+    }
+}
+
+void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
+    framebufferWidth = width;
+    framebufferHeight = height;
+}
+
 double scrollOffset = 0.0f;
 
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
@@ -266,17 +306,16 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
 
 double previousTime = 0.0;
 
-GLuint ssbo;
-
-struct object {
-    float x;
-    float y;
-    float z;
+// Scene SSBOs, binding points match shaders/scene.glsl
+GLuint gridSSBO, gridIndicesSSBO;
+// Primitives change every frame when the scene is animated
+StreamBuffer primitivesStream;
+// The FrameState block of the scene and loading programs, see frame_state.h
+StreamBuffer frameStateStream;
+// The `sceneLights` SSBO of shaders/lights.glsl, lights can orbit
+StreamBuffer lightsStream;
 
-    object(float x, float y, float z) : x(x), y(y), z(z) {}
-};
-
-void createAndBindSSBO(const std::vector<object>& vecList) {
+void createAndBindSSBO(GLuint& ssbo, GLuint binding, const void* data, size_t size) {
     glGenBuffers(1, &ssbo);
     if (glGetError() != GL_NO_ERROR) {
         std::cerr << "Error generating SSBO\n";
@@ -289,13 +328,13 @@ void createAndBindSSBO(const std::vector<object>& vecList) {
         return;
     }
 
-    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(vecList), vecList.data(), GL_STATIC_DRAW);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size, data, GL_STATIC_DRAW);
     if (glGetError() != GL_NO_ERROR) {
         std::cerr << "Error setting SSBO data\n";
         return;
     }
 
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, ssbo); // Binding point 0
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, ssbo);
     if (glGetError() != GL_NO_ERROR) {
         std::cerr << "Error binding SSBO base\n";
         return;
@@ -306,35 +345,343 @@ void createAndBindSSBO(const std::vector<object>& vecList) {
         std::cerr << "Error unbinding SSBO\n";
         return;
     }
+}
 
-    std::cout << "SSBO created and bound successfully\n";
+// Uploads the primitives and their acceleration grid. The grid is built for the
+// scene file positions and stays valid while the animations move primitives.
+bool createSceneSSBOs(const std::vector<ScenePrimitive>& primitives, const std::vector<SceneAnimation>& animations) {
+    SceneGrid grid;
+    buildSceneGrid(primitives, grid, sceneMotionExtent(animations));
+    std::vector<unsigned char> gridData = packSceneGrid(grid);
+
+    // Zero sized SSBOs aren't allowed, the shader never reads past the counts anyway
+    static const uint32_t empty[4] = {};
+    if (!primitivesStream.create(GL_SHADER_STORAGE_BUFFER, 0, primitives.empty() ? (const void*)empty : primitives.data(),
+                                 std::max<size_t>(primitives.size() * sizeof(ScenePrimitive), sizeof(empty)))) {
+        return false;
+    }
+    primitivesStream.upload();
+    createAndBindSSBO(gridSSBO, 1, gridData.data(), gridData.size());
+    createAndBindSSBO(gridIndicesSSBO, 2, grid.indices.empty() ? (const void*)empty : grid.indices.data(),
+                      std::max<size_t>(grid.indices.size() * sizeof(uint32_t), sizeof(empty)));
+
+    std::cout << "Scene grid " << grid.dims.x << "x" << grid.dims.y << "x" << grid.dims.z
+              << ", " << grid.indices.size() << " cell entries\n";
+    return true;
 }
 
-void updateSSBO(const std::vector<glm::vec3>& newVecList) {
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
-    GLvoid* p = glMapBuffer(GL_SHADER_STORAGE_BUFFER, GL_WRITE_ONLY);
-    if (p) {
-        memcpy(p, newVecList.data(), newVecList.size() * sizeof(glm::vec3));
-        glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+// Streams the animated primitives for `time`; only their records are copied
+void updateSceneAnimation(const std::vector<SceneAnimation>& animations, float time, std::vector<ScenePrimitive>& primitives) {
+    animateScene(animations, time, primitives);
+    for (const SceneAnimation& animation : animations) {
+        size_t index = animation.primitive;
+        primitivesStream.update(index * sizeof(ScenePrimitive), &primitives[index], sizeof(ScenePrimitive));
+    }
+    primitivesStream.upload();
+}
+
+// Streams the lights as they are at `time`
+void updateSceneLights(const std::vector<LightOrbit>& orbits, float time, std::vector<SceneLight>& lights) {
+    animateLights(orbits, time, lights);
+    for (const LightOrbit& orbit : orbits) {
+        size_t index = orbit.light;
+        lightsStream.update(index * sizeof(SceneLight), &lights[index], sizeof(SceneLight));
     }
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    lightsStream.upload();
+}
+
+// Radius of the sphere around the camera that collision keeps out of the scene
+static const float CAMERA_RADIUS = 0.2f;
+
+// Moves the camera freely until it is CAMERA_RADIUS away from the surface
+// and drops the part of the rest of this frame's move that goes into it, so
+// the camera slides along walls. probe is the latest distance query at the
+// camera, a frame or two old: the distance at the camera now is at least its
+// distance minus how far the camera moved since.
+static glm::vec3 collideCamera(glm::vec3 camPos, glm::vec3 move, const SdfResult& probe) {
+    float clearance = probe.position.w - glm::length(camPos - glm::vec3(probe.position)) - CAMERA_RADIUS;
+    clearance = glm::max(clearance, 0.0f);
+    float length = glm::length(move);
+    if (length <= clearance) return move;
+    glm::vec3 free = move * (clearance / length);
+    glm::vec3 rest = move - free;
+    glm::vec3 normal(probe.normal);
+    rest -= normal * glm::min(glm::dot(rest, normal), 0.0f);
+    return free + rest;
 }
 
-int main(void)
+// Times a second the main thread samples the input when no events come in
+static const double INPUT_SAMPLE_HZ = 1000.0;
+
+// The input as of one sample, handed from the main thread to the render thread
+struct InputSnapshot {
+    glm::vec3 camPos;
+    glm::vec3 camTarget;
+    glm::vec3 forward;
+    float scroll;
+    int width, height; // of the framebuffer
+    int renderMode;
+    bool flashlight, tiledCompute, relaxedMarch, overlay;
+    unsigned picks;
+    std::chrono::steady_clock::time_point time; // when it was sampled
+};
+LatestValue<InputSnapshot> inputSnapshots;
+// Distance queries at the camera, from the render thread, see collideCamera()
+LatestValue<SdfResult> cameraProbes;
+SdfResult cameraProbe;
+bool hasCameraProbe = false;
+
+// Moves the camera by the keys held over the last deltaTime seconds and
+// publishes the input for the render thread. GLFW only lets the main thread
+// look at the window, so this runs there, the mouse callbacks turn the camera
+// in between.
+void sampleInput(GLFWwindow* window, float deltaTime) {
+    float moveSpeed = 5.0f;
+    float movement = moveSpeed * deltaTime;
+
+    // Check key states and update camera position
+    if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS)
+    {
+        movement *= 2.0f;
+    }
+    camOriented = glfwGetKey(window, GLFW_KEY_LEFT_ALT) == GLFW_PRESS;
+    if (camOriented)
+    {
+        movement /= 5.0f;
+    }
+
+    glm::vec3 move(0.0f);
+    if (camOriented)
+    {
+        if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+        {
+            move += movement * forward;
+        }
+        if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+        {
+            move -= movement * forward;
+        }
+        if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+        {
+            move -= movement * right;
+        }
+        if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+        {
+            move += movement * right;
+        }
+    }
+    else {
+        if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+        {
+            move += movement * glm::vec3(forwardXZ.x, 0.0f, forwardXZ.z);
+        }
+        if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+        {
+            move -= movement * glm::vec3(forwardXZ.x, 0.0f, forwardXZ.z);
+        }
+        if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+        {
+            move -= movement * glm::vec3(right.x, 0.0f, right.z);
+        }
+        if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+        {
+            move += movement * glm::vec3(right.x, 0.0f, right.z);
+        }
+    }
+
+    if (glfwGetKey(window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS)
+    {
+        move.y -= movement;
+    }
+    if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS)
+    {
+        move.y += movement;
+    }
+
+    glm::vec3 camera(camPosX, camPosY, camPosZ);
+    if (cameraProbes.read(cameraProbe)) {
+        hasCameraProbe = true;
+        // Pushed out once per probe, whatever got the camera inside. The
+        // camera has moved on since the probe, the distance is carried along
+        // the normal to where it is now.
+        glm::vec3 normal(cameraProbe.normal);
+        float depth = CAMERA_RADIUS - cameraProbe.position.w - glm::dot(normal, camera - glm::vec3(cameraProbe.position));
+        if (collisionOn && depth > 0.0f) {
+            camera += normal * depth;
+        }
+    }
+    if (collisionOn && hasCameraProbe) {
+        move = collideCamera(camera, move, cameraProbe);
+    }
+    camera += move;
+    camPosX = camera.x;
+    camPosY = camera.y;
+    camPosZ = camera.z;
+
+    InputSnapshot input;
+    input.camPos = camera;
+    input.camTarget = camTarget;
+    input.forward = forward;
+    input.scroll = (float)scrollOffset;
+    input.width = framebufferWidth;
+    input.height = framebufferHeight;
+    input.renderMode = renderMode;
+    input.flashlight = flashlightOn;
+    input.tiledCompute = tiledCompute;
+    input.relaxedMarch = relaxedMarch;
+    input.overlay = overlayOn;
+    input.picks = pickCount;
+    input.time = std::chrono::steady_clock::now();
+    inputSnapshots.publish(input);
+}
+
+// A monospaced system font for the overlay when --font isn't given, empty if there is none
+static std::string defaultFontPath() {
+    static const char* candidates[] = {
+#ifdef _WIN32
+        "C:/Windows/Fonts/consola.ttf",
+        "C:/Windows/Fonts/cour.ttf",
+#else
+        "/usr/share/fonts/truetype/dejavu/DejaVuSansMono.ttf",
+        "/usr/share/fonts/TTF/DejaVuSansMono.ttf",
+        "/usr/share/fonts/dejavu/DejaVuSansMono.ttf",
+        "/usr/share/fonts/truetype/liberation/LiberationMono-Regular.ttf",
+        "/System/Library/Fonts/Menlo.ttc",
+#endif
+    };
+    for (const char* path : candidates) {
+        std::error_code error;
+        if (std::filesystem::exists(path, error)) return path;
+    }
+    return "";
+}
+
+static const char* renderModeName(int mode) {
+    switch (mode) {
+        case 0: return "UV debug";
+        case 1: return "single ray";
+        case 2: return "2x supersampled";
+        case 3: return "3x supersampled";
+        case 4: return "4x supersampled";
+        case TAA_RENDER_MODE: return "temporal";
+        case HEATMAP_STEPS_MODE: return "march steps heatmap";
+        case HEATMAP_CALLS_MODE: return "calcSDF calls heatmap";
+        default: return "unknown";
+    }
+}
+
+static void usage(const char* exe) {
+    fprintf(stderr,
+        "Usage: %s [--scene <file>] [--shader-cache <dir>] [--no-specialize] [--no-bake] [--no-prepass] [--no-deferred] [--ao-scale <1|2|4>] [--shadow-scale <1|2|4>] [--no-accumulate] [--compute] [--relaxed-march] [--frame-budget <ms>] [--frames-in-flight <n>] [--font <file>] [--benchmark <camera path> [--size <W>x<H>] [--out <results.json>] [--warmup <frames>]] [--export <camera path> [--size <W>x<H>] [--out <frame_%%05d.png|.exr>] [--from <s>] [--to <s>] [--fps <n>] [--tile <pixels>] [--encoders <n>]]\n",
+        exe);
+}
+
+int main(int argc, char** argv)
 {
     GLFWwindow* window;
     GLuint vertex_array, vertex_buffer, program;
     GLint vpos_location, vcol_location;
-    GLint resolutionLoc, timeLoc, scrollLoc, camPosLoc, camTargetLoc, flashlightLoc, renderModeLoc;
     //GLint textureTestLoc;
 
+    // Benchmark mode plays back a camera path offscreen instead of the interactive loop.
+    // Export mode is set up the same way and writes the frames to files instead of timing them.
+    bool benchmark = false;
+    bool exportFrames = false;
+    BenchmarkOptions benchmarkOptions;
+    ExportOptions exportOptions;
+    std::string outPath;
+    std::string scenePath = "../../scenes/default.scene";
+    std::string shaderCacheDir = "shader_cache"; // empty disables the program binary cache
+    bool specialize = true; // generate calcSceneSDF for the loaded scene instead of interpreting the SSBO
+    bool bakeSDF = true;    // sample static fractals into distance volumes, see sdf_bake.h
+    bool depthPrepass = true; // cone-march tiles to start the primary rays late, see depth_prepass.h
+    bool deferredShading = true; // light the one ray modes from a G-buffer with culled lights, see deferred_shading.h
+    int aoScale = 2;             // resolution divisors of the deferred AO and shadows, see occlusion_passes.h
+    int shadowScale = 2;
+    bool accumulateOcclusion = true; // average AO and shadows over frames while nothing moves
+    float frameBudgetMs = 16.6f; // dynamic resolution target, 0 renders at the window size
+    int framesInFlight = 2;      // how far the CPU may run ahead of the GPU, 0 leaves it to the driver, see frame_pacer.h
+    std::string fontPath;        // of the overlay, defaultFontPath() when empty
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--scene" && hasValue) {
+            scenePath = argv[++i];
+        } else if (arg == "--shader-cache" && hasValue) {
+            shaderCacheDir = argv[++i];
+        } else if (arg == "--no-specialize") {
+            specialize = false;
+        } else if (arg == "--no-bake") {
+            bakeSDF = false;
+        } else if (arg == "--no-prepass") {
+            depthPrepass = false;
+        } else if (arg == "--no-deferred") {
+            deferredShading = false;
+        } else if ((arg == "--ao-scale" || arg == "--shadow-scale") && hasValue) {
+            int scale = atoi(argv[++i]);
+            if (scale != 1 && scale != 2 && scale != 4) {
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            (arg == "--ao-scale" ? aoScale : shadowScale) = scale;
+        } else if (arg == "--no-accumulate") {
+            accumulateOcclusion = false;
+        } else if (arg == "--compute") {
+            tiledCompute = true;
+        } else if (arg == "--relaxed-march") {
+            relaxedMarch = true;
+        } else if (arg == "--frame-budget" && hasValue) {
+            frameBudgetMs = (float)atof(argv[++i]);
+        } else if (arg == "--frames-in-flight" && hasValue) {
+            framesInFlight = atoi(argv[++i]);
+        } else if (arg == "--font" && hasValue) {
+            fontPath = argv[++i];
+        } else if (arg == "--benchmark" && hasValue) {
+            benchmark = true;
+            benchmarkOptions.cameraPath = argv[++i];
+        } else if (arg == "--size" && hasValue) {
+            if (sscanf(argv[++i], "%dx%d", &benchmarkOptions.width, &benchmarkOptions.height) != 2) {
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+        } else if (arg == "--out" && hasValue) {
+            outPath = argv[++i];
+        } else if (arg == "--warmup" && hasValue) {
+            benchmarkOptions.warmupFrames = atoi(argv[++i]);
+        } else if (arg == "--export" && hasValue) {
+            benchmark = exportFrames = true;
+            exportOptions.cameraPath = argv[++i];
+        } else if (arg == "--from" && hasValue) {
+            exportOptions.startTime = (float)atof(argv[++i]);
+        } else if (arg == "--to" && hasValue) {
+            exportOptions.endTime = (float)atof(argv[++i]);
+        } else if (arg == "--fps" && hasValue) {
+            exportOptions.fps = (float)atof(argv[++i]);
+        } else if (arg == "--tile" && hasValue) {
+            exportOptions.tileSize = atoi(argv[++i]);
+        } else if (arg == "--encoders" && hasValue) {
+            exportOptions.encoderThreads = atoi(argv[++i]);
+        } else {
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (exportFrames) {
+        if (!outPath.empty()) exportOptions.outputPattern = outPath;
+    } else {
+        benchmarkOptions.outputPath = outPath;
+    }
+
     glfwSetErrorCallback(error_callback);
     if (!glfwInit())
         exit(EXIT_FAILURE);
 
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    if (benchmark) {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE); // all rendering goes to an offscreen FBO
+    }
 
     window = glfwCreateWindow(1080, 720, "Sangatsu", NULL, NULL);
     if (!window)
@@ -349,43 +696,121 @@ int main(void)
         std::cerr << "Failed to initialize GLAD\n";
         return -1;
     }
+    loadGLExtensions((GLADloadproc)glfwGetProcAddress);
+
+    // Textures are decoded on worker threads and uploaded as they finish, see texture_stream.h
+    TextureStreamer textureStreamer;
+    textureStreamer.create(shaderCacheDir);
+    GLuint testTexture = textureStreamer.request("../../textures/test.png");
+
+    // The scene program comes from the shader cache or is compiled in the background.
+    // Until it is ready the window shows the (tiny) loading shader instead of blocking.
+    double buildStart = glfwGetTime();
+    ProgramBuild loadingBuild, sceneBuild, upscaleBuild, taaBuild, prepassBuild, lightingBuild, occlusionBuild;
+    ProgramBuild tiledBuild, tiledPresentBuild, queryBuild;
+    if (!benchmark) {
+        startShaderProgram("../../shaders/vertex.glsl", "../../shaders/loading.glsl", shaderCacheDir, loadingBuild);
+        finishProgramBuild(loadingBuild);
+    }
 
-    // Textures
+    // The scene is needed first, the fragment shader is generated for it
+    std::vector<ScenePrimitive> primitives;
+    std::vector<SceneAnimation> animations;
+    std::vector<SceneLight> lights;
+    std::vector<LightOrbit> lightOrbits;
+    if (!loadScene(scenePath, primitives, &animations, &lights, &lightOrbits)) {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
 
-    // testTexture
-    GLuint testTexture;
-    glGenTextures(1, &testTexture);
-    glBindTexture(GL_TEXTURE_2D, testTexture);
-    // Texture wrapping parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	// set texture wrapping to GL_REPEAT (default wrapping method)
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    // Texture filtering parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    // Load image
-    loadTexture("../../textures/test.png", testTexture);
+    // Baking marks the primitives it covers, which the shader generation and upload depend on
+    SceneBake sceneBake;
+    if (!bakeScene("../../shaders/bake_sdf.glsl", primitives, animations, shaderCacheDir, bakeSDF, sceneBake)) {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
 
-    program = createShaderProgram("../../shaders/vertex.glsl", "../../shaders/fragment.glsl");
+    if (!startSceneProgram("../../shaders/vertex.glsl", "../../shaders/fragment.glsl", shaderCacheDir,
+                           primitives, animations, specialize, sceneBuild) ||
+        (benchmark && !finishProgramBuild(sceneBuild))) {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
+    // Built like the scene program, it evaluates the same calcSceneSDF
+    if (depthPrepass && !startSceneProgram("../../shaders/vertex.glsl", "../../shaders/depth_prepass.glsl", shaderCacheDir,
+                                           primitives, animations, specialize, prepassBuild)) {
+        depthPrepass = false;
+    }
+    // The lighting pass casts the shadow rays, so it needs the scene too. The
+    // culling shader doesn't, and is small enough to build right away.
+    GLuint cullProgram = 0;
+    if (deferredShading) {
+        ShaderSource cullSource;
+        if (buildShaderSource("../../shaders/light_cull.glsl", {}, cullSource)) {
+            cullProgram = createComputeProgram(cullSource.code, cullSource.files);
+        }
+        deferredShading = cullProgram && startSceneProgram("../../shaders/vertex.glsl", "../../shaders/deferred_lighting.glsl",
+                                                           shaderCacheDir, primitives, animations, specialize, lightingBuild);
+    }
+    bool occlusionPasses = deferredShading && (aoScale > 1 || shadowScale > 1) &&
+                           startSceneProgram("../../shaders/vertex.glsl", "../../shaders/occlusion_pass.glsl", shaderCacheDir,
+                                             primitives, animations, specialize, occlusionBuild);
+    // Built in the background either way so it can be switched to at runtime,
+    // a benchmark only needs it when asked for
+    bool tiledAvailable = (!benchmark || tiledCompute) &&
+                          startSceneComputeProgram("../../shaders/raymarch_tiled.glsl", shaderCacheDir,
+                                                   primitives, animations, specialize, tiledBuild);
+    if (tiledAvailable) {
+        startShaderProgram("../../shaders/vertex.glsl", "../../shaders/tiled_present.glsl", shaderCacheDir, tiledPresentBuild);
+    }
+    // Scene queries for camera collision and picking, the benchmark flies a fixed path
+    bool queriesAvailable = !benchmark &&
+                            startSceneComputeProgram("../../shaders/sdf_query.glsl", shaderCacheDir,
+                                                     primitives, animations, specialize, queryBuild);
+    program = sceneBuild.ready ? sceneBuild.program : loadingBuild.program;
     glUseProgram(program);
 
     //glUniform1i(glGetUniformLocation(program, "u_textureTest"), 0);
 
-    std::vector<object> vecList = {
-        object(5.0f, 0.0f, 5.0f),
-        object(5.0f, 10.0f, 5.0f)
-    };
+    // Create and bind the scene SSBOs
+    if (!createSceneSSBOs(primitives, animations)) {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
+    if (!lightsStream.create(GL_SHADER_STORAGE_BUFFER, 7, lights.data(), lights.size() * sizeof(SceneLight))) {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
+    lightsStream.upload();
+    FrameState initialState{};
+    if (!frameStateStream.create(GL_UNIFORM_BUFFER, FRAME_STATE_BINDING, &initialState, sizeof(initialState))) {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
+    // The scene shaders count into it in the heatmap modes, so it has to be bound in benchmarks too
+    MarchStats marchStats;
+    marchStats.create();
+
+    if (!benchmark) {
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+        glfwSetCursorPosCallback(window, mouse_position_callback);
+
+        glfwSetKeyCallback(window, key_callback);
 
-    // Create and bind the SSBO
-    createAndBindSSBO(vecList);
+        glfwSetScrollCallback(window, scroll_callback);
 
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-    glfwSetCursorPosCallback(window, mouse_position_callback);
-  
-    glfwSwapInterval(1);
+        glfwSetMouseButtonCallback(window, mouse_button_callback);
 
-    glfwSetKeyCallback(window, key_callback);
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    }
 
-    glfwSetScrollCallback(window, scroll_callback);
+    glfwSwapInterval(benchmark ? 0 : 1);
 
     glGenVertexArrays(1, &vertex_array);
     glBindVertexArray(vertex_array);
@@ -397,15 +822,11 @@ int main(void)
     vpos_location = glGetAttribLocation(program, "in_position");
     vcol_location = glGetAttribLocation(program, "vCol");
 
-    // Get uniform locations for fragment shader
-    resolutionLoc = glGetUniformLocation(program, "u_resolution");
-    timeLoc = glGetUniformLocation(program, "u_time");
-    scrollLoc = glGetUniformLocation(program, "u_scroll");
-    camPosLoc = glGetUniformLocation(program, "u_camPos");
-    camTargetLoc = glGetUniformLocation(program, "u_camTarget");
-    flashlightLoc = glGetUniformLocation(program, "u_flashlight");
-    renderModeLoc = glGetUniformLocation(program, "u_renderMode");
-    //textureTestLoc = glGetUniformLocation(program, "u_textureTest");
+    // The rest of the frame's state is in the FrameState block, set again whenever the program changes
+    auto setLightCount = [&]() {
+        glUniform1i(glGetUniformLocation(program, "u_lightCount"), (int)lights.size());
+    };
+    setLightCount();
 
 //    // Texture binding
 //    glActiveTexture(GL_TEXTURE0);
@@ -419,130 +840,472 @@ int main(void)
     glVertexAttribPointer(vcol_location, 3, GL_FLOAT, GL_FALSE,
                           sizeof(Vertex), (void*)offsetof(Vertex, col));
 
-    previousTime = glfwGetTime();
+    DepthPrepass prepass;
+    bool prepassReady = false;
+    auto createPrepass = [&]() {
+        prepassReady = prepassBuild.ready && prepass.create(prepassBuild.program);
+        if (!prepassReady) {
+            std::cerr << "Depth prepass disabled\n";
+        }
+    };
 
-    int width, height;
-    glfwGetWindowSize(window, &width, &height);
-    glfwSetCursorPos(window, width / 2, height / 2);
-    prevMouseX = width / 2;
-    prevMouseY = height / 2;
+    DeferredShading deferred;
+    OcclusionPasses occlusion;
+    bool deferredReady = false;
+    // Once both scene programs are built; the deferred path works without the occlusion passes
+    auto createDeferred = [&]() {
+        bool occlusionReady = occlusionPasses && occlusionBuild.ready &&
+                              occlusion.create(occlusionBuild.program, aoScale, shadowScale, accumulateOcclusion);
+        if (occlusionPasses && !occlusionReady) {
+            std::cerr << "Reduced resolution AO and shadows disabled\n";
+        }
+        deferredReady = lightingBuild.ready && deferred.create(cullProgram, lightingBuild.program, occlusionReady ? &occlusion : nullptr);
+        if (!deferredReady) {
+            std::cerr << "Deferred shading disabled\n";
+        }
+    };
 
-    while (!glfwWindowShouldClose(window))
-    {
-        double currentTime = glfwGetTime();
-        float deltaTime = static_cast<float>(currentTime - previousTime);
-        previousTime = currentTime;
+    TiledRaymarch tiled;
+    bool tiledReady = false;
+    auto createTiled = [&]() {
+        tiledReady = tiledBuild.ready && finishProgramBuild(tiledPresentBuild) &&
+                     tiled.create(tiledBuild.program, tiledPresentBuild.program);
+        if (!tiledReady) {
+            std::cerr << "Tiled compute path disabled\n";
+        }
+    };
 
-        float moveSpeed = 5.0f;
-        float movement = moveSpeed * deltaTime;
+    SdfQueries sdfQueries;
+    bool queriesReady = false;
+    unsigned cameraTicket = 0, pickTicket = 0; // batches in flight, 0 when none
+    unsigned picksHandled = 0;
+    auto createQueries = [&]() {
+        queriesReady = queryBuild.ready && sdfQueries.create(queryBuild.program);
+        if (!queriesReady) {
+            std::cerr << "Camera collision and picking disabled\n";
+        }
+    };
 
+    if (benchmark) {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, testTexture);
 
-        glfwGetFramebufferSize(window, &width, &height);
-        glViewport(0, 0, width, height);
-        glClear(GL_COLOR_BUFFER_BIT);
+        if (depthPrepass) {
+            finishProgramBuild(prepassBuild);
+            createPrepass();
+        }
+        if (deferredShading) {
+            finishProgramBuild(lightingBuild);
+            if (occlusionPasses) finishProgramBuild(occlusionBuild);
+            createDeferred();
+        }
+        if (tiledAvailable) {
+            finishProgramBuild(tiledBuild);
+            createTiled();
+        }
 
-        // Check key states and update camera position
-        if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS)
-        {
-            movement *= 2.0f;
+        // Scene animation follows the camera path time
+        benchmarkOptions.frameState = &frameStateStream;
+        benchmarkOptions.prepareFrame = [&](const BenchmarkFrame& frame, FrameState& state) {
+            updateSceneAnimation(animations, frame.time, primitives);
+            updateSceneLights(lightOrbits, frame.time, lights);
+            if (prepassReady) {
+                prepass.render(benchmarkOptions.width, benchmarkOptions.height, frame.camPos, frame.camTarget, frame.scroll);
+            }
+            bool deferredFrame = deferredReady && !tiledReady && DeferredShading::supports(frame.renderMode);
+            state.prepassTile = prepassReady ? PREPASS_TILE : 0;
+            state.deferred = deferredFrame ? deferred.sceneMode() : 0;
+            state.relaxedMarch = relaxedMarch;
+            if (deferredFrame) {
+                deferred.begin(benchmarkOptions.width, benchmarkOptions.height);
+            }
+        };
+        if (tiledReady) {
+            benchmarkOptions.drawScene = [&](const BenchmarkFrame& frame) {
+                tiled.render({benchmarkOptions.width, benchmarkOptions.height, frame.time, frame.scroll, frame.camPos, frame.camTarget,
+                              frame.flashlight, frame.renderMode, glm::vec2(0.0f), prepassReady ? PREPASS_TILE : 0, (int)lights.size(),
+                              relaxedMarch});
+            };
         }
-        camOriented = glfwGetKey(window, GLFW_KEY_LEFT_ALT) == GLFW_PRESS;
-        if (camOriented)
-        {
-            movement /= 5.0f;
+        benchmarkOptions.finishFrame = [&](const BenchmarkFrame& frame) {
+            if (deferredReady && !tiledReady && DeferredShading::supports(frame.renderMode)) {
+                deferred.shade(frame.camPos, frame.camTarget, frame.flashlight, (int)lights.size());
+            }
+            primitivesStream.fence();
+            lightsStream.fence();
+        };
+        textureStreamer.finish();
+        bool ok = exportFrames ? runExport(program, benchmarkOptions, exportOptions)
+                               : runBenchmark(program, benchmarkOptions);
+
+        prepass.destroy();
+        deferred.destroy();
+        occlusion.destroy();
+        tiled.destroy();
+        marchStats.destroy();
+        textureStreamer.destroy();
+        glDeleteTextures(1, &testTexture);
+        primitivesStream.destroy();
+        lightsStream.destroy();
+        frameStateStream.destroy();
+        destroySceneBake(sceneBake);
+        glDeleteBuffers(1, &vertex_buffer);
+        glDeleteVertexArrays(1, &vertex_array);
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    // Renders the scene below the window resolution when it doesn't fit the frame budget
+    DynamicResolution dynamicResolution;
+    if (frameBudgetMs > 0.0f) {
+        startShaderProgram("../../shaders/vertex.glsl", "../../shaders/upscale.glsl", shaderCacheDir, upscaleBuild);
+        if (!finishProgramBuild(upscaleBuild) || !dynamicResolution.create(upscaleBuild.program, frameBudgetMs)) {
+            std::cerr << "Dynamic resolution disabled\n";
+            frameBudgetMs = 0.0f;
         }
+    }
+
+    // Render mode 5 accumulates one ray per pixel over several frames instead of supersampling
+    TemporalAA temporalAA;
+    startShaderProgram("../../shaders/vertex.glsl", "../../shaders/taa.glsl", shaderCacheDir, taaBuild);
+    bool temporalAvailable = finishProgramBuild(taaBuild) && temporalAA.create(taaBuild.program);
+    if (!temporalAvailable) {
+        std::cerr << "Temporal antialiasing disabled\n";
+    }
+
+    // Performance overlay, toggled with O
+    ProgramBuild overlayBuild;
+    TextOverlay overlay;
+    PassTimers passTimers;
+    passTimers.create();
+    if (fontPath.empty()) {
+        fontPath = defaultFontPath();
+    }
+    startShaderProgram("../../shaders/overlay_vertex.glsl", "../../shaders/overlay.glsl", shaderCacheDir, overlayBuild);
+    bool overlayAvailable = !fontPath.empty() && finishProgramBuild(overlayBuild) && overlay.create(overlayBuild.program, fontPath, 16);
+    if (!overlayAvailable) {
+        std::cerr << "Performance overlay disabled" << (fontPath.empty() ? ", no font found (see --font)" : "") << "\n";
+    }
+    std::vector<std::string> overlayLines;
+    double overlayUpdateTime = 0.0, cpuFrameMsSum = 0.0, cpuWorkMsSum = 0.0;
+    int overlayFrames = 0;
+
+    previousTime = glfwGetTime();
+
+    // The previous frame, to tell whether the deferred AO and shadows can be averaged
+    bool lastFrameDeferred = false, lastFlashlight = false;
+    glm::vec3 lastCamPos(0.0f), lastCamTarget(0.0f);
+    double lastScroll = 0.0;
+    int lastRenderWidth = 0, lastRenderHeight = 0;
+
+    // The cursor is disabled, so GLFW reports it unbounded and it never has to be recentred
+    glfwGetCursorPos(window, &prevMouseX, &prevMouseY);
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+    sampleInput(window, 0.0f);
 
-        if (camOriented)
+    FramePacer pacer;
+    pacer.create(framesInFlight);
+
+    auto reportShaderBuild = [&]() {
+        printf("Scene shaders %s in %.2f s\n", sceneBuild.fromCache ? "loaded from cache" : "compiled", glfwGetTime() - buildStart);
+    };
+    if (sceneBuild.ready) {
+        reportShaderBuild();
+    }
+
+    // The frames are rendered on a thread of their own, so the input doesn't wait for them
+    std::atomic<bool> rendering(true);
+    glfwMakeContextCurrent(nullptr);
+    std::thread renderThread([&]() {
+        glfwMakeContextCurrent(window);
+        while (!glfwWindowShouldClose(window))
         {
-            if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-            {
-                camPosX += movement * forward.x;
-                camPosY += movement * forward.y;
-                camPosZ += movement * forward.z;
-            }
-            if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-            {
-                camPosX -= movement * forward.x;
-                camPosY -= movement * forward.y;
-                camPosZ -= movement * forward.z;
+            pacer.beginFrame();
+
+            // Swap in the scene program once the background compile is done
+            if (program != sceneBuild.program && pollProgramBuild(sceneBuild)) {
+                if (sceneBuild.failed) {
+                    break;
+                }
+                reportShaderBuild();
+                program = sceneBuild.program;
+                glUseProgram(program);
+                setLightCount();
             }
-            if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-            {
-                camPosX -= movement * right.x;
-                camPosY -= movement * right.y;
-                camPosZ -= movement * right.z;
+
+            if (depthPrepass && !prepassReady && !prepassBuild.failed && pollProgramBuild(prepassBuild)) {
+                createPrepass();
             }
-            if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-            {
-                camPosX += movement * right.x;
-                camPosY += movement * right.y;
-                camPosZ += movement * right.z;
+            if (deferredShading && !deferredReady && !lightingBuild.failed && pollProgramBuild(lightingBuild) &&
+                (!occlusionPasses || pollProgramBuild(occlusionBuild))) {
+                createDeferred();
             }
-        }
-        else {
-            if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-            {
-                camPosX += movement * forwardXZ.x;
-                camPosZ += movement * forwardXZ.z;
+            if (tiledAvailable && !tiledReady && !tiledBuild.failed && pollProgramBuild(tiledBuild)) {
+                createTiled();
             }
-            if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-            {
-                camPosX -= movement * forwardXZ.x;
-                camPosZ -= movement * forwardXZ.z;
+            if (queriesAvailable && !queriesReady && !queryBuild.failed && pollProgramBuild(queryBuild)) {
+                createQueries();
             }
-            if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-            {
-                camPosX -= movement * right.x;
-                camPosZ -= movement * right.z;
+
+            textureStreamer.update();
+
+            double currentTime = glfwGetTime();
+            float deltaTime = static_cast<float>(currentTime - previousTime);
+            previousTime = currentTime;
+            passTimers.beginFrame();
+
+            // Collision and picking answers come in a frame or two after they were asked
+            if (cameraTicket) {
+                if (const SdfResult* results = sdfQueries.results(cameraTicket)) {
+                    cameraProbes.publish(results[0]);
+                    cameraTicket = 0;
+                }
             }
-            if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-            {
-                camPosX += movement * right.x;
-                camPosZ += movement * right.z;
+            if (pickTicket) {
+                if (const SdfResult* results = sdfQueries.results(pickTicket)) {
+                    const SdfResult& hit = results[0];
+                    if (hit.position.w < 0.0f) {
+                        printf("Picked nothing\n");
+                    } else {
+                        printf("Picked material %d at (%.2f, %.2f, %.2f), %.2f away\n", (int)hit.normal.w,
+                               hit.position.x, hit.position.y, hit.position.z, hit.position.w);
+                    }
+                    pickTicket = 0;
+                }
             }
-        }
 
-        if (glfwGetKey(window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS)
-        {
-            camPosY -= movement;
-        }
-        if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS)
-        {
-            camPosY += movement;
-        }
+            updateSceneAnimation(animations, (float)currentTime, primitives);
+            updateSceneLights(lightOrbits, (float)currentTime, lights);
 
-        // vecList[0] = glm::vec3(vecList[0].x, sin(currentTime), vecList[0].z); // Update the third vector in the SSBO
-        // vecList[1].y += sin(currentTime); // Update the fourth vector in the SSBO
-        // updateSSBO(vecList); // Update the SSBO with the new vector list
+            // The input is latched as late as possible, right before the draws that show it
+            InputSnapshot input;
+            inputSnapshots.read(input);
+            int width = input.width, height = input.height;
+            glm::vec3 camPos = input.camPos, camTarget = input.camTarget;
 
-        // Set uniform values (placeholders)
-        glUniform2f(resolutionLoc, (float)width, (float)height);
-        glUniform1f(timeLoc, currentTime);
-        glUniform1f(scrollLoc, scrollOffset);
-        glUniform3f(camPosLoc, camPosX, camPosY, camPosZ);
-        glUniform3f(camTargetLoc, camTarget.x, camTarget.y, camTarget.z);
-        glUniform1i(flashlightLoc, flashlightOn);
-        glUniform1i(renderModeLoc, renderMode);
+            // Asked after the animation so they see this frame's primitives
+            if (queriesReady && !cameraTicket) {
+                SdfQuery probe = pointQuery(camPos);
+                cameraTicket = sdfQueries.submit(&probe, 1);
+            }
+            if (queriesReady && input.picks != picksHandled && !pickTicket) {
+                SdfQuery ray = rayQuery(camPos, input.forward, 100.0f);
+                pickTicket = sdfQueries.submit(&ray, 1);
+                picksHandled = input.picks;
+            }
 
-        // bind textures on corresponding texture units
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, testTexture);
+            // The history is only valid for consecutive temporal frames of the scene program
+            bool temporal = temporalAvailable && input.renderMode == TAA_RENDER_MODE && program == sceneBuild.program;
+            if (!temporal) {
+                temporalAA.reset();
+            }
+
+            int renderWidth = width, renderHeight = height;
+            if (frameBudgetMs > 0.0f) {
+                dynamicResolution.begin(width, height, renderWidth, renderHeight);
+            } else if (!temporal) {
+                glViewport(0, 0, width, height);
+                glClear(GL_COLOR_BUFFER_BIT);
+            }
+            glm::vec2 jitter(0.0f);
+            if (temporal) {
+                temporalAA.begin(renderWidth, renderHeight);
+                jitter = temporalAA.jitter();
+            }
+            bool prepassActive = prepassReady && program == sceneBuild.program;
+            if (prepassActive) {
+                passTimers.begin(TIMED_PREPASS);
+                prepass.render(renderWidth, renderHeight, camPos, camTarget, input.scroll);
+                passTimers.end(TIMED_PREPASS);
+            }
+            glUseProgram(program); // the prepass, present(), resolve() and shade() leave their programs bound
+
+            bool tiledActive = input.tiledCompute && tiledReady && program == sceneBuild.program;
+            bool deferredActive = deferredReady && !tiledActive && program == sceneBuild.program && DeferredShading::supports(input.renderMode);
+
+            // The whole frame's state is one write into the mapped buffer
+            FrameState state;
+            state.resolution = glm::vec2((float)renderWidth, (float)renderHeight);
+            state.jitter = jitter;
+            state.camPos = camPos;
+            state.time = (float)currentTime;
+            state.camTarget = camTarget;
+            state.scroll = input.scroll;
+            state.flashlight = input.flashlight;
+            state.renderMode = input.renderMode;
+            state.prepassTile = prepassActive ? PREPASS_TILE : 0;
+            state.deferred = deferredActive ? deferred.sceneMode() : 0;
+            state.relaxedMarch = input.relaxedMarch;
+            frameStateStream.update(0, &state, sizeof(state));
+            frameStateStream.upload();
+
+            // AO and shadows can be averaged over frames while the G-buffer and the
+            // lights stay put (the temporal mode jitters the G-buffer every frame)
+            bool occlusionUnchanged = deferredActive && lastFrameDeferred && !temporal && animations.empty() && lightOrbits.empty() &&
+                                      camPos == lastCamPos && camTarget == lastCamTarget && input.scroll == lastScroll &&
+                                      input.flashlight == lastFlashlight && renderWidth == lastRenderWidth && renderHeight == lastRenderHeight;
+            lastFrameDeferred = deferredActive;
+            lastCamPos = camPos;
+            lastCamTarget = camTarget;
+            lastScroll = input.scroll;
+            lastFlashlight = input.flashlight;
+            lastRenderWidth = renderWidth;
+            lastRenderHeight = renderHeight;
+
+            // bind textures on corresponding texture units
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, testTexture);
+
+            if (deferredActive) {
+                deferred.begin(renderWidth, renderHeight);
+            }
+            bool heatmap = isHeatmapMode(input.renderMode) && program == sceneBuild.program;
+            if (heatmap) {
+                marchStats.begin(renderWidth, renderHeight);
+            }
+            passTimers.begin(TIMED_SCENE);
+            if (tiledActive) {
+                tiled.render({renderWidth, renderHeight, (float)currentTime, input.scroll, camPos, camTarget,
+                              input.flashlight, input.renderMode, jitter, prepassActive ? PREPASS_TILE : 0, (int)lights.size(),
+                              input.relaxedMarch});
+            } else {
+                glDrawArrays(GL_TRIANGLES, 0, 6);
+            }
+            passTimers.end(TIMED_SCENE);
+            if (heatmap) {
+                marchStats.end();
+            }
+            if (deferredActive) {
+                passTimers.begin(TIMED_SHADING);
+                deferred.shade(camPos, camTarget, input.flashlight, (int)lights.size(), occlusionUnchanged);
+                passTimers.end(TIMED_SHADING);
+            }
+            primitivesStream.fence();
+            lightsStream.fence();
+            frameStateStream.fence();
+
+            GLuint resolved = 0;
+            if (temporal) {
+                passTimers.begin(TIMED_TAA);
+                resolved = temporalAA.resolve({camPos, camTarget, input.scroll});
+                passTimers.end(TIMED_TAA);
+            }
+            if (frameBudgetMs > 0.0f || temporal) {
+                passTimers.begin(TIMED_PRESENT);
+                if (frameBudgetMs > 0.0f) {
+                    dynamicResolution.present(resolved);
+                } else {
+                    temporalAA.blitToWindow();
+                }
+                passTimers.end(TIMED_PRESENT);
+            }
 
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+            // The text is refreshed a few times a second so it can be read; CPU
+            // times are averaged over that, GPU times are the latest measured
+            if (overlayAvailable && input.overlay && overlayFrames > 0 && currentTime - overlayUpdateTime >= 0.25) {
+                char line[160];
+                overlayLines.clear();
+                snprintf(line, sizeof(line), "%dx%d window, %dx%d rendered", width, height, renderWidth, renderHeight);
+                overlayLines.push_back(line);
+                snprintf(line, sizeof(line), "Mode %d %s, %s%s", input.renderMode, renderModeName(input.renderMode),
+                         tiledActive ? "tiled compute" : deferredActive ? "deferred" : "forward", input.relaxedMarch ? ", relaxed" : "");
+                overlayLines.push_back(line);
+                snprintf(line, sizeof(line), "CPU %.2f ms/frame, %.2f ms work", cpuFrameMsSum / overlayFrames, cpuWorkMsSum / overlayFrames);
+                overlayLines.push_back(line);
+                FrameLatency latency = pacer.collect();
+                if (latency.frames > 0) {
+                    snprintf(line, sizeof(line), "Input to GPU %.1f ms, max %.1f, %.2f ms waiting", latency.latencyMs,
+                             latency.maxLatencyMs, latency.waitMs);
+                    overlayLines.push_back(line);
+                }
+                for (int pass = 0; pass < TIMED_PASS_COUNT; pass++) {
+                    double ms = passTimers.ms((TimedPass)pass);
+                    if (ms < 0.0) continue;
+                    snprintf(line, sizeof(line), "GPU %-8s %6.2f ms", PassTimers::name((TimedPass)pass), ms);
+                    overlayLines.push_back(line);
+                }
+                const MarchTotals& totals = marchStats.totals();
+                if (isHeatmapMode(input.renderMode) && totals.pixels > 0) {
+                    snprintf(line, sizeof(line), "Per pixel %.1f steps, %.1f calcSDF calls", (double)totals.steps / totals.pixels,
+                             (double)totals.sdfCalls / totals.pixels);
+                    overlayLines.push_back(line);
+                    snprintf(line, sizeof(line), "Out of steps %.2f%% of pixels", 100.0 * totals.exhausted / totals.pixels);
+                    overlayLines.push_back(line);
+                }
+                overlayUpdateTime = currentTime;
+                cpuFrameMsSum = cpuWorkMsSum = 0.0;
+                overlayFrames = 0;
+            }
+            if (overlayAvailable && input.overlay) {
+                passTimers.begin(TIMED_OVERLAY);
+                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                overlay.draw(overlayLines, width, height);
+                passTimers.end(TIMED_OVERLAY);
+            }
+            passTimers.endFrame();
+            cpuFrameMsSum += deltaTime * 1000.0;
+            cpuWorkMsSum += (glfwGetTime() - currentTime) * 1000.0;
+            overlayFrames++;
 
-        // Center the mouse cursor
-        glfwSetCursorPos(window, width / 2, height / 2);
-        prevMouseX = width / 2;
-        prevMouseY = height / 2;
+            glfwSwapBuffers(window);
+            pacer.endFrame(input.time);
+        }
+        glfwMakeContextCurrent(nullptr);
+        rendering = false;
+        glfwPostEmptyEvent();
+    });
+
+    // GLFW only lets the main thread poll the window, this one samples the
+    // input whenever an event comes in and at INPUT_SAMPLE_HZ in between
+    double lastSample = glfwGetTime();
+    while (rendering) {
+        glfwWaitEventsTimeout(1.0 / INPUT_SAMPLE_HZ);
+        double now = glfwGetTime();
+        sampleInput(window, (float)(now - lastSample));
+        lastSample = now;
+    }
+    renderThread.join();
+    glfwMakeContextCurrent(window);
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+    FrameLatency latency = pacer.overall();
+    if (latency.frames > 0) {
+        printf("Input to GPU latency %.1f ms on average, %.1f ms at most\n", latency.latencyMs, latency.maxLatencyMs);
     }
 
+    primitivesStream.destroy();
+    lightsStream.destroy();
+    frameStateStream.destroy();
+    destroySceneBake(sceneBake);
+    dynamicResolution.destroy();
+    temporalAA.destroy();
+    prepass.destroy();
+    deferred.destroy();
+    occlusion.destroy();
+    tiled.destroy();
+    sdfQueries.destroy();
+    marchStats.destroy();
+    textureStreamer.destroy();
+    glDeleteTextures(1, &testTexture);
+    overlay.destroy();
+    passTimers.destroy();
+    pacer.destroy();
     glDeleteBuffers(1, &vertex_buffer);
     glDeleteVertexArrays(1, &vertex_array);
+    glDeleteProgram(loadingBuild.program);
+    glDeleteProgram(sceneBuild.program);
+    glDeleteProgram(upscaleBuild.program);
+    glDeleteProgram(taaBuild.program);
+    glDeleteProgram(prepassBuild.program);
+    glDeleteProgram(lightingBuild.program);
+    glDeleteProgram(occlusionBuild.program);
+    glDeleteProgram(tiledBuild.program);
+    glDeleteProgram(tiledPresentBuild.program);
+    glDeleteProgram(queryBuild.program);
+    glDeleteProgram(overlayBuild.program);
+    glDeleteProgram(cullProgram);
 
     glfwDestroyWindow(window);
     glfwTerminate();
-    exit(EXIT_SUCCESS);
+    exit(sceneBuild.failed ? EXIT_FAILURE : EXIT_SUCCESS);
 }
\ No newline at end of file
@@ -0,0 +1,82 @@
+#include "march_stats.h"
+
+#include <algorithm>
+
+// Step digits, call digits, then the exhausted pixel count, as laid out in heatmap.glsl
+#define MARCH_STATS_COUNTERS (MARCH_STATS_STEP_DIGITS + MARCH_STATS_CALL_DIGITS + 1)
+
+bool MarchStats::create() {
+    destroy();
+    static const uint32_t zero[MARCH_STATS_COUNTERS] = {};
+    glGenBuffers(MARCH_STATS_FRAMES, buffers);
+    for (int i = 0; i < MARCH_STATS_FRAMES; i++) {
+        glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, buffers[i]);
+        glBufferData(GL_ATOMIC_COUNTER_BUFFER, sizeof(zero), zero, GL_DYNAMIC_READ);
+    }
+    glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, 0);
+    glBindBufferBase(GL_ATOMIC_COUNTER_BUFFER, MARCH_STATS_BINDING, buffers[0]);
+    next = 0;
+    lastTotals = MarchTotals();
+    return true;
+}
+
+void MarchStats::destroy() {
+    if (!buffers[0]) return;
+
+    for (GLsync& fence : fences) {
+        if (fence) glDeleteSync(fence);
+        fence = nullptr;
+    }
+    glDeleteBuffers(MARCH_STATS_FRAMES, buffers);
+    std::fill(buffers, buffers + MARCH_STATS_FRAMES, 0);
+}
+
+void MarchStats::readBack() {
+    // Oldest first; stop at the first buffer the GPU hasn't finished
+    for (int i = 0; i < MARCH_STATS_FRAMES; i++) {
+        int slot = (next + i) % MARCH_STATS_FRAMES;
+        if (!fences[slot]) continue;
+        if (glClientWaitSync(fences[slot], 0, 0) == GL_TIMEOUT_EXPIRED) break;
+        glDeleteSync(fences[slot]);
+        fences[slot] = nullptr;
+
+        uint32_t counters[MARCH_STATS_COUNTERS] = {};
+        glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, buffers[slot]);
+        glGetBufferSubData(GL_ATOMIC_COUNTER_BUFFER, 0, sizeof(counters), counters);
+        glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, 0);
+
+        MarchTotals totals;
+        totals.pixels = framePixels[slot];
+        for (int digit = MARCH_STATS_STEP_DIGITS - 1; digit >= 0; digit--) {
+            totals.steps = totals.steps * 16 + counters[digit];
+        }
+        for (int digit = MARCH_STATS_CALL_DIGITS - 1; digit >= 0; digit--) {
+            totals.sdfCalls = totals.sdfCalls * 16 + counters[MARCH_STATS_STEP_DIGITS + digit];
+        }
+        totals.exhausted = counters[MARCH_STATS_COUNTERS - 1];
+        lastTotals = totals;
+    }
+}
+
+void MarchStats::begin(int width, int height) {
+    readBack();
+    // Only after MARCH_STATS_FRAMES heatmap frames the GPU hasn't caught up with
+    if (fences[next]) {
+        glClientWaitSync(fences[next], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        readBack();
+    }
+
+    static const uint32_t zero[MARCH_STATS_COUNTERS] = {};
+    glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, buffers[next]);
+    glBufferSubData(GL_ATOMIC_COUNTER_BUFFER, 0, sizeof(zero), zero);
+    glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, 0);
+    glBindBufferBase(GL_ATOMIC_COUNTER_BUFFER, MARCH_STATS_BINDING, buffers[next]);
+    framePixels[next] = (uint64_t)std::max(width, 0) * (uint64_t)std::max(height, 0);
+}
+
+void MarchStats::end() {
+    // Counter writes aren't coherent with glGetBufferSubData otherwise
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    fences[next] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    next = (next + 1) % MARCH_STATS_FRAMES;
+}
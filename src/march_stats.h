@@ -0,0 +1,61 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstdint>
+
+// Render modes that show per pixel march statistics, see shaders/heatmap.glsl
+#define HEATMAP_STEPS_MODE 6
+#define HEATMAP_CALLS_MODE 7
+// Atomic counter buffer binding point of the statistics
+#define MARCH_STATS_BINDING 0
+// Base 16 digit counters per total, must match heatmap.glsl
+#define MARCH_STATS_STEP_DIGITS 3
+#define MARCH_STATS_CALL_DIGITS 4
+// Counter buffers in flight; one is read once the GPU has finished with it
+#define MARCH_STATS_FRAMES 3
+
+struct MarchTotals {
+    uint64_t pixels = 0;
+    uint64_t steps = 0;      // rMarch iterations of the primary rays
+    uint64_t sdfCalls = 0;   // calcSDF calls, normals, shadows and AO included
+    uint64_t exhausted = 0;  // pixels whose ray used up MAX_STEPS
+};
+
+static inline bool isHeatmapMode(int renderMode) {
+    return renderMode == HEATMAP_STEPS_MODE || renderMode == HEATMAP_CALLS_MODE;
+}
+
+// Frame totals of the heatmap render modes. The scene shaders add every
+// pixel to an atomic counter buffer; begin() clears one of
+// MARCH_STATS_FRAMES buffers and binds it, end() fences it, and it is read
+// back once the fence has signalled, so reading never stalls the frame.
+//
+// A buffer stays bound between frames, the shaders only touch it in the
+// heatmap modes but every program that includes heatmap.glsl needs one.
+class MarchStats {
+public:
+    MarchStats() = default;
+    MarchStats(const MarchStats&) = delete;
+    MarchStats& operator=(const MarchStats&) = delete;
+    ~MarchStats() { destroy(); }
+
+    bool create();
+    void destroy();
+
+    // Around the scene pass of a heatmap frame rendered at width x height
+    void begin(int width, int height);
+    void end();
+
+    // Of the latest frame read back, all zero before the first
+    const MarchTotals& totals() const { return lastTotals; }
+
+private:
+    void readBack();
+
+    GLuint buffers[MARCH_STATS_FRAMES] = {};
+    GLsync fences[MARCH_STATS_FRAMES] = {};
+    uint64_t framePixels[MARCH_STATS_FRAMES] = {};
+    int next = 0;
+    MarchTotals lastTotals;
+};
@@ -0,0 +1,174 @@
+#include "occlusion_passes.h"
+
+#include "temporal_aa.h"
+
+#include <algorithm>
+#include <iostream>
+
+bool OcclusionPasses::create(GLuint passProgram, int aoScale, int shadowScale, bool accumulateHistory) {
+    destroy();
+    program = passProgram;
+    passLoc = glGetUniformLocation(program, "u_pass");
+    scaleLoc = glGetUniformLocation(program, "u_scale");
+    sizeLoc = glGetUniformLocation(program, "u_size");
+    sampleOffsetLoc = glGetUniformLocation(program, "u_sampleOffset");
+    historyCountLoc = glGetUniformLocation(program, "u_historyCount");
+    shadowLightsLoc = glGetUniformLocation(program, "u_shadowLights");
+    camPosLoc = glGetUniformLocation(program, "u_camPos");
+    camTargetLoc = glGetUniformLocation(program, "u_camTarget");
+    flashlightLoc = glGetUniformLocation(program, "u_flashlight");
+    aoDivisor = aoScale;
+    shadowDivisor = shadowScale;
+    accumulate = accumulateHistory;
+    historyCount = 0;
+    lastShadowLights = -1;
+
+    glGenFramebuffers(2, aoFBO);
+    glGenFramebuffers(1, &shadowFBO);
+    return true;
+}
+
+void OcclusionPasses::destroy() {
+    if (!shadowFBO) return;
+
+    glDeleteFramebuffers(2, aoFBO);
+    glDeleteFramebuffers(1, &shadowFBO);
+    glDeleteTextures(2, aoTextures);
+    glDeleteTextures(2, shadowTextures);
+    std::fill(aoFBO, aoFBO + 2, 0);
+    std::fill(aoTextures, aoTextures + 2, 0);
+    std::fill(shadowTextures, shadowTextures + 2, 0);
+    shadowFBO = 0;
+    aoSize = glm::ivec2(0);
+    shadowSize = glm::ivec3(0);
+}
+
+int OcclusionPasses::shadowLights(int lightCount) const {
+    if (shadowDivisor <= 1) return 0;
+    return std::min(lightCount, OCCLUSION_MAX_LAYERS * 4 - 1);
+}
+
+bool OcclusionPasses::resizeAO(int texelsX, int texelsY) {
+    glDeleteTextures(2, aoTextures);
+    glGenTextures(2, aoTextures);
+    for (int i = 0; i < 2; i++) {
+        glBindTexture(GL_TEXTURE_2D, aoTextures[i]);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_R16F, texelsX, texelsY);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, aoFBO[i]);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, aoTextures[i], 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cerr << "AO framebuffer is incomplete\n";
+            glBindTexture(GL_TEXTURE_2D, 0);
+            return false;
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    aoSize = glm::ivec2(texelsX, texelsY);
+    return true;
+}
+
+bool OcclusionPasses::resizeShadows(int texelsX, int texelsY, int layers) {
+    glDeleteTextures(2, shadowTextures);
+    glGenTextures(2, shadowTextures);
+    for (int i = 0; i < 2; i++) {
+        glBindTexture(GL_TEXTURE_2D_ARRAY, shadowTextures[i]);
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGBA16F, texelsX, texelsY, layers);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    // Rasterizes the pass without anything attached
+    glBindFramebuffer(GL_FRAMEBUFFER, shadowFBO);
+    glFramebufferParameteri(GL_FRAMEBUFFER, GL_FRAMEBUFFER_DEFAULT_WIDTH, texelsX);
+    glFramebufferParameteri(GL_FRAMEBUFFER, GL_FRAMEBUFFER_DEFAULT_HEIGHT, texelsY);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Shadow framebuffer is incomplete\n";
+        return false;
+    }
+    shadowSize = glm::ivec3(texelsX, texelsY, layers);
+    return true;
+}
+
+void OcclusionPasses::render(int width, int height, const glm::vec3& camPos, const glm::vec3& camTarget,
+                             bool flashlight, int lightCount, bool unchanged) {
+    if (aoDivisor <= 1 && shadowDivisor <= 1) return;
+
+    GLint previousFBO, previousViewport[4];
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFBO);
+    glGetIntegerv(GL_VIEWPORT, previousViewport);
+
+    int slotLights = shadowLights(lightCount);
+    if (!accumulate || !unchanged || width != lastWidth || height != lastHeight || slotLights != lastShadowLights) {
+        historyCount = 0;
+    }
+    lastWidth = width;
+    lastHeight = height;
+    lastShadowLights = slotLights;
+    int previous = current;
+    current = 1 - current;
+    sampleIndex++;
+
+    glUseProgram(program);
+    glUniform2i(sizeLoc, width, height);
+    glUniform1i(historyCountLoc, historyCount);
+    glUniform1i(shadowLightsLoc, slotLights);
+    glUniform3fv(camPosLoc, 1, &camPos[0]);
+    glUniform3fv(camTargetLoc, 1, &camTarget[0]);
+    glUniform1i(flashlightLoc, flashlight);
+
+    auto setScale = [&](int scale) {
+        glUniform1i(scaleLoc, scale);
+        glUniform2i(sampleOffsetLoc, (int)(halton(sampleIndex, 2) * scale), (int)(halton(sampleIndex, 3) * scale));
+    };
+
+    if (aoDivisor > 1) {
+        int texelsX = (width + aoDivisor - 1) / aoDivisor;
+        int texelsY = (height + aoDivisor - 1) / aoDivisor;
+        if (texelsX > aoSize.x || texelsY > aoSize.y) {
+            resizeAO(std::max(texelsX, aoSize.x), std::max(texelsY, aoSize.y));
+            historyCount = 0;
+            glUniform1i(historyCountLoc, 0);
+        }
+        glActiveTexture(GL_TEXTURE0 + OCCLUSION_TEXTURE_UNIT + 2);
+        glBindTexture(GL_TEXTURE_2D, aoTextures[previous]);
+        glBindFramebuffer(GL_FRAMEBUFFER, aoFBO[current]);
+        glViewport(0, 0, texelsX, texelsY);
+        glUniform1i(passLoc, 0);
+        setScale(aoDivisor);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+    }
+
+    if (shadowDivisor > 1) {
+        int texelsX = (width + shadowDivisor - 1) / shadowDivisor;
+        int texelsY = (height + shadowDivisor - 1) / shadowDivisor;
+        int layers = slotLights / 4 + 1; // + 1 slot for the flashlight
+        if (texelsX > shadowSize.x || texelsY > shadowSize.y || layers > shadowSize.z) {
+            resizeShadows(std::max(texelsX, shadowSize.x), std::max(texelsY, shadowSize.y), std::max(layers, shadowSize.z));
+            historyCount = 0;
+            glUniform1i(historyCountLoc, 0);
+        }
+        glActiveTexture(GL_TEXTURE0 + OCCLUSION_TEXTURE_UNIT + 3);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, shadowTextures[previous]);
+        glBindImageTexture(OCCLUSION_IMAGE_UNIT, shadowTextures[current], 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+        glBindFramebuffer(GL_FRAMEBUFFER, shadowFBO);
+        glViewport(0, 0, texelsX, texelsY);
+        glUniform1i(passLoc, 1);
+        setScale(shadowDivisor);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFBO);
+    glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+    glActiveTexture(GL_TEXTURE0 + OCCLUSION_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, aoTextures[current]);
+    glActiveTexture(GL_TEXTURE0 + OCCLUSION_TEXTURE_UNIT + 1);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, shadowTextures[current]);
+    glActiveTexture(GL_TEXTURE0);
+
+    historyCount = std::min(historyCount + 1, OCCLUSION_MAX_HISTORY);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// First texture unit of the results: AO, then shadows. The next two hold
+// their history while the passes run. Matches occlusion_pass.glsl and
+// deferred_lighting.glsl.
+#define OCCLUSION_TEXTURE_UNIT 9
+// Image unit the shadow pass writes through
+#define OCCLUSION_IMAGE_UNIT 1
+// Layers of the shadow buffer, four lights each; lights past the last slot
+// (the flashlight takes one) are shadowed at full resolution
+#define OCCLUSION_MAX_LAYERS 8
+// Frames averaged into the history at most, after that it's a running average
+#define OCCLUSION_MAX_HISTORY 16
+
+// Reduced resolution AO and shadows for the deferred path. calcAO() and the
+// soft shadow rays are the costly part of lighting a pixel, and both change
+// slowly across a surface. shaders/occlusion_pass.glsl evaluates them at
+// 1/scale of the G-buffer resolution, AO into one texture and the shadow
+// factor of each light into a layer component of a texture array, and the
+// lighting pass upsamples them with a depth and normal aware filter.
+//
+// Each pass has its own scale (1 turns it off and leaves the work in the
+// full resolution passes). While nothing moves, successive frames evaluate
+// different pixels of each texel's block and average them, so a still image
+// converges towards full resolution quality.
+//
+// The textures only grow, like the DynamicResolution target.
+class OcclusionPasses {
+public:
+    OcclusionPasses() = default;
+    OcclusionPasses(const OcclusionPasses&) = delete;
+    OcclusionPasses& operator=(const OcclusionPasses&) = delete;
+    ~OcclusionPasses() { destroy(); }
+
+    // passProgram is the linked shaders/occlusion_pass.glsl program (not
+    // owned). Scales are 1, 2 or 4.
+    bool create(GLuint passProgram, int aoScale, int shadowScale, bool accumulate);
+    void destroy();
+
+    int aoScale() const { return aoDivisor; }
+    int shadowScale() const { return shadowDivisor; }
+    // Lights that get a slot in the shadow buffer, the first ones of the list
+    int shadowLights(int lightCount) const;
+
+    // Runs the enabled passes for a width x height G-buffer that is bound to
+    // its texture units, and binds the results to theirs. `unchanged` means
+    // the G-buffer, the lights and the scene are the same as on the previous
+    // call, so the history can be kept. Restores the framebuffer and
+    // viewport; leaves the pass program bound.
+    void render(int width, int height, const glm::vec3& camPos, const glm::vec3& camTarget,
+                bool flashlight, int lightCount, bool unchanged);
+
+private:
+    bool resizeAO(int texelsX, int texelsY);
+    bool resizeShadows(int texelsX, int texelsY, int layers);
+
+    GLuint program = 0;
+    GLint passLoc = -1, scaleLoc = -1, sizeLoc = -1, sampleOffsetLoc = -1, historyCountLoc = -1;
+    GLint shadowLightsLoc = -1, camPosLoc = -1, camTargetLoc = -1, flashlightLoc = -1;
+    int aoDivisor = 1, shadowDivisor = 1;
+    bool accumulate = true;
+
+    // Both buffers are ping-ponged: one is written while the other is the history
+    GLuint aoFBO[2] = {};
+    GLuint aoTextures[2] = {};
+    GLuint shadowFBO = 0;      // no attachments, the shadow pass writes through an image
+    GLuint shadowTextures[2] = {};
+    glm::ivec2 aoSize = glm::ivec2(0);
+    glm::ivec3 shadowSize = glm::ivec3(0); // z layers
+
+    int current = 0;
+    int historyCount = 0;
+    unsigned sampleIndex = 0;  // picks the pixel of each block evaluated while averaging
+    int lastWidth = 0, lastHeight = 0, lastShadowLights = -1;
+};
@@ -0,0 +1,82 @@
+#include "pass_timers.h"
+
+#include <algorithm>
+
+bool PassTimers::create() {
+    destroy();
+    glGenQueries(PASS_TIMER_FRAMES * TIMED_PASS_COUNT * 2, &queries[0][0][0]);
+    std::fill(&used[0][0], &used[0][0] + PASS_TIMER_FRAMES * TIMED_PASS_COUNT, false);
+    std::fill(pending, pending + PASS_TIMER_FRAMES, false);
+    std::fill(lastMs, lastMs + TIMED_PASS_COUNT, -1.0);
+    nextFrame = 0;
+    timing = false;
+    created = true;
+    return true;
+}
+
+void PassTimers::destroy() {
+    if (!created) return;
+
+    glDeleteQueries(PASS_TIMER_FRAMES * TIMED_PASS_COUNT * 2, &queries[0][0][0]);
+    created = false;
+}
+
+const char* PassTimers::name(TimedPass pass) {
+    static const char* names[TIMED_PASS_COUNT] = { "prepass", "scene", "shading", "taa", "present", "overlay" };
+    return names[pass];
+}
+
+void PassTimers::readFrames() {
+    // Oldest first; stop at the first frame the GPU hasn't finished
+    for (int i = 0; i < PASS_TIMER_FRAMES; i++) {
+        int frame = (nextFrame + i) % PASS_TIMER_FRAMES;
+        if (!pending[frame]) continue;
+
+        // The GPU runs the passes in order, so the frame is done when its last timestamp is
+        int last = -1;
+        for (int pass = 0; pass < TIMED_PASS_COUNT; pass++) {
+            if (used[frame][pass]) last = pass;
+        }
+        GLint available = GL_FALSE;
+        glGetQueryObjectiv(queries[frame][last][1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) break;
+
+        for (int pass = 0; pass < TIMED_PASS_COUNT; pass++) {
+            if (!used[frame][pass]) {
+                lastMs[pass] = -1.0;
+                continue;
+            }
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(queries[frame][pass][0], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(queries[frame][pass][1], GL_QUERY_RESULT, &end);
+            lastMs[pass] = end > begin ? (end - begin) / 1.0e6 : 0.0;
+        }
+        pending[frame] = false;
+    }
+}
+
+void PassTimers::beginFrame() {
+    readFrames();
+    timing = created && !pending[nextFrame];
+    if (timing) {
+        std::fill(used[nextFrame], used[nextFrame] + TIMED_PASS_COUNT, false);
+    }
+}
+
+void PassTimers::begin(TimedPass pass) {
+    if (!timing) return;
+    glQueryCounter(queries[nextFrame][pass][0], GL_TIMESTAMP);
+}
+
+void PassTimers::end(TimedPass pass) {
+    if (!timing) return;
+    glQueryCounter(queries[nextFrame][pass][1], GL_TIMESTAMP);
+    used[nextFrame][pass] = true;
+}
+
+void PassTimers::endFrame() {
+    if (!timing) return;
+    pending[nextFrame] = std::find(used[nextFrame], used[nextFrame] + TIMED_PASS_COUNT, true) != used[nextFrame] + TIMED_PASS_COUNT;
+    nextFrame = (nextFrame + 1) % PASS_TIMER_FRAMES;
+    timing = false;
+}
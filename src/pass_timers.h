@@ -0,0 +1,54 @@
+#pragma once
+
+#include <glad/glad.h>
+
+// Frames of timestamps in flight; a frame is read once the GPU has all of it, never waited for
+#define PASS_TIMER_FRAMES 4
+
+// The passes of an interactive frame, in the order they run
+enum TimedPass {
+    TIMED_PREPASS,  // depth prepass (depth_prepass.h)
+    TIMED_SCENE,    // scene pass: fragment.glsl on the quad, or the tiled compute path
+    TIMED_SHADING,  // deferred light culling, AO/shadow passes and lighting (deferred_shading.h)
+    TIMED_TAA,      // temporal resolve (temporal_aa.h)
+    TIMED_PRESENT,  // upscale or blit to the window
+    TIMED_OVERLAY,  // text overlay (text_overlay.h)
+    TIMED_PASS_COUNT
+};
+
+// GPU time of each pass of a frame, for the performance overlay. Each pass is
+// bracketed by two GL_TIMESTAMP queries rather than a GL_TIME_ELAPSED query,
+// since those can't nest and DynamicResolution already times the whole scene
+// with one. Like DynamicResolution the results are read a few frames late.
+class PassTimers {
+public:
+    PassTimers() = default;
+    PassTimers(const PassTimers&) = delete;
+    PassTimers& operator=(const PassTimers&) = delete;
+    ~PassTimers() { destroy(); }
+
+    bool create();
+    void destroy();
+
+    // Reads the frames the GPU has finished, then starts timing a new one
+    // unless its queries are all still in flight
+    void beginFrame();
+    void begin(TimedPass pass);
+    void end(TimedPass pass);
+    void endFrame();
+
+    // GPU time of the pass in the latest finished frame, negative if it didn't run
+    double ms(TimedPass pass) const { return lastMs[pass]; }
+    static const char* name(TimedPass pass);
+
+private:
+    void readFrames();
+
+    GLuint queries[PASS_TIMER_FRAMES][TIMED_PASS_COUNT][2] = {};
+    bool used[PASS_TIMER_FRAMES][TIMED_PASS_COUNT] = {};
+    bool pending[PASS_TIMER_FRAMES] = {};
+    int nextFrame = 0;
+    bool timing = false;
+    bool created = false;
+    double lastMs[TIMED_PASS_COUNT] = {};
+};
@@ -0,0 +1,238 @@
+#include "program_cache.h"
+
+#include "gl_ext.h"
+#include "shader_gen.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#define PROGRAM_CACHE_MAGIC 0x42504753u // "SGPB"
+
+struct ProgramCacheHeader {
+    uint32_t magic;
+    uint32_t format;  // binaryFormat from glGetProgramBinary
+    uint32_t length;
+};
+
+uint64_t hashString(const std::string& s, uint64_t hash) {
+    for (unsigned char c : s) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static std::string glString(GLenum name) {
+    const char* s = (const char*)glGetString(name);
+    return s ? s : "";
+}
+
+static std::string cacheFileName(const std::string& vertexSource, const std::string& fragmentSource) {
+    uint64_t hash = hashString(vertexSource);
+    hash = hashString(std::string(1, '\0') + fragmentSource, hash);
+    hash = hashString(std::string(1, '\0') + glString(GL_VENDOR) + glString(GL_RENDERER) + glString(GL_VERSION), hash);
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)hash);
+    return name;
+}
+
+static bool loadProgramBinary(const std::string& path, GLuint program) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) return false;
+
+    ProgramCacheHeader header;
+    if (!file.read((char*)&header, sizeof(header)) || header.magic != PROGRAM_CACHE_MAGIC) return false;
+    std::vector<char> binary(header.length);
+    if (!file.read(binary.data(), binary.size())) return false;
+
+    glProgramBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+    GLint success = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    return success == GL_TRUE;
+}
+
+static void saveProgramBinary(const std::string& path, GLuint program) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+
+    // Written under a temporary name first so a crash never leaves a truncated binary behind
+    std::string tempPath = path + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary);
+        if (!file.is_open()) {
+            std::cerr << "Failed to write shader cache: " << path << std::endl;
+            return;
+        }
+        ProgramCacheHeader header = { PROGRAM_CACHE_MAGIC, format, (uint32_t)length };
+        file.write((const char*)&header, sizeof(header));
+        file.write(binary.data(), length);
+    }
+    std::filesystem::rename(tempPath, path, error);
+    if (error) {
+        std::cerr << "Failed to write shader cache: " << path << std::endl;
+    }
+}
+
+// Creates the build's program and loads it from the cache when possible.
+// Returns true on a cache hit.
+static bool startFromCache(const std::string& vertexSource, const std::string& fragmentSource,
+                           const std::string& cacheDir, ProgramBuild& build) {
+    build.program = glCreateProgram();
+
+    GLint binaryFormats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormats);
+    if (!cacheDir.empty() && binaryFormats > 0) {
+        build.cachePath = (std::filesystem::path(cacheDir) / cacheFileName(vertexSource, fragmentSource)).string();
+        if (loadProgramBinary(build.cachePath, build.program)) {
+            build.fromCache = true;
+            build.ready = true;
+            return true;
+        }
+        // Missing, or rejected by the driver; glProgramBinary may have left the program in a failed state
+        glDeleteProgram(build.program);
+        build.program = glCreateProgram();
+    }
+    return false;
+}
+
+void startProgramBuild(const std::string& vertexSource, const std::string& fragmentSource,
+                       const std::string& cacheDir, ProgramBuild& build,
+                       const std::vector<std::string>& fragmentFiles) {
+    build = ProgramBuild();
+    build.fragmentFiles = fragmentFiles;
+    if (startFromCache(vertexSource, fragmentSource, cacheDir, build)) return;
+
+    const char* vertexCStr = vertexSource.c_str();
+    const char* fragmentCStr = fragmentSource.c_str();
+    build.vertexShader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(build.vertexShader, 1, &vertexCStr, nullptr);
+    glCompileShader(build.vertexShader);
+    build.fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(build.fragmentShader, 1, &fragmentCStr, nullptr);
+    glCompileShader(build.fragmentShader);
+
+    // No status queries here, they would wait for the compile to finish
+    glAttachShader(build.program, build.vertexShader);
+    glAttachShader(build.program, build.fragmentShader);
+    if (!build.cachePath.empty()) {
+        glProgramParameteri(build.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    glLinkProgram(build.program);
+}
+
+void startComputeProgramBuild(const std::string& source, const std::string& cacheDir, ProgramBuild& build,
+                              const std::vector<std::string>& files) {
+    build = ProgramBuild();
+    build.fragmentFiles = files;
+    // An empty vertex source keeps compute binaries apart from fragment ones
+    if (startFromCache("", source, cacheDir, build)) return;
+
+    const char* code = source.c_str();
+    build.computeShader = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(build.computeShader, 1, &code, nullptr);
+    glCompileShader(build.computeShader);
+    glAttachShader(build.program, build.computeShader);
+    if (!build.cachePath.empty()) {
+        glProgramParameteri(build.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    glLinkProgram(build.program);
+}
+
+static void printShaderLog(GLuint shader, const std::vector<std::string>& files = {}) {
+    int success;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success) {
+        char infoLog[512];
+        glGetShaderInfoLog(shader, 512, nullptr, infoLog);
+        std::string log = files.empty() ? infoLog : annotateShaderLog(infoLog, files);
+        fprintf(stderr, "ERROR::SHADER::COMPILATION_FAILED\n%s\n", log.c_str());
+    }
+}
+
+GLuint createComputeProgram(const std::string& source, const std::vector<std::string>& files) {
+    const char* code = source.c_str();
+    GLuint shader = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(shader, 1, &code, nullptr);
+    glCompileShader(shader);
+
+    int success;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success) {
+        printShaderLog(shader, files);
+        glDeleteShader(shader);
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program, shader);
+    glLinkProgram(program);
+    glDeleteShader(shader);
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        char infoLog[512];
+        glGetProgramInfoLog(program, 512, nullptr, infoLog);
+        fprintf(stderr, "ERROR::PROGRAM::LINKING_FAILED\n%s\n", infoLog);
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+bool pollProgramBuild(ProgramBuild& build) {
+    if (build.ready || build.failed) return true;
+
+    if (hasParallelShaderCompile()) {
+        GLint complete = GL_FALSE;
+        glGetProgramiv(build.program, GL_COMPLETION_STATUS_KHR, &complete);
+        if (!complete) return false;
+    }
+
+    int success;
+    glGetProgramiv(build.program, GL_LINK_STATUS, &success);
+    if (!success) {
+        if (build.computeShader) {
+            printShaderLog(build.computeShader, build.fragmentFiles);
+        } else {
+            printShaderLog(build.vertexShader);
+            printShaderLog(build.fragmentShader, build.fragmentFiles);
+        }
+        char infoLog[512];
+        glGetProgramInfoLog(build.program, 512, nullptr, infoLog);
+        fprintf(stderr, "ERROR::PROGRAM::LINKING_FAILED\n%s\n", infoLog);
+        build.failed = true;
+    } else {
+        build.ready = true;
+        if (!build.cachePath.empty()) {
+            saveProgramBinary(build.cachePath, build.program);
+        }
+    }
+
+    for (GLuint shader : { build.vertexShader, build.fragmentShader, build.computeShader }) {
+        if (!shader) continue;
+        glDetachShader(build.program, shader);
+        glDeleteShader(shader);
+    }
+    build.vertexShader = build.fragmentShader = build.computeShader = 0;
+    return true;
+}
+
+bool finishProgramBuild(ProgramBuild& build) {
+    while (!pollProgramBuild(build)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return build.ready;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A shader program that is either loaded from the on-disk binary cache or
+// compiled and linked, in the background when the driver supports
+// KHR_parallel_shader_compile.
+struct ProgramBuild {
+    GLuint program = 0;
+    GLuint vertexShader = 0;   // only set while compiling
+    GLuint fragmentShader = 0;
+    GLuint computeShader = 0;
+    std::string cachePath;     // binary written here once linked, empty when caching is off
+    std::vector<std::string> fragmentFiles; // fragment or compute shader source names for compiler messages, see buildShaderSource
+    bool fromCache = false;
+    bool ready = false;        // linked successfully, the program can be used
+    bool failed = false;
+};
+
+// Starts building a program from preprocessed sources. The cache key hashes
+// both sources together with the GL vendor, renderer and version strings, so
+// a shader edit or driver update never picks up a stale binary. A cache hit
+// is ready right away. Pass an empty cacheDir to disable the cache.
+// fragmentFiles, when given, turns "<string>:<line>" in the fragment shader's
+// compile log back into file names.
+void startProgramBuild(const std::string& vertexSource, const std::string& fragmentSource,
+                       const std::string& cacheDir, ProgramBuild& build,
+                       const std::vector<std::string>& fragmentFiles = {});
+
+// The same for a compute program. `files` names the compute shader's source
+// strings like fragmentFiles does.
+void startComputeProgramBuild(const std::string& source, const std::string& cacheDir, ProgramBuild& build,
+                              const std::vector<std::string>& files = {});
+
+// Returns true once the build has finished, successfully or not. Never blocks
+// with KHR_parallel_shader_compile; without it the first call waits for the
+// driver. A successful build is stored in the cache.
+bool pollProgramBuild(ProgramBuild& build);
+
+// Waits for the build to finish and returns build.ready
+bool finishProgramBuild(ProgramBuild& build);
+
+// Compiles and links a small compute shader right away, without the cache. Returns
+// 0 after printing the log on failure. `files` is as for startProgramBuild.
+GLuint createComputeProgram(const std::string& source, const std::vector<std::string>& files = {});
+
+// 64-bit FNV-1a, used for cache file names
+uint64_t hashString(const std::string& s, uint64_t hash = 14695981039346656037ull);
@@ -0,0 +1,335 @@
+#include "scene.h"
+
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+// Cells never get smaller than this: the march treats distances below
+// MIN_DIST_TO_SDF * LOD as hits (up to ~0.6 at MAX_DIST_TO_TRAVEL), so the
+// grid bound (>= margin = half a cell) must stay well above that.
+#define GRID_MIN_CELL_SIZE 2.0f
+#define GRID_MAX_DIM 64
+
+ScenePrimitive makePrimitive(PrimitiveType type, glm::vec3 position, glm::vec4 params, int materialID) {
+    ScenePrimitive p;
+    p.positionScale = glm::vec4(position, 1.0f);
+    p.rotation = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    p.params = params;
+    p.info = glm::ivec4(type, materialID, 0, 0);
+    return p;
+}
+
+SceneLight makeLight(glm::vec3 position, glm::vec3 target, glm::vec3 color, float focusDeg, float spreadDeg,
+                     float size, float range) {
+    SceneLight l;
+    l.positionSize = glm::vec4(position, size);
+    l.colorRange = glm::vec4(color, range);
+    l.target = glm::vec4(target, 0.0f);
+    l.cone = glm::vec4(cosf(glm::radians(focusDeg)), cosf(glm::radians(spreadDeg)), 0.0f, 0.0f);
+    return l;
+}
+
+void defaultSceneLights(std::vector<SceneLight>& lights, std::vector<LightOrbit>& orbits) {
+    lights.clear();
+    orbits.clear();
+    lights.push_back(makeLight(glm::vec3(5.0f, 4.0f, 0.0f), glm::vec3(0.5f, 0.0f, 0.0f), glm::vec3(0.6157f, 0.0f, 0.0f), 15.0f, 30.0f, 0.01f));
+    orbits.push_back({ 0, glm::vec3(0.0f, 4.0f, 0.0f), 5.0f, -1.0f });
+    lights.push_back(makeLight(glm::vec3(100.0f, 50.0f, 20.0f), glm::vec3(-15.0f, 20.0f, -25.0f), glm::vec3(1.0f), 10.0f, 20.0f, 0.01f));
+}
+
+static bool parseType(const std::string& name, PrimitiveType& type) {
+    static const std::map<std::string, PrimitiveType> types = {
+        { "plane", PRIM_PLANE }, { "box", PRIM_BOX }, { "sphere", PRIM_SPHERE }, { "blob", PRIM_BLOB },
+        { "torus", PRIM_TORUS }, { "cylinder", PRIM_CYLINDER }, { "menger", PRIM_MENGER }, { "mandelbulb", PRIM_MANDELBULB },
+    };
+    auto it = types.find(name);
+    if (it == types.end()) return false;
+    type = it->second;
+    return true;
+}
+
+bool loadScene(const std::string& path, std::vector<ScenePrimitive>& primitives, std::vector<SceneAnimation>* animations,
+               std::vector<SceneLight>* lights, std::vector<LightOrbit>* orbits) {
+    std::vector<SceneLight> sceneLights;
+    std::vector<LightOrbit> lightOrbits;
+
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open scene file: " << path << std::endl;
+        return false;
+    }
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        size_t comment = line.find('#');
+        if (comment != std::string::npos) line.erase(comment);
+
+        std::istringstream in(line);
+        std::string typeName;
+        if (!(in >> typeName)) continue;
+
+        PrimitiveType type = PRIM_PLANE;
+        bool isLight = typeName == "light";
+        if (!isLight && !parseType(typeName, type)) {
+            std::cerr << path << ":" << lineNumber << ": unknown primitive type '" << typeName << "'\n";
+            return false;
+        }
+
+        // keyword followed by as many numbers as it takes
+        std::map<std::string, std::vector<float>> values;
+        std::string token, keyword;
+        while (in >> token) {
+            char* end;
+            float v = strtof(token.c_str(), &end);
+            if (*end == '\0' && !keyword.empty()) {
+                values[keyword].push_back(v);
+            } else {
+                keyword = token;
+                values[keyword];
+            }
+        }
+        auto get = [&](const char* key, size_t index, float fallback) {
+            auto it = values.find(key);
+            if (it == values.end() || it->second.empty()) return fallback;
+            // a single number stands for all components (e.g. "size 0.5")
+            return index < it->second.size() ? it->second[index] : it->second.back();
+        };
+
+        glm::vec3 position(get("position", 0, 0.0f), get("position", 1, 0.0f), get("position", 2, 0.0f));
+        if (isLight) {
+            if (sceneLights.size() >= MAX_SCENE_LIGHTS) {
+                std::cerr << path << ":" << lineNumber << ": more than " << MAX_SCENE_LIGHTS << " lights\n";
+                return false;
+            }
+            glm::vec3 target(get("target", 0, 0.0f), get("target", 1, 0.0f), get("target", 2, 0.0f));
+            glm::vec3 color(get("color", 0, 1.0f), get("color", 1, 1.0f), get("color", 2, 1.0f));
+            float focus = get("focus", 0, 15.0f);
+            float spread = std::max(get("spread", 0, 2.0f * focus), focus);
+            if (values.count("orbit")) {
+                // the position is the centre of the circle, the light starts at angle 0
+                float radius = std::abs(get("orbit", 0, 1.0f));
+                float speed = values["orbit"].size() > 1 ? values["orbit"][1] : 1.0f;
+                lightOrbits.push_back({ (uint32_t)sceneLights.size(), position, radius, speed });
+                position.x += radius;
+            }
+            sceneLights.push_back(makeLight(position, target, color, focus, spread,
+                                            get("size", 0, 0.01f), std::max(get("range", 0, 0.0f), 0.0f)));
+            continue;
+        }
+
+        glm::vec4 params(0.0f);
+        switch (type) {
+            case PRIM_PLANE:
+                params = glm::vec4(glm::normalize(glm::vec3(get("normal", 0, 0.0f), get("normal", 1, 1.0f), get("normal", 2, 0.0f))), get("offset", 0, 0.0f));
+                break;
+            case PRIM_BOX:
+                params = glm::vec4(get("size", 0, 0.5f), get("size", 1, 0.5f), get("size", 2, 0.5f), 0.0f);
+                break;
+            case PRIM_SPHERE:
+                params.x = get("radius", 0, 1.0f);
+                break;
+            case PRIM_TORUS:
+                params.x = get("radii", 0, 0.25f);
+                params.y = get("radii", 1, 1.0f);
+                break;
+            case PRIM_CYLINDER:
+                params.x = get("radius", 0, 0.5f);
+                params.y = get("height", 0, 1.0f);
+                break;
+            case PRIM_MENGER:
+                params.x = get("size", 0, 1.0f);
+                break;
+            default:
+                break;
+        }
+
+        ScenePrimitive p = makePrimitive(type, position, params, (int)get("material", 0, 0.0f));
+        p.positionScale.w = get("scale", 0, 1.0f);
+        if (type == PRIM_MENGER) p.info.z = (int)get("degree", 0, 4.0f);
+        if (values.count("rotation")) {
+            glm::vec3 axis(get("rotation", 0, 0.0f), get("rotation", 1, 1.0f), get("rotation", 2, 0.0f));
+            glm::quat q = glm::angleAxis(glm::radians(get("rotation", 3, 0.0f)), glm::normalize(axis));
+            p.rotation = glm::vec4(q.x, q.y, q.z, q.w);
+        }
+        if (values.count("bob") && animations) {
+            SceneAnimation animation;
+            animation.primitive = (uint32_t)primitives.size();
+            animation.origin = position;
+            animation.amplitude = std::abs(get("bob", 0, 1.0f));
+            animation.frequency = values["bob"].size() > 1 ? values["bob"][1] : 1.0f;
+            animations->push_back(animation);
+        }
+        primitives.push_back(p);
+    }
+
+    if (lights) {
+        if (sceneLights.empty()) defaultSceneLights(sceneLights, lightOrbits);
+        *lights = sceneLights;
+        if (orbits) *orbits = lightOrbits;
+    }
+
+    std::cout << "Loaded " << primitives.size() << " primitives";
+    if (lights) std::cout << " and " << lights->size() << " lights";
+    std::cout << " from " << path << std::endl;
+    return true;
+}
+
+void animateScene(const std::vector<SceneAnimation>& animations, float time, std::vector<ScenePrimitive>& primitives) {
+    for (const SceneAnimation& animation : animations) {
+        glm::vec3 position = animation.origin + glm::vec3(0.0f, animation.amplitude * sinf(animation.frequency * time), 0.0f);
+        primitives[animation.primitive].positionScale = glm::vec4(position, primitives[animation.primitive].positionScale.w);
+    }
+}
+
+void animateLights(const std::vector<LightOrbit>& orbits, float time, std::vector<SceneLight>& lights) {
+    for (const LightOrbit& orbit : orbits) {
+        glm::vec3 position = orbit.center + orbit.radius * glm::vec3(cosf(orbit.speed * time), 0.0f, sinf(orbit.speed * time));
+        lights[orbit.light].positionSize = glm::vec4(position, lights[orbit.light].positionSize.w);
+    }
+}
+
+float sceneMotionExtent(const std::vector<SceneAnimation>& animations) {
+    float extent = 0.0f;
+    for (const SceneAnimation& animation : animations) {
+        extent = std::max(extent, animation.amplitude);
+    }
+    return extent;
+}
+
+bool isBounded(const ScenePrimitive& primitive) {
+    return primitive.info.x != PRIM_PLANE;
+}
+
+void primitiveBounds(const ScenePrimitive& primitive, glm::vec3& boundsMin, glm::vec3& boundsMax) {
+    const glm::vec4& a = primitive.params;
+    glm::vec3 extent;
+    switch (primitive.info.x) {
+        case PRIM_BOX: extent = glm::vec3(a.x, a.y, a.z); break;
+        case PRIM_SPHERE: extent = glm::vec3(a.x); break;
+        case PRIM_BLOB: extent = glm::vec3(1.65f); break;
+        case PRIM_TORUS: extent = glm::vec3(a.x + a.y, a.x, a.x + a.y); break;
+        case PRIM_CYLINDER: extent = glm::vec3(a.x, a.y, a.x); break;
+        case PRIM_MENGER: extent = glm::vec3(a.x); break;
+        case PRIM_MANDELBULB: extent = glm::vec3(1.25f); break;
+        default: extent = glm::vec3(0.0f); break;
+    }
+    extent *= primitive.positionScale.w;
+
+    // Extent of the rotated box along each world axis
+    glm::quat q(primitive.rotation.w, primitive.rotation.x, primitive.rotation.y, primitive.rotation.z);
+    glm::mat3 r = glm::mat3_cast(q);
+    glm::vec3 world(0.0f);
+    for (int i = 0; i < 3; i++) {
+        world += glm::abs(r[i]) * extent[i];
+    }
+
+    glm::vec3 center(primitive.positionScale);
+    boundsMin = center - world;
+    boundsMax = center + world;
+}
+
+float primitiveLipschitz(const ScenePrimitive& primitive) {
+    return primitive.info.x == PRIM_BLOB ? 1.75f : 1.0f; // BLOB_LIPSCHITZ in shaders/hg_sdf.glsl
+}
+
+void buildSceneGrid(const std::vector<ScenePrimitive>& primitives, SceneGrid& grid, float motionSlack) {
+    grid.cells.clear();
+    grid.indices.clear();
+    grid.motionSlack = motionSlack;
+
+    std::vector<uint32_t> bounded;
+    std::vector<glm::vec3> mins, maxs;
+    glm::vec3 sceneMin(1e30f), sceneMax(-1e30f);
+    for (uint32_t i = 0; i < primitives.size(); i++) {
+        if (!isBounded(primitives[i])) {
+            grid.indices.push_back(i);
+            continue;
+        }
+        glm::vec3 lo, hi;
+        primitiveBounds(primitives[i], lo, hi);
+        bounded.push_back(i);
+        mins.push_back(lo);
+        maxs.push_back(hi);
+        sceneMin = glm::min(sceneMin, lo);
+        sceneMax = glm::max(sceneMax, hi);
+    }
+    grid.globalCount = (uint32_t)grid.indices.size();
+
+    if (bounded.empty()) {
+        grid.dims = glm::ivec3(0);
+        return;
+    }
+
+    // Aim for a handful of cells per primitive
+    glm::vec3 extent = glm::max(sceneMax - sceneMin, glm::vec3(1e-3f));
+    float targetCells = glm::clamp(8.0f * bounded.size(), 64.0f, (float)(GRID_MAX_DIM * GRID_MAX_DIM * GRID_MAX_DIM));
+    float edge = std::max(std::cbrt(extent.x * extent.y * extent.z / targetCells), GRID_MIN_CELL_SIZE + 2.0f * motionSlack);
+    grid.margin = 0.5f * edge;
+
+    // Pad by the margin so that points outside the grid are at least `margin` from everything in it
+    grid.min = sceneMin - grid.margin;
+    glm::vec3 size = extent + 2.0f * grid.margin;
+    grid.dims = glm::clamp(glm::ivec3(glm::ceil(size / edge)), glm::ivec3(1), glm::ivec3(GRID_MAX_DIM));
+    grid.cellSize = size / glm::vec3(grid.dims);
+
+    auto cellRange = [&](size_t b, glm::ivec3& lo, glm::ivec3& hi) {
+        lo = glm::ivec3(glm::floor((mins[b] - grid.margin - grid.min) / grid.cellSize));
+        hi = glm::ivec3(glm::floor((maxs[b] + grid.margin - grid.min) / grid.cellSize));
+        lo = glm::clamp(lo, glm::ivec3(0), grid.dims - 1);
+        hi = glm::clamp(hi, glm::ivec3(0), grid.dims - 1);
+    };
+    auto cellIndex = [&](int x, int y, int z) { return x + grid.dims.x * (y + grid.dims.y * z); };
+
+    // Two passes: count, then fill each cell's slice of the index list
+    size_t cellCount = (size_t)grid.dims.x * grid.dims.y * grid.dims.z;
+    grid.cells.assign(cellCount, glm::uvec2(0));
+    for (size_t b = 0; b < bounded.size(); b++) {
+        glm::ivec3 lo, hi;
+        cellRange(b, lo, hi);
+        for (int z = lo.z; z <= hi.z; z++)
+            for (int y = lo.y; y <= hi.y; y++)
+                for (int x = lo.x; x <= hi.x; x++)
+                    grid.cells[cellIndex(x, y, z)].y++;
+    }
+
+    uint32_t offset = grid.globalCount;
+    for (glm::uvec2& cell : grid.cells) {
+        cell.x = offset;
+        offset += cell.y;
+        cell.y = 0;
+    }
+    grid.indices.resize(offset);
+
+    for (size_t b = 0; b < bounded.size(); b++) {
+        glm::ivec3 lo, hi;
+        cellRange(b, lo, hi);
+        for (int z = lo.z; z <= hi.z; z++)
+            for (int y = lo.y; y <= hi.y; y++)
+                for (int x = lo.x; x <= hi.x; x++) {
+                    glm::uvec2& cell = grid.cells[cellIndex(x, y, z)];
+                    grid.indices[cell.x + cell.y++] = bounded[b];
+                }
+    }
+}
+
+std::vector<unsigned char> packSceneGrid(const SceneGrid& grid) {
+    SceneGridHeader header;
+    header.min = glm::vec4(grid.min, grid.margin - grid.motionSlack);
+    header.cellSize = glm::vec4(grid.cellSize, 0.0f);
+    header.dims = glm::ivec4(grid.dims, (int)grid.globalCount);
+
+    std::vector<unsigned char> data(sizeof(header) + grid.cells.size() * sizeof(glm::uvec2));
+    memcpy(data.data(), &header, sizeof(header));
+    if (!grid.cells.empty()) {
+        memcpy(data.data() + sizeof(header), grid.cells.data(), grid.cells.size() * sizeof(glm::uvec2));
+    }
+    return data;
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+// Data-driven scene description shared by the GL app and the CPU renderer.
+// Primitives are uploaded as-is to the `primitives` SSBO and evaluated by
+// evalPrimitive() in shaders/primitives.glsl; the uniform grid built here lets
+// calcSDF skip every primitive that isn't near the sample point.
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum PrimitiveType {
+    PRIM_PLANE = 0,     // params: xyz normal, w distance from origin (unbounded)
+    PRIM_BOX = 1,       // params: xyz half extents
+    PRIM_SPHERE = 2,    // params: x radius
+    PRIM_BLOB = 3,      // no params, radius ~1.65
+    PRIM_TORUS = 4,     // params: x small radius, y large radius
+    PRIM_CYLINDER = 5,  // params: x radius, y half height
+    PRIM_MENGER = 6,    // params: x size; info.z degree
+    PRIM_MANDELBULB = 7 // no params, radius ~1.2
+};
+
+// One std430 record of the `primitives` SSBO (64 bytes, must match primitives.glsl).
+struct ScenePrimitive {
+    glm::vec4 positionScale; // xyz translation, w uniform scale
+    glm::vec4 rotation;      // unit quaternion (x, y, z, w) from local to world space
+    glm::vec4 params;        // type specific, see PrimitiveType
+    glm::ivec4 info;         // x type, y material ID, z integer parameter, w baked volume + 1 (sdf_bake.h)
+};
+
+// Uniform grid over the bounded primitives. The GPU layout is the `sceneGrid`
+// SSBO (header + cells) and the `sceneGridIndices` SSBO (indices).
+struct SceneGrid {
+    glm::vec3 min = glm::vec3(0.0f);
+    glm::vec3 cellSize = glm::vec3(1.0f);
+    glm::ivec3 dims = glm::ivec3(0);
+    // Each cell lists every primitive whose bounds come within `margin` of it,
+    // so a point in a cell is at least (distance to the cell exit + margin)
+    // away from every primitive the cell doesn't list.
+    float margin = 0.0f;
+    // Animated primitives may move up to this far from where they were binned,
+    // which eats into the margin the shader can rely on
+    float motionSlack = 0.0f;
+    // indices[0, globalCount) are the unbounded primitives, evaluated everywhere
+    uint32_t globalCount = 0;
+    std::vector<glm::uvec2> cells; // (first index, count) into `indices`
+    std::vector<uint32_t> indices;
+};
+
+// GPU header that precedes the cells in the sceneGrid SSBO
+struct SceneGridHeader {
+    glm::vec4 min;      // xyz, w margin minus motion slack
+    glm::vec4 cellSize; // xyz, w unused
+    glm::ivec4 dims;    // xyz, w global primitive count
+};
+
+// Vertical bobbing around the scene file position, "bob <amplitude> [frequency]"
+struct SceneAnimation {
+    uint32_t primitive;
+    glm::vec3 origin;
+    float amplitude;
+    float frequency; // radians per second
+};
+
+// Must match MAX_LIGHTS in shaders/lights.glsl
+#define MAX_SCENE_LIGHTS 256
+
+// One std430 record of the `sceneLights` SSBO (64 bytes, must match struct Light in shaders/lights.glsl).
+// A spotlight aimed from its position at its target.
+struct SceneLight {
+    glm::vec4 positionSize; // xyz position, w size (larger = softer shadows)
+    glm::vec4 colorRange;   // rgb colour, w range where it fades out, 0 for unlimited
+    glm::vec4 target;       // xyz point the light is aimed at
+    glm::vec4 cone;         // x cos(focus), y cos(spread)
+};
+
+// Circles a light around a centre in the horizontal plane, "orbit <radius> [speed]"
+struct LightOrbit {
+    uint32_t light;
+    glm::vec3 center;
+    float radius;
+    float speed; // radians per second, negative is clockwise seen from above
+};
+
+ScenePrimitive makePrimitive(PrimitiveType type, glm::vec3 position, glm::vec4 params, int materialID);
+
+// focusDeg and spreadDeg are the half angles of the full and the outer cone
+SceneLight makeLight(glm::vec3 position, glm::vec3 target, glm::vec3 color, float focusDeg, float spreadDeg,
+                     float size, float range = 0.0f);
+// The two lights used when a scene file has none
+void defaultSceneLights(std::vector<SceneLight>& lights, std::vector<LightOrbit>& orbits);
+
+// Loads a scene description, one primitive per line:
+//   <type> [position x y z] [rotation ax ay az degrees] [scale s] [<param keywords>] [material id] [bob a f]
+// or one light:
+//   light [position x y z] [target x y z] [color r g b] [focus deg] [spread deg] [size s] [range r] [orbit r speed]
+// See scenes/default.scene for the keywords each type accepts. A scene
+// without light lines gets defaultSceneLights().
+bool loadScene(const std::string& path, std::vector<ScenePrimitive>& primitives,
+               std::vector<SceneAnimation>* animations = nullptr,
+               std::vector<SceneLight>* lights = nullptr, std::vector<LightOrbit>* orbits = nullptr);
+
+// Moves the animated primitives to where they are at `time`
+void animateScene(const std::vector<SceneAnimation>& animations, float time, std::vector<ScenePrimitive>& primitives);
+// Moves the orbiting lights to where they are at `time`
+void animateLights(const std::vector<LightOrbit>& orbits, float time, std::vector<SceneLight>& lights);
+// Furthest any animation moves its primitive from the scene file position
+float sceneMotionExtent(const std::vector<SceneAnimation>& animations);
+
+bool isBounded(const ScenePrimitive& primitive);
+// World space AABB of a bounded primitive
+void primitiveBounds(const ScenePrimitive& primitive, glm::vec3& boundsMin, glm::vec3& boundsMax);
+// Lipschitz bound of the primitive's distance function, 1 for exact distances
+// and bounds (primitiveLipschitz() in shaders/primitives.glsl)
+float primitiveLipschitz(const ScenePrimitive& primitive);
+
+// Bins the primitives at their current positions. Pass sceneMotionExtent() as
+// motionSlack when they are animated afterwards without rebuilding the grid.
+void buildSceneGrid(const std::vector<ScenePrimitive>& primitives, SceneGrid& grid, float motionSlack = 0.0f);
+
+// Flattens the grid into the sceneGrid SSBO layout (header followed by cells)
+std::vector<unsigned char> packSceneGrid(const SceneGrid& grid);
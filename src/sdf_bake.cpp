@@ -0,0 +1,284 @@
+#include "sdf_bake.h"
+
+#include "program_cache.h"
+#include "shader_gen.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#define SDF_CACHE_MAGIC 0x42534753u // "SGSB"
+
+// Work groups per glDispatchCompute call, the minimum every GL 4.3 driver supports
+#define BAKE_MAX_GROUPS 65535
+
+// Headroom on the centre distance when picking the cells that get a brick, as
+// CULL_SLACK in src/cpu/mesher.cpp: the fractal estimators overshoot near the
+// surface, and without it the surface can pass through a cell without a brick
+#define BAKE_SLACK 1.5f
+
+struct SdfCacheHeader {
+    uint32_t magic;
+    uint32_t volumes;
+    uint32_t cells;
+    int32_t atlasSize[3];
+};
+
+bool isBakeable(const ScenePrimitive& primitive) {
+    return primitive.info.x == PRIM_MENGER || primitive.info.x == PRIM_MANDELBULB;
+}
+
+static GLuint createBakeSSBO(GLuint binding, const void* data, size_t size) {
+    // Zero sized SSBOs aren't allowed
+    static const uint32_t empty[4] = {};
+    if (size == 0) {
+        data = empty;
+        size = sizeof(empty);
+    }
+    GLuint ssbo;
+    glGenBuffers(1, &ssbo);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size, data, GL_STATIC_DRAW);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, ssbo);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    return ssbo;
+}
+
+// Runs `jobs` jobs of one bake stage, jobsPerGroup per work group
+static void dispatchBakeStage(GLuint program, int stage, int jobs, int jobsPerGroup) {
+    glUniform1i(glGetUniformLocation(program, "u_stage"), stage);
+    glUniform1i(glGetUniformLocation(program, "u_jobCount"), jobs);
+    for (int first = 0; first < jobs; first += BAKE_MAX_GROUPS * jobsPerGroup) {
+        int groups = std::min(BAKE_MAX_GROUPS, (jobs - first + jobsPerGroup - 1) / jobsPerGroup);
+        glUniform1i(glGetUniformLocation(program, "u_firstJob"), first);
+        glDispatchCompute(groups, 1, 1);
+    }
+}
+
+static bool loadBake(const std::string& path, SceneBake& bake, std::vector<uint16_t>& atlas) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) return false;
+
+    SdfCacheHeader header;
+    if (!file.read((char*)&header, sizeof(header)) || header.magic != SDF_CACHE_MAGIC ||
+        header.volumes != bake.volumes.size() || header.cells != bake.cells.size()) {
+        return false;
+    }
+    bake.atlasSize = glm::ivec3(header.atlasSize[0], header.atlasSize[1], header.atlasSize[2]);
+    atlas.resize((size_t)bake.atlasSize.x * bake.atlasSize.y * bake.atlasSize.z);
+    return file.read((char*)bake.cells.data(), bake.cells.size() * sizeof(BakedCell)) &&
+           file.read((char*)atlas.data(), atlas.size() * sizeof(uint16_t));
+}
+
+static void saveBake(const std::string& path, const SceneBake& bake, const std::vector<uint16_t>& atlas) {
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+
+    // Same as the program cache: never leave a truncated file behind
+    std::string tempPath = path + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary);
+        if (!file.is_open()) {
+            std::cerr << "Failed to write SDF cache: " << path << std::endl;
+            return;
+        }
+        SdfCacheHeader header = { SDF_CACHE_MAGIC, (uint32_t)bake.volumes.size(), (uint32_t)bake.cells.size(),
+                                  { bake.atlasSize.x, bake.atlasSize.y, bake.atlasSize.z } };
+        file.write((const char*)&header, sizeof(header));
+        file.write((const char*)bake.cells.data(), bake.cells.size() * sizeof(BakedCell));
+        file.write((const char*)atlas.data(), atlas.size() * sizeof(uint16_t));
+    }
+    std::filesystem::rename(tempPath, path, error);
+    if (error) {
+        std::cerr << "Failed to write SDF cache: " << path << std::endl;
+    }
+}
+
+// Samples the analytic SDFs on the GPU. Fills bake.cells, bake.atlasSize and
+// the atlas texture, which has to exist already.
+static bool runBake(const ShaderSource& source, const std::vector<ScenePrimitive>& primitives, SceneBake& bake) {
+    GLuint program = createComputeProgram(source.code, source.files);
+    if (!program) return false;
+    glUseProgram(program);
+
+    // Stage 0: one job per cell, evaluated at its centre
+    std::vector<glm::ivec4> jobs;
+    for (size_t v = 0; v < bake.volumes.size(); v++) {
+        const glm::ivec4& dims = bake.volumes[v].dims;
+        for (int z = 0; z < dims.z; z++)
+            for (int y = 0; y < dims.y; y++)
+                for (int x = 0; x < dims.x; x++)
+                    jobs.push_back(glm::ivec4((int)v, x, y, z));
+    }
+    GLuint primitivesSSBO = createBakeSSBO(0, primitives.data(), primitives.size() * sizeof(ScenePrimitive));
+    GLuint jobsSSBO = createBakeSSBO(5, jobs.data(), jobs.size() * sizeof(glm::ivec4));
+    GLuint centersSSBO = createBakeSSBO(6, nullptr, jobs.size() * sizeof(float));
+    const int groupSize = BAKE_BRICK_SIZE * BAKE_BRICK_SIZE * BAKE_BRICK_SIZE;
+    dispatchBakeStage(program, 0, (int)jobs.size(), groupSize);
+
+    std::vector<float> centers(jobs.size());
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, centersSSBO);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, centers.size() * sizeof(float), centers.data());
+
+    // Only cells the surface may pass through get a brick, the others store the
+    // centre distance moved the slackened half diagonal towards zero
+    std::vector<glm::ivec4> brickJobs;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        const BakedVolume& volume = bake.volumes[jobs[i].x];
+        float reach = BAKE_SLACK * 0.5f * sqrtf(3.0f) * volume.min.w;
+        float d = centers[i];
+        BakedCell& cell = bake.cells[i];
+        cell.distance = d > 0.0f ? d - reach : d + reach;
+        cell.brick = -1;
+        if (fabsf(d) <= reach) {
+            brickJobs.push_back(jobs[i]);
+        }
+    }
+
+    // Bricks are packed into a roughly cubic atlas, 10 bits per axis of brick origin
+    bake.bricks = brickJobs.size();
+    int perAxis = std::max(1, (int)ceil(cbrt((double)bake.bricks)));
+    glm::ivec3 atlasBricks(perAxis, perAxis, std::max<int>(1, (int)((bake.bricks + perAxis * perAxis - 1) / (perAxis * perAxis))));
+    if (perAxis * BAKE_BRICK_SIZE > 1024) {
+        std::cerr << "Too many SDF bricks: " << bake.bricks << std::endl;
+        glDeleteBuffers(1, &primitivesSSBO);
+        glDeleteBuffers(1, &jobsSSBO);
+        glDeleteBuffers(1, &centersSSBO);
+        glDeleteProgram(program);
+        return false;
+    }
+    for (size_t b = 0; b < brickJobs.size(); b++) {
+        glm::ivec3 origin = BAKE_BRICK_SIZE * glm::ivec3(b % atlasBricks.x, (b / atlasBricks.x) % atlasBricks.y, b / (atlasBricks.x * atlasBricks.y));
+        const BakedVolume& volume = bake.volumes[brickJobs[b].x];
+        size_t index = volume.dims.w + brickJobs[b].y + volume.dims.x * (brickJobs[b].z + volume.dims.y * brickJobs[b].w);
+        bake.cells[index].brick = origin.x | (origin.y << 10) | (origin.z << 20);
+    }
+    bake.atlasSize = atlasBricks * BAKE_BRICK_SIZE;
+
+    // Stage 1: one work group per brick, one invocation per sample
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, bake.cellsSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, bake.cells.size() * sizeof(BakedCell), bake.cells.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, jobsSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<size_t>(brickJobs.size(), 1) * sizeof(glm::ivec4), brickJobs.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glBindTexture(GL_TEXTURE_3D, bake.atlasTexture);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_R16F, bake.atlasSize.x, bake.atlasSize.y, bake.atlasSize.z, 0, GL_RED, GL_FLOAT, nullptr);
+    glBindImageTexture(0, bake.atlasTexture, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_R16F);
+    dispatchBakeStage(program, 1, (int)brickJobs.size(), 1);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+    glDeleteBuffers(1, &primitivesSSBO);
+    glDeleteBuffers(1, &jobsSSBO);
+    glDeleteBuffers(1, &centersSSBO);
+    glUseProgram(0);
+    glDeleteProgram(program);
+    return true;
+}
+
+bool bakeScene(const char* shaderPath, std::vector<ScenePrimitive>& primitives,
+               const std::vector<SceneAnimation>& animations, const std::string& cacheDir,
+               bool enabled, SceneBake& bake) {
+    auto bakeStart = std::chrono::steady_clock::now();
+    std::vector<bool> animated(primitives.size(), false);
+    for (const SceneAnimation& animation : animations) {
+        animated[animation.primitive] = true;
+    }
+
+    // One volume per primitive, padded by a cell so the band around the surface is inside it
+    size_t cellCount = 0;
+    for (size_t i = 0; i < primitives.size(); i++) {
+        if (!enabled || !isBakeable(primitives[i]) || animated[i]) continue;
+
+        glm::vec3 boundsMin, boundsMax;
+        primitiveBounds(primitives[i], boundsMin, boundsMax);
+        glm::vec3 extent = boundsMax - boundsMin;
+        float cellSize = std::max(extent.x, std::max(extent.y, extent.z)) / (BAKE_CELLS - 2);
+
+        BakedVolume volume;
+        volume.min = glm::vec4(boundsMin - cellSize, cellSize);
+        volume.dims = glm::ivec4(glm::min(glm::ivec3(glm::ceil(extent / cellSize)) + 2, glm::ivec3(BAKE_CELLS)), (int)cellCount);
+        volume.primitive = (int32_t)i;
+        volume.errorBound = sqrtf(3.0f) * cellSize / (BAKE_BRICK_SIZE - 1);
+        volume.band = volume.errorBound;
+        volume.pad = 0;
+        bake.volumes.push_back(volume);
+        cellCount += (size_t)volume.dims.x * volume.dims.y * volume.dims.z;
+        primitives[i].info.w = (int)bake.volumes.size();
+    }
+    bake.cells.resize(cellCount);
+
+    bake.volumesSSBO = createBakeSSBO(3, bake.volumes.data(), bake.volumes.size() * sizeof(BakedVolume));
+    bake.cellsSSBO = createBakeSSBO(4, bake.cells.data(), bake.cells.size() * sizeof(BakedCell));
+    glGenTextures(1, &bake.atlasTexture);
+    glBindTexture(GL_TEXTURE_3D, bake.atlasTexture);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    if (bake.volumes.empty()) {
+        glBindTexture(GL_TEXTURE_3D, 0);
+        return true;
+    }
+
+    ShaderSource source;
+    if (!buildShaderSource(shaderPath, {}, source)) return false;
+
+    // Keyed by everything the samples depend on: the GLSL, the brick selection and the baked primitives
+    std::string cachePath;
+    if (!cacheDir.empty()) {
+        const float slack = BAKE_SLACK;
+        uint64_t hash = hashString(source.code);
+        hash = hashString(std::string((const char*)&slack, sizeof(slack)), hash);
+        for (const BakedVolume& volume : bake.volumes) {
+            hash = hashString(std::string((const char*)&volume, sizeof(volume)), hash);
+            hash = hashString(std::string((const char*)&primitives[volume.primitive], sizeof(ScenePrimitive)), hash);
+        }
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.sdf", (unsigned long long)hash);
+        cachePath = (std::filesystem::path(cacheDir) / name).string();
+    }
+
+    std::vector<uint16_t> atlas;
+    bool fromCache = !cachePath.empty() && loadBake(cachePath, bake, atlas);
+    if (fromCache) {
+        bake.bricks = std::count_if(bake.cells.begin(), bake.cells.end(), [](const BakedCell& c) { return c.brick >= 0; });
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, bake.cellsSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, bake.cells.size() * sizeof(BakedCell), bake.cells.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        glBindTexture(GL_TEXTURE_3D, bake.atlasTexture);
+        glTexImage3D(GL_TEXTURE_3D, 0, GL_R16F, bake.atlasSize.x, bake.atlasSize.y, bake.atlasSize.z, 0, GL_RED, GL_HALF_FLOAT, atlas.data());
+    } else {
+        if (!runBake(source, primitives, bake)) return false;
+        if (!cachePath.empty()) {
+            atlas.resize((size_t)bake.atlasSize.x * bake.atlasSize.y * bake.atlasSize.z);
+            glBindTexture(GL_TEXTURE_3D, bake.atlasTexture);
+            glGetTexImage(GL_TEXTURE_3D, 0, GL_RED, GL_HALF_FLOAT, atlas.data());
+            saveBake(cachePath, bake, atlas);
+        }
+    }
+    // The scene shaders sample the atlas from texture unit 1
+    glBindTexture(GL_TEXTURE_3D, 0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_3D, bake.atlasTexture);
+    glActiveTexture(GL_TEXTURE0);
+
+    printf("%s %zu SDF volumes, %zu bricks (%.1f MB) in %.2f s\n", fromCache ? "Loaded" : "Baked",
+           bake.volumes.size(), bake.bricks,
+           (double)bake.atlasSize.x * bake.atlasSize.y * bake.atlasSize.z * sizeof(uint16_t) / (1024.0 * 1024.0),
+           std::chrono::duration<double>(std::chrono::steady_clock::now() - bakeStart).count());
+    return true;
+}
+
+void destroySceneBake(SceneBake& bake) {
+    glDeleteBuffers(1, &bake.volumesSSBO);
+    glDeleteBuffers(1, &bake.cellsSSBO);
+    glDeleteTextures(1, &bake.atlasTexture);
+    bake = SceneBake();
+}
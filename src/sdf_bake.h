@@ -0,0 +1,61 @@
+#pragma once
+
+// Sparse distance volumes ("brick maps") for static fractal primitives.
+//
+// The Menger sponge and the mandelbulb cost more per evaluation than the rest
+// of the scene together, but they don't move. bakeScene() samples each of
+// them once with a compute shader (shaders/bake_sdf.glsl) and the march reads
+// the baked distance instead, going back to the analytic SDF only within a
+// thin band around the surface (shaders/baked_sdf.glsl), widened by the
+// caller's sdfTolerance. Results are cached on disk.
+
+#include "scene.h"
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define BAKE_CELLS 32       // cells along the longest axis of a volume
+#define BAKE_BRICK_SIZE 8   // samples per brick axis, must match BAKED_BRICK_SIZE in baked_sdf.glsl
+
+// std430 record of the `bakedVolumes` SSBO (48 bytes)
+struct BakedVolume {
+    glm::vec4 min;      // xyz corner, w cell size
+    glm::ivec4 dims;    // xyz cells, w first cell in `cells`
+    int32_t primitive;
+    float errorBound;   // largest overestimate of trilinear interpolation
+    float band;         // below this plus sdfTolerance the shader evaluates the analytic SDF
+    int32_t pad;
+};
+
+// std430 record of the `bakedCellData` SSBO
+struct BakedCell {
+    float distance;     // lower bound over the cell when there is no brick
+    int32_t brick;      // atlas origin packed as x | y << 10 | z << 20, or -1
+};
+
+struct SceneBake {
+    std::vector<BakedVolume> volumes;
+    std::vector<BakedCell> cells;
+    glm::ivec3 atlasSize = glm::ivec3(0);
+    size_t bricks = 0;
+    GLuint volumesSSBO = 0;
+    GLuint cellsSSBO = 0;
+    GLuint atlasTexture = 0;
+};
+
+// Menger sponges and mandelbulbs; animated ones are never baked
+bool isBakeable(const ScenePrimitive& primitive);
+
+// Bakes every bakeable primitive, or loads the result from cacheDir (empty
+// disables the cache), and binds the SSBOs and the atlas texture. Baked
+// primitives get their volume index + 1 in info.w, so this has to run before
+// the primitives are uploaded and the fragment shader is generated. With
+// `enabled` false, or nothing to bake, empty buffers are bound instead.
+bool bakeScene(const char* shaderPath, std::vector<ScenePrimitive>& primitives,
+               const std::vector<SceneAnimation>& animations, const std::string& cacheDir,
+               bool enabled, SceneBake& bake);
+
+void destroySceneBake(SceneBake& bake);
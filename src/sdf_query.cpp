@@ -0,0 +1,132 @@
+#include "sdf_query.h"
+
+#include "gl_ext.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+bool SdfQueries::create(GLuint queryProgram) {
+    destroy();
+    program = queryProgram;
+    countLoc = glGetUniformLocation(program, "u_queryCount");
+
+    // Every batch starts at a multiple of its size, which is a valid binding offset
+    GLsizeiptr querySize = (GLsizeiptr)sizeof(SdfQuery) * SDF_QUERY_CAPACITY * SDF_QUERY_BATCHES;
+    GLsizeiptr resultSize = (GLsizeiptr)sizeof(SdfResult) * SDF_QUERY_CAPACITY * SDF_QUERY_BATCHES;
+    glGenBuffers(1, &queryBuffer);
+    glGenBuffers(1, &resultBuffer);
+    if (hasBufferStorage()) {
+        GLbitfield writeFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        GLbitfield readFlags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, queryBuffer);
+        glBufferStorage(GL_SHADER_STORAGE_BUFFER, querySize, nullptr, writeFlags);
+        mappedQueries = (SdfQuery*)glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, querySize, writeFlags);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, resultBuffer);
+        glBufferStorage(GL_SHADER_STORAGE_BUFFER, resultSize, nullptr, readFlags);
+        mappedResults = (SdfResult*)glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, resultSize, readFlags);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        if (!mappedQueries || !mappedResults) {
+            std::cerr << "Failed to persistently map the SDF query buffers\n";
+            destroy();
+            return false;
+        }
+    } else {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, queryBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, querySize, nullptr, GL_STREAM_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, resultBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, resultSize, nullptr, GL_STREAM_READ);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+    return program != 0;
+}
+
+void SdfQueries::destroy() {
+    for (Batch& batch : batches) {
+        if (batch.fence) glDeleteSync(batch.fence);
+        batch = Batch();
+    }
+    if (mappedQueries) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, queryBuffer);
+        glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+    }
+    if (mappedResults) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, resultBuffer);
+        glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    GLuint buffers[2] = { queryBuffer, resultBuffer };
+    glDeleteBuffers(2, buffers);
+    queryBuffer = resultBuffer = 0;
+    mappedQueries = nullptr;
+    mappedResults = nullptr;
+    program = 0;
+    next = 0;
+}
+
+unsigned SdfQueries::submit(const SdfQuery* queries, int count) {
+    if (!program || count <= 0) return 0;
+    count = std::min(count, SDF_QUERY_CAPACITY);
+
+    // The batches are reused in order, a batch the GPU hasn't finished is never touched
+    Batch& batch = batches[next];
+    if (batch.fence && !results(batch.ticket)) return 0;
+    int index = next;
+    next = (next + 1) % SDF_QUERY_BATCHES;
+
+    size_t first = (size_t)index * SDF_QUERY_CAPACITY;
+    if (mappedQueries) {
+        memcpy(mappedQueries + first, queries, count * sizeof(SdfQuery));
+    } else {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, queryBuffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, first * sizeof(SdfQuery), count * sizeof(SdfQuery), queries);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, SDF_QUERY_BINDING, queryBuffer,
+                      first * sizeof(SdfQuery), SDF_QUERY_CAPACITY * sizeof(SdfQuery));
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, SDF_RESULT_BINDING, resultBuffer,
+                      first * sizeof(SdfResult), SDF_QUERY_CAPACITY * sizeof(SdfResult));
+    glUseProgram(program);
+    glUniform1i(countLoc, count);
+    glDispatchCompute((count + SDF_QUERY_WORKGROUP - 1) / SDF_QUERY_WORKGROUP, 1, 1);
+    // Shader writes to a persistently mapped buffer only reach the CPU after this barrier
+    glMemoryBarrier(mappedResults ? GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT : GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    batch.ticket = nextTicket++;
+    if (nextTicket == 0) nextTicket = 1;
+    batch.count = count;
+    batch.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    return batch.ticket;
+}
+
+const SdfResult* SdfQueries::results(unsigned ticket) {
+    for (int index = 0; index < SDF_QUERY_BATCHES; index++) {
+        Batch& batch = batches[index];
+        if (!ticket || batch.ticket != ticket) continue;
+
+        size_t first = (size_t)index * SDF_QUERY_CAPACITY;
+        if (batch.fence) {
+            // Flushed so the fence gets to the GPU even when nothing else is submitted
+            GLenum status = glClientWaitSync(batch.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) return nullptr;
+            glDeleteSync(batch.fence);
+            batch.fence = nullptr;
+            if (!mappedResults) {
+                // Done on the GPU, so this copy doesn't stall
+                batch.readback.resize(batch.count);
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, resultBuffer);
+                glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, first * sizeof(SdfResult), batch.count * sizeof(SdfResult), batch.readback.data());
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+            }
+        }
+        return mappedResults ? mappedResults + first : batch.readback.data();
+    }
+    return nullptr;
+}
+
+int SdfQueries::inFlight() const {
+    int count = 0;
+    for (const Batch& batch : batches) count += batch.fence != nullptr;
+    return count;
+}
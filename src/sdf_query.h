@@ -0,0 +1,87 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Batches that can be in flight at once
+#define SDF_QUERY_BATCHES 3
+// Queries per batch
+#define SDF_QUERY_CAPACITY 4096
+// Invocations per workgroup, must match QUERY_WORKGROUP in sdf_query.glsl
+#define SDF_QUERY_WORKGROUP 64
+// SSBO binding points of the queries and the results, as in sdf_query.glsl
+#define SDF_QUERY_BINDING 9
+#define SDF_RESULT_BINDING 10
+
+// std430 layout of shaders/sdf_query.glsl
+struct SdfQuery {
+    glm::vec4 origin;    // xyz the point, or where the ray starts
+    glm::vec4 direction; // xyz the normalized ray direction, w how far to march; 0 asks for the distance at origin
+};
+
+struct SdfResult {
+    glm::vec4 position;  // xyz the point or the ray's hit, w the signed distance or the distance along the ray, -1 on a miss
+    glm::vec4 normal;    // xyz the surface normal there, w the minID() material (0 on a miss)
+};
+
+inline SdfQuery pointQuery(glm::vec3 point) {
+    return { glm::vec4(point, 1.0f), glm::vec4(0.0f) };
+}
+
+inline SdfQuery rayQuery(glm::vec3 origin, glm::vec3 direction, float maxDistance) {
+    return { glm::vec4(origin, 1.0f), glm::vec4(glm::normalize(direction), maxDistance) };
+}
+
+// Distance, normal and material queries against the scene for the CPU side,
+// e.g. camera collision and picking. The queries are evaluated by
+// shaders/sdf_query.glsl, which is built like the scene shaders and so runs
+// the very calcSceneSDF the frame is drawn with.
+//
+// submit() copies a batch into a persistently mapped buffer and dispatches
+// it; a fence after the dispatch tells results() when the batch is done, so
+// neither call ever waits for the GPU. Results are normally in a frame or two
+// later and are read straight from a persistently mapped buffer. Up to
+// SDF_QUERY_BATCHES batches are in flight; without GL 4.4 buffer storage the
+// buffers are written and read with glBufferSubData / glGetBufferSubData.
+class SdfQueries {
+public:
+    SdfQueries() = default;
+    SdfQueries(const SdfQueries&) = delete;
+    SdfQueries& operator=(const SdfQueries&) = delete;
+    ~SdfQueries() { destroy(); }
+
+    // The linked sdf_query.glsl program (not owned). Expects the scene SSBOs
+    // and the bake atlas to be bound like for the scene pass.
+    bool create(GLuint program);
+    void destroy();
+
+    // Dispatches up to SDF_QUERY_CAPACITY queries and returns the batch's
+    // ticket, or 0 when every batch is still in flight. Leaves the query
+    // program bound.
+    unsigned submit(const SdfQuery* queries, int count);
+    // One result per query of the batch once the GPU has run it, null until
+    // then. The results stay valid until SDF_QUERY_BATCHES more batches have
+    // been submitted, after that the ticket is unknown and gets null again.
+    const SdfResult* results(unsigned ticket);
+
+    int inFlight() const;
+
+private:
+    struct Batch {
+        unsigned ticket = 0;
+        int count = 0;
+        GLsync fence = nullptr; // null once the results are in
+        std::vector<SdfResult> readback; // without persistent mapping
+    };
+
+    GLuint program = 0;
+    GLint countLoc = -1;
+    GLuint queryBuffer = 0, resultBuffer = 0;
+    SdfQuery* mappedQueries = nullptr;   // null without buffer storage
+    SdfResult* mappedResults = nullptr;
+    Batch batches[SDF_QUERY_BATCHES];
+    int next = 0;
+    unsigned nextTicket = 1;
+};
@@ -0,0 +1,392 @@
+#include "shader_gen.h"
+
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <regex>
+#include <set>
+#include <sstream>
+
+// One top-level declaration (or preprocessor line) with the comments above it
+struct Chunk {
+    int file;
+    int line;                    // first line of `text`, 1-based
+    std::string text;
+    std::string defines;         // function or const name; empty means always kept
+    std::set<std::string> uses;  // identifiers referenced outside comments
+    bool keep = false;
+};
+
+static std::string trim(const std::string& s) {
+    size_t first = s.find_first_not_of(" \t\r\n");
+    if (first == std::string::npos) return "";
+    return s.substr(first, s.find_last_not_of(" \t\r\n") - first + 1);
+}
+
+static std::string stripComments(const std::string& line, bool& inBlockComment) {
+    std::string code;
+    for (size_t i = 0; i < line.size(); i++) {
+        if (inBlockComment) {
+            if (line.compare(i, 2, "*/") == 0) {
+                inBlockComment = false;
+                i++;
+            }
+        } else if (line.compare(i, 2, "//") == 0) {
+            break;
+        } else if (line.compare(i, 2, "/*") == 0) {
+            inBlockComment = true;
+            i++;
+        } else {
+            code += line[i];
+        }
+    }
+    return code;
+}
+
+static void scanIdentifiers(const std::string& code, std::set<std::string>& out) {
+    for (size_t i = 0; i < code.size();) {
+        if (isalpha((unsigned char)code[i]) || code[i] == '_') {
+            size_t start = i;
+            while (i < code.size() && (isalnum((unsigned char)code[i]) || code[i] == '_')) i++;
+            out.insert(code.substr(start, i - start));
+        } else if (isdigit((unsigned char)code[i])) {
+            // skip numbers so suffixes like the "e" in 1e5 aren't identifiers
+            while (i < code.size() && (isalnum((unsigned char)code[i]) || code[i] == '.')) i++;
+        } else {
+            i++;
+        }
+    }
+}
+
+// Name of the function or const a declaration defines, empty for anything
+// that has to stay (uniforms, blocks, structs, globals with side effects)
+static std::string declaredName(const std::string& code) {
+    static const std::regex function(R"(^\s*(?:(?:highp|mediump|lowp)\s+)?[A-Za-z_]\w*\s+([A-Za-z_]\w*)\s*\()");
+    static const std::regex constant(R"(^\s*const\s+[A-Za-z_]\w*\s*(?:\[\s*\d*\s*\])?\s+([A-Za-z_]\w*))");
+    static const std::regex keyword(R"(^\s*(layout|struct|uniform|in|out|buffer|precision)\b)");
+    std::smatch match;
+    if (std::regex_search(code, keyword)) return "";
+    if (std::regex_search(code, match, function)) return match[1];
+    if (std::regex_search(code, match, constant)) return match[1];
+    return "";
+}
+
+static bool isFunction(const std::string& code) {
+    std::string header = code.substr(0, code.find('{'));
+    return !declaredName(header).empty() && header.find('(') != std::string::npos && trim(header).compare(0, 6, "const ") != 0;
+}
+
+static bool parseSource(const std::string& name, std::istream& in, const std::string& directory,
+                        const std::map<std::string, std::string>& overrides, std::set<std::string>& included,
+                        ShaderSource& out, std::vector<Chunk>& chunks) {
+    int file = (int)out.files.size();
+    out.files.push_back(name);
+
+    std::string pending; // comment/blank lines waiting for the next chunk
+    int pendingLine = 0;
+    Chunk current;
+    std::string currentCode;
+    bool inChunk = false;
+    bool inBlockComment = false;
+    int depth = 0;
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(in, line)) {
+        lineNumber++;
+        std::string code = stripComments(line, inBlockComment);
+        std::string trimmed = trim(code);
+
+        if (!inChunk) {
+            if (trimmed.empty()) {
+                if (pending.empty()) pendingLine = lineNumber;
+                pending += line + "\n";
+                continue;
+            }
+            Chunk chunk;
+            chunk.file = file;
+            chunk.line = pending.empty() ? lineNumber : pendingLine;
+            chunk.text = pending;
+            pending.clear();
+
+            if (trimmed.compare(0, 8, "#include") == 0) {
+                std::string includeName = trimmed.substr(8);
+                includeName.erase(includeName.find_last_not_of(" \"\t\n\r") + 1);
+                includeName.erase(0, includeName.find_first_not_of(" \"\t\n\r"));
+
+                chunks.push_back(chunk); // leading comments
+                auto override = overrides.find(includeName);
+                if (override != overrides.end()) {
+                    std::istringstream generated(override->second);
+                    if (!parseSource("generated " + includeName, generated, directory, overrides, included, out, chunks)) return false;
+                } else {
+                    std::filesystem::path includePath = std::filesystem::path(directory) / includeName;
+                    if (included.count(includePath.string())) continue; // Prevent recursive includes
+                    included.insert(includePath.string());
+                    std::ifstream includeFile(includePath);
+                    if (!includeFile.is_open()) {
+                        std::cerr << "Failed to open shader file: " << includePath.string() << std::endl;
+                        return false;
+                    }
+                    if (!parseSource(includePath.string(), includeFile, includePath.parent_path().string(), overrides, included, out, chunks)) return false;
+                }
+                continue;
+            }
+            if (trimmed[0] == '#') {
+                chunk.text += line + "\n";
+                scanIdentifiers(trimmed, chunk.uses);
+                chunks.push_back(chunk);
+                continue;
+            }
+
+            current = chunk;
+            currentCode.clear();
+            inChunk = true;
+            depth = 0;
+        }
+
+        current.text += line + "\n";
+        currentCode += code + "\n";
+        bool ended = false;
+        for (char c : code) {
+            if (c == '{') {
+                depth++;
+            } else if (c == '}') {
+                depth--;
+                if (depth == 0 && isFunction(currentCode)) ended = true;
+            } else if (c == ';' && depth == 0) {
+                ended = true;
+            }
+        }
+        if (ended) {
+            current.defines = declaredName(currentCode);
+            scanIdentifiers(currentCode, current.uses);
+            chunks.push_back(current);
+            inChunk = false;
+        }
+    }
+
+    if (inChunk) {
+        std::cerr << name << ": unterminated declaration starting at line " << current.line << std::endl;
+        return false;
+    }
+    if (!pending.empty()) {
+        Chunk chunk;
+        chunk.file = file;
+        chunk.line = pendingLine;
+        chunk.text = pending;
+        chunks.push_back(chunk);
+    }
+    return true;
+}
+
+bool buildShaderSource(const std::string& path, const std::map<std::string, std::string>& overrides, ShaderSource& out) {
+    out = ShaderSource();
+    std::ifstream shaderFile(path);
+    if (!shaderFile.is_open()) {
+        std::cerr << "Failed to open shader file: " << path << std::endl;
+        return false;
+    }
+
+    std::vector<Chunk> chunks;
+    std::set<std::string> included = { path };
+    if (!parseSource(path, shaderFile, std::filesystem::path(path).parent_path().string(), overrides, included, out, chunks)) {
+        return false;
+    }
+
+    // Walk the references from everything that always stays (main(), uniforms, macros, ...)
+    std::vector<std::string> work = { "main" };
+    for (Chunk& chunk : chunks) {
+        if (chunk.defines.empty()) {
+            chunk.keep = true;
+            work.insert(work.end(), chunk.uses.begin(), chunk.uses.end());
+        }
+    }
+    std::set<std::string> visited;
+    while (!work.empty()) {
+        std::string name = work.back();
+        work.pop_back();
+        if (!visited.insert(name).second) continue;
+        for (Chunk& chunk : chunks) {
+            if (!chunk.keep && chunk.defines == name) { // every overload of the name
+                chunk.keep = true;
+                work.insert(work.end(), chunk.uses.begin(), chunk.uses.end());
+            }
+        }
+    }
+
+    // #line after every gap so compiler messages keep pointing at the original files
+    std::ostringstream code;
+    int file = 0, nextLine = 1;
+    size_t kept = 0;
+    for (const Chunk& chunk : chunks) {
+        if (!chunk.keep || chunk.text.empty()) continue;
+        if (chunk.file != file || chunk.line != nextLine) {
+            code << "#line " << chunk.line << " " << chunk.file << "\n";
+        }
+        code << chunk.text;
+        file = chunk.file;
+        nextLine = chunk.line + (int)std::count(chunk.text.begin(), chunk.text.end(), '\n');
+        if (!chunk.defines.empty()) kept++;
+    }
+    out.code = code.str();
+
+    size_t shakeable = std::count_if(chunks.begin(), chunks.end(), [](const Chunk& c) { return !c.defines.empty(); });
+    std::cout << "Shader " << path << ": kept " << kept << " of " << shakeable << " functions and constants\n";
+    return true;
+}
+
+static std::string glslFloat(float value) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.9g", value);
+    std::string s = buf;
+    if (s.find_first_of(".e") == std::string::npos) s += ".0";
+    return s;
+}
+
+static std::string glslVec3(glm::vec3 v) {
+    return "vec3(" + glslFloat(v.x) + ", " + glslFloat(v.y) + ", " + glslFloat(v.z) + ")";
+}
+
+// Evaluation order: cheap primitives first so the fractals' bounding tests see a tight distance
+static int primitiveCost(int type) {
+    switch (type) {
+        case PRIM_BLOB: return 1;
+        case PRIM_MENGER: return 2;
+        case PRIM_MANDELBULB: return 3;
+        default: return 0;
+    }
+}
+
+std::string generateSceneSDF(const std::vector<ScenePrimitive>& primitives, const std::vector<SceneAnimation>& animations) {
+    static const char* typeNames[] = { "plane", "box", "sphere", "blob", "torus", "cylinder", "menger", "mandelbulb" };
+
+    std::map<uint32_t, float> motion; // primitive -> animation amplitude
+    for (const SceneAnimation& animation : animations) {
+        motion[animation.primitive] = std::max(motion[animation.primitive], animation.amplitude);
+    }
+
+    std::vector<uint32_t> order(primitives.size());
+    for (uint32_t i = 0; i < order.size(); i++) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return primitiveCost(primitives[a].info.x) < primitiveCost(primitives[b].info.x);
+    });
+
+    std::ostringstream out;
+    out << "// calcSceneSDF() generated by generateSceneSDF() for " << primitives.size() << " primitives\n";
+    if (!motion.empty()) {
+        out << "\n"
+               "// Animated primitives are streamed, see StreamBuffer\n"
+               "#include \"primitives.glsl\"\n";
+    }
+    out << "\n"
+           "vec2 calcSceneSDF(vec3 pos) {\n"
+           "    vec2 dist = vec2(MAX_DIST_TO_TRAVEL * 2.0, 0.0);\n";
+
+    for (uint32_t index : order) {
+        const ScenePrimitive& prim = primitives[index];
+        int type = prim.info.x;
+        if (type < PRIM_PLANE || type > PRIM_MANDELBULB) continue;
+
+        bool animated = motion.count(index) > 0;
+        float scale = prim.positionScale.w;
+        const glm::vec4& a = prim.params;
+        bool baked = prim.info.w > 0 && !animated;
+        std::string indent = baked ? "            " : "        ";
+
+        out << "\n    // [" << index << "] " << typeNames[type] << ", material " << prim.info.y << (animated ? ", animated" : "") << "\n";
+        if (primitiveCost(type) > 0) {
+            // The bounding box distance never exceeds the primitive's, so it can be skipped when it can't win
+            glm::vec3 boundsMin, boundsMax;
+            primitiveBounds(prim, boundsMin, boundsMax);
+            glm::vec3 center = 0.5f * (boundsMin + boundsMax);
+            glm::vec3 extent = 0.5f * (boundsMax - boundsMin) + glm::vec3(animated ? motion[index] : 0.0f);
+            out << "    if (fBox(pos - " << glslVec3(center) << ", " << glslVec3(extent) << ") < dist.x) {\n";
+        } else {
+            out << "    {\n";
+        }
+        if (baked) {
+            // Analytic only close to the surface, see baked_sdf.glsl
+            int volume = prim.info.w - 1;
+            out << "        float d = bakedDistance(" << volume << ", pos);\n"
+                << "        if (d <= bakedBand(" << volume << ")) {\n";
+        }
+
+        if (animated) {
+            out << indent << "vec3 p = pos - prims[" << index << "].positionScale.xyz;\n";
+        } else if (glm::vec3(prim.positionScale) != glm::vec3(0.0f)) {
+            out << indent << "vec3 p = pos - " << glslVec3(glm::vec3(prim.positionScale)) << ";\n";
+        } else {
+            out << indent << "vec3 p = pos;\n";
+        }
+        if (prim.rotation != glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)) {
+            glm::quat q(prim.rotation.w, prim.rotation.x, prim.rotation.y, prim.rotation.z);
+            glm::mat3 m = glm::transpose(glm::mat3_cast(q)); // world to local
+            out << indent << "p = mat3(";
+            for (int c = 0; c < 3; c++)
+                for (int r = 0; r < 3; r++)
+                    out << glslFloat(m[c][r]) << (c == 2 && r == 2 ? "" : ", ");
+            out << ") * p;\n";
+        }
+        if (scale != 1.0f) {
+            out << indent << "p /= " << glslFloat(scale) << ";\n";
+        }
+
+        // The fractals leave out what sdfTolerance allows, see hg_sdf.glsl
+        std::string tolerance = scale != 1.0f ? "sdfTolerance / " + glslFloat(scale) : "sdfTolerance";
+        std::string d;
+        switch (type) {
+            case PRIM_PLANE: d = "fPlane(p, " + glslVec3(glm::vec3(a)) + ", " + glslFloat(a.w) + ")"; break;
+            case PRIM_BOX: d = "fBox(p, " + glslVec3(glm::vec3(a)) + ")"; break;
+            case PRIM_SPHERE: d = "fSphere(p, " + glslFloat(a.x) + ")"; break;
+            case PRIM_BLOB: d = "fBlob(p)"; break;
+            case PRIM_TORUS: d = "fTorus(p, " + glslFloat(a.x) + ", " + glslFloat(a.y) + ")"; break;
+            case PRIM_CYLINDER: d = "fCylinder(p, " + glslFloat(a.x) + ", " + glslFloat(a.y) + ")"; break;
+            case PRIM_MENGER: d = "fMengerLOD(p, " + std::to_string(prim.info.z) + ", " + glslFloat(a.x) + ", " + tolerance + ")"; break;
+            case PRIM_MANDELBULB:
+                out << indent << "vec4 trap;\n";
+                d = "mandelbulbLOD(p, " + tolerance + ", trap)";
+                break;
+        }
+        if (scale != 1.0f) {
+            d += " * " + glslFloat(scale);
+        }
+        if (baked) {
+            out << indent << "d = " << d << ";\n"
+                << "        }\n";
+            d = "d";
+        }
+        if (primitiveLipschitz(prim) != 1.0f) {
+            d = "lipschitzDistance(" + d + ", " + glslFloat(primitiveLipschitz(prim)) + ")";
+        }
+        out << "        dist = minID(vec2(" << d << ", " << glslFloat((float)prim.info.y) << "), dist);\n";
+        out << "    }\n";
+    }
+
+    out << "\n    return dist;\n}\n";
+    return out.str();
+}
+
+std::string annotateShaderLog(const std::string& log, const std::vector<std::string>& files) {
+    // Mesa/AMD/Intel "0:12(3): error", "ERROR: 0:12: ..." and NVIDIA "0(12) : error"
+    static const std::regex location(R"(^((?:ERROR: |WARNING: )?)(\d+)(?::(\d+)|\((\d+)\)))");
+    std::istringstream in(log);
+    std::ostringstream out;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::smatch match;
+        if (std::regex_search(line, match, location)) {
+            size_t file = std::stoul(match[2]);
+            std::string lineNumber = match[3].matched ? match[3].str() : match[4].str();
+            if (file < files.size()) {
+                line = match[1].str() + files[file] + ":" + lineNumber + line.substr(match[0].length());
+            }
+        }
+        out << line << "\n";
+    }
+    return out.str();
+}
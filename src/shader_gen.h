@@ -0,0 +1,37 @@
+#pragma once
+
+// Fragment shader assembly: resolves #includes like preprocessShader, but
+// drops every function and const that nothing reachable from main()
+// references, and can replace the generic scene interpreter (scene.glsl)
+// with straight-line GLSL generated for one particular scene.
+
+#include "scene.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+// Scenes with more primitives keep the grid-accelerated interpreter; unrolled
+// code would grow with the object count and cost more than it saves.
+#define SPECIALIZE_MAX_PRIMITIVES 64
+
+struct ShaderSource {
+    std::string code;
+    // File name for each GLSL source string number used in the #line directives
+    std::vector<std::string> files;
+};
+
+// Reads `path` and everything it includes. `overrides` maps an include name
+// (as written after #include) to code that is used in its place.
+bool buildShaderSource(const std::string& path, const std::map<std::string, std::string>& overrides, ShaderSource& out);
+
+// calcSceneSDF() for exactly these primitives: one unrolled block per primitive
+// with its transform and parameters as literals, and a bounding box test in
+// front of the expensive fractals. Animated primitives keep reading their
+// position from the primitives SSBO so streaming still works, and baked ones
+// (info.w, see sdf_bake.h) read their volume before the analytic SDF.
+std::string generateSceneSDF(const std::vector<ScenePrimitive>& primitives, const std::vector<SceneAnimation>& animations);
+
+// Rewrites "<string>:<line>" / "<string>(<line>)" locations in a compiler log
+// to "<file>:<line>" using the names recorded by buildShaderSource.
+std::string annotateShaderLog(const std::string& log, const std::vector<std::string>& files);
@@ -0,0 +1,165 @@
+#include "stream_buffer.h"
+
+#include "gl_ext.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+// Beyond this many separate dirty ranges a region is rewritten as one span
+#define MAX_DIRTY_RANGES 64
+
+bool StreamBuffer::create(GLenum bufferTarget, GLuint bindingPoint, const void* data, size_t size) {
+    destroy();
+    target = bufferTarget;
+    binding = bindingPoint;
+    dataSize = size;
+
+    // Every region has to start at a valid glBindBufferRange offset
+    GLint alignment = 256;
+    glGetIntegerv(target == GL_UNIFORM_BUFFER ? GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT : GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    regionStride = std::max<size_t>((size + alignment - 1) / alignment * alignment, alignment);
+    GLsizeiptr totalSize = regionStride * STREAM_BUFFER_REGIONS;
+
+    glGenBuffers(1, &buffer);
+    glBindBuffer(target, buffer);
+    if (hasBufferStorage()) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(target, totalSize, nullptr, flags);
+        mapped = (unsigned char*)glMapBufferRange(target, 0, totalSize, flags);
+        if (!mapped) {
+            std::cerr << "Failed to persistently map stream buffer\n";
+            glBindBuffer(target, 0);
+            destroy();
+            return false;
+        }
+    } else {
+        glBufferData(target, totalSize, nullptr, GL_DYNAMIC_DRAW);
+    }
+    glBindBuffer(target, 0);
+
+    shadow.assign((const unsigned char*)data, (const unsigned char*)data + size);
+    for (Region& region : regions) {
+        markDirty(region, Range(0, size));
+    }
+    // The first upload() moves on to region 0
+    current = STREAM_BUFFER_REGIONS - 1;
+    stallCount = 0;
+    return true;
+}
+
+void StreamBuffer::destroy() {
+    if (!buffer) return;
+
+    for (Region& region : regions) {
+        if (region.fence) glDeleteSync(region.fence);
+        region.fence = nullptr;
+        region.dirty.clear();
+    }
+    if (mapped) {
+        glBindBuffer(target, buffer);
+        glUnmapBuffer(target);
+        glBindBuffer(target, 0);
+        mapped = nullptr;
+    }
+    glDeleteBuffers(1, &buffer);
+    buffer = 0;
+    shadow.clear();
+}
+
+void StreamBuffer::update(size_t offset, const void* data, size_t size) {
+    if (offset + size > dataSize) {
+        std::cerr << "StreamBuffer::update out of range\n";
+        return;
+    }
+    memcpy(shadow.data() + offset, data, size);
+    for (Region& region : regions) {
+        markDirty(region, Range(offset, offset + size));
+    }
+}
+
+void StreamBuffer::markDirty(Region& region, Range range) {
+    std::vector<Range>& dirty = region.dirty;
+    dirty.push_back(range);
+    std::sort(dirty.begin(), dirty.end());
+
+    // Merge overlapping and touching ranges
+    size_t out = 0;
+    for (size_t i = 1; i < dirty.size(); i++) {
+        if (dirty[i].first <= dirty[out].second) {
+            dirty[out].second = std::max(dirty[out].second, dirty[i].second);
+        } else {
+            dirty[++out] = dirty[i];
+        }
+    }
+    dirty.resize(out + 1);
+
+    if (dirty.size() > MAX_DIRTY_RANGES) {
+        Range span(dirty.front().first, dirty.back().second);
+        dirty.assign(1, span);
+    }
+}
+
+void StreamBuffer::waitForRegion(Region& region) {
+    if (!region.fence) return;
+
+    GLenum result = glClientWaitSync(region.fence, 0, 0);
+    if (result == GL_TIMEOUT_EXPIRED) {
+        stallCount++;
+        do {
+            result = glClientWaitSync(region.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000); // 1 ms
+        } while (result == GL_TIMEOUT_EXPIRED);
+    }
+    if (result == GL_WAIT_FAILED) {
+        std::cerr << "Error waiting for stream buffer fence\n";
+    }
+    glDeleteSync(region.fence);
+    region.fence = nullptr;
+}
+
+void StreamBuffer::writeRegion(int index) {
+    Region& region = regions[index];
+    size_t base = index * regionStride;
+    if (!mapped) {
+        glBindBuffer(target, buffer);
+    }
+    for (const Range& range : region.dirty) {
+        size_t size = range.second - range.first;
+        if (mapped) {
+            memcpy(mapped + base + range.first, shadow.data() + range.first, size);
+        } else {
+            // The fence already guarantees the GPU is done with this region
+            GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+            void* p = glMapBufferRange(target, base + range.first, size, access);
+            if (p) {
+                memcpy(p, shadow.data() + range.first, size);
+                glUnmapBuffer(target);
+            }
+        }
+    }
+    if (!mapped) {
+        glBindBuffer(target, 0);
+    }
+    region.dirty.clear();
+}
+
+void StreamBuffer::upload() {
+    if (!buffer) return;
+
+    // Nothing changed since the current region was written, keep drawing from it
+    if (!regions[current].dirty.empty()) {
+        int next = (current + 1) % STREAM_BUFFER_REGIONS;
+        waitForRegion(regions[next]);
+        writeRegion(next);
+        current = next;
+    }
+    glBindBufferRange(target, binding, buffer, current * regionStride, std::max<size_t>(dataSize, 1));
+}
+
+void StreamBuffer::fence() {
+    if (!buffer) return;
+
+    Region& region = regions[current];
+    if (region.fence) glDeleteSync(region.fence);
+    region.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
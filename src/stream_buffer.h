@@ -0,0 +1,66 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Number of copies of the data; the CPU writes one while the GPU may still be
+// reading the other two.
+#define STREAM_BUFFER_REGIONS 3
+
+// Buffer for data that changes every frame, e.g. animated scene primitives.
+//
+// The buffer holds STREAM_BUFFER_REGIONS copies of the data in one
+// persistently mapped, coherent allocation (glBufferStorage). update() only
+// touches a CPU-side copy and records the dirty range; upload() picks the next
+// region, copies the ranges that region is missing and binds it. Each region
+// is fenced after the draws that read it, so by the time it comes round
+// again the GPU is normally done with it and the CPU never waits.
+class StreamBuffer {
+public:
+    StreamBuffer() = default;
+    StreamBuffer(const StreamBuffer&) = delete;
+    StreamBuffer& operator=(const StreamBuffer&) = delete;
+    ~StreamBuffer() { destroy(); }
+
+    // target is GL_SHADER_STORAGE_BUFFER or GL_UNIFORM_BUFFER
+    bool create(GLenum target, GLuint binding, const void* data, size_t size);
+    void destroy();
+
+    // Replaces [offset, offset + size) of the data; takes effect on the next upload()
+    void update(size_t offset, const void* data, size_t size);
+
+    // Call once per frame before drawing: makes the latest data visible at the binding point
+    void upload();
+    // Call after the draws that read the buffer have been issued
+    void fence();
+
+    size_t size() const { return dataSize; }
+    // Number of upload() calls that had to wait for the GPU to release a region
+    unsigned stalls() const { return stallCount; }
+
+private:
+    typedef std::pair<size_t, size_t> Range; // [begin, end)
+
+    struct Region {
+        GLsync fence = nullptr;
+        std::vector<Range> dirty; // ranges changed since this region was last written
+    };
+
+    void markDirty(Region& region, Range range);
+    void waitForRegion(Region& region);
+    void writeRegion(int index);
+
+    GLuint buffer = 0;
+    GLenum target = 0;
+    GLuint binding = 0;
+    size_t dataSize = 0;
+    size_t regionStride = 0;
+    unsigned char* mapped = nullptr; // null when glBufferStorage is unavailable
+    std::vector<unsigned char> shadow;
+    Region regions[STREAM_BUFFER_REGIONS];
+    int current = 0;
+    unsigned stallCount = 0;
+};
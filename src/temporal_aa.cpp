@@ -0,0 +1,159 @@
+#include "temporal_aa.h"
+
+#include <algorithm>
+#include <iostream>
+
+float halton(unsigned index, unsigned base) {
+    float result = 0.0f;
+    float f = 1.0f;
+    while (index > 0) {
+        f /= base;
+        result += f * (index % base);
+        index /= base;
+    }
+    return result;
+}
+
+namespace {
+
+GLuint createTexture(GLenum format, int width, int height) {
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, format, width, height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+}
+
+} // namespace
+
+bool TemporalAA::create(GLuint resolveProgram) {
+    destroy();
+    program = resolveProgram;
+    sizeLoc = glGetUniformLocation(program, "u_size");
+    historySizeLoc = glGetUniformLocation(program, "u_historySize");
+    jitterLoc = glGetUniformLocation(program, "u_jitter");
+    historyWeightLoc = glGetUniformLocation(program, "u_historyWeight");
+    camPosLoc = glGetUniformLocation(program, "u_camPos");
+    camTargetLoc = glGetUniformLocation(program, "u_camTarget");
+    scrollLoc = glGetUniformLocation(program, "u_scroll");
+    prevCamPosLoc = glGetUniformLocation(program, "u_prevCamPos");
+    prevCamTargetLoc = glGetUniformLocation(program, "u_prevCamTarget");
+    prevScrollLoc = glGetUniformLocation(program, "u_prevScroll");
+
+    glGenFramebuffers(1, &sceneFBO);
+    glGenFramebuffers(2, historyFBO);
+    frame = 0;
+    current = 0;
+    historyValid = false;
+    return true;
+}
+
+void TemporalAA::destroy() {
+    if (!sceneFBO) return;
+
+    glDeleteFramebuffers(1, &sceneFBO);
+    glDeleteFramebuffers(2, historyFBO);
+    glDeleteTextures(1, &sceneColor);
+    glDeleteTextures(1, &sceneDistance);
+    glDeleteTextures(2, history);
+    sceneFBO = sceneColor = sceneDistance = 0;
+    historyFBO[0] = historyFBO[1] = history[0] = history[1] = 0;
+    textureWidth = textureHeight = 0;
+}
+
+bool TemporalAA::resize(int newWidth, int newHeight) {
+    glDeleteTextures(1, &sceneColor);
+    glDeleteTextures(1, &sceneDistance);
+    glDeleteTextures(2, history);
+    sceneColor = createTexture(GL_RGBA8, newWidth, newHeight);
+    sceneDistance = createTexture(GL_R32F, newWidth, newHeight);
+    // Half floats, 8 bits lose the small steps a 0.9 history weight makes
+    history[0] = createTexture(GL_RGBA16F, newWidth, newHeight);
+    history[1] = createTexture(GL_RGBA16F, newWidth, newHeight);
+    textureWidth = newWidth;
+    textureHeight = newHeight;
+    historyValid = false;
+
+    const GLenum drawBuffers[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+    glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, sceneColor, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, sceneDistance, 0);
+    glDrawBuffers(2, drawBuffers);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    for (int i = 0; i < 2; i++) {
+        glBindFramebuffer(GL_FRAMEBUFFER, historyFBO[i]);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, history[i], 0);
+        complete = complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    }
+    if (!complete) {
+        std::cerr << "Temporal antialiasing framebuffer is incomplete\n";
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        return false;
+    }
+    return true;
+}
+
+void TemporalAA::begin(int frameWidth, int frameHeight) {
+    width = std::max(frameWidth, 1);
+    height = std::max(frameHeight, 1);
+    if (width > textureWidth || height > textureHeight) {
+        resize(std::max(width, textureWidth), std::max(height, textureHeight));
+    }
+    frame++;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+    glViewport(0, 0, width, height);
+}
+
+glm::vec2 TemporalAA::jitter() const {
+    // Index 0 of the sequence is (0, 0) for every base, start at 1
+    unsigned index = frame % TAA_SAMPLES + 1;
+    return glm::vec2(halton(index, 2) - 0.5f, halton(index, 3) - 0.5f);
+}
+
+GLuint TemporalAA::resolve(const TemporalCamera& camera) {
+    int previous = current;
+    current = 1 - current;
+    glm::vec2 offset = jitter();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, historyFBO[current]);
+    glViewport(0, 0, width, height);
+    glUseProgram(program);
+    glUniform2f(sizeLoc, (float)width, (float)height);
+    glUniform2f(historySizeLoc, (float)historyWidth, (float)historyHeight);
+    glUniform2f(jitterLoc, offset.x, offset.y);
+    glUniform1f(historyWeightLoc, historyValid ? TAA_HISTORY_WEIGHT : 0.0f);
+    glUniform3fv(camPosLoc, 1, &camera.position[0]);
+    glUniform3fv(camTargetLoc, 1, &camera.target[0]);
+    glUniform1f(scrollLoc, camera.scroll);
+    glUniform3fv(prevCamPosLoc, 1, &previousCamera.position[0]);
+    glUniform3fv(prevCamTargetLoc, 1, &previousCamera.target[0]);
+    glUniform1f(prevScrollLoc, previousCamera.scroll);
+
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, sceneColor);
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, sceneDistance);
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_2D, history[previous]);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+    glActiveTexture(GL_TEXTURE0);
+
+    historyWidth = width;
+    historyHeight = height;
+    historyValid = true;
+    previousCamera = camera;
+    return history[current];
+}
+
+void TemporalAA::blitToWindow() {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, historyFBO[current]);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// renderMode that traces one jittered ray per pixel and resolves it temporally
+#define TAA_RENDER_MODE 5
+// Length of the Halton(2, 3) jitter sequence
+#define TAA_SAMPLES 8
+// Share of the blended result taken from the reprojected history
+#define TAA_HISTORY_WEIGHT 0.9f
+
+// Radical inverse of index in the given base, in [0, 1)
+float halton(unsigned index, unsigned base);
+
+struct TemporalCamera {
+    glm::vec3 position;
+    glm::vec3 target;
+    float scroll;
+};
+
+// Temporal antialiasing: instead of several rays per pixel every frame, one
+// ray with a subpixel jitter that changes each frame, accumulated into a
+// history buffer by shaders/taa.glsl. The scene pass writes its colour and
+// the hit distance (fragment.glsl outputs 0 and 1) into offscreen textures;
+// resolve() reprojects the history using the previous frame's camera and
+// blends into the other of two ping-ponged history textures.
+//
+// Like DynamicResolution the textures only grow, and a frame uses their lower
+// left corner, so the render size may change from frame to frame.
+class TemporalAA {
+public:
+    TemporalAA() = default;
+    TemporalAA(const TemporalAA&) = delete;
+    TemporalAA& operator=(const TemporalAA&) = delete;
+    ~TemporalAA() { destroy(); }
+
+    // resolveProgram is the linked shaders/taa.glsl program (not owned)
+    bool create(GLuint resolveProgram);
+    void destroy();
+
+    // Drops the history, e.g. after the image was produced some other way
+    void reset() { historyValid = false; }
+
+    // Binds the scene target and viewport for a width x height frame and
+    // advances the jitter
+    void begin(int width, int height);
+    // Subpixel offset for this frame's rays (u_jitter), in [-0.5, 0.5]
+    glm::vec2 jitter() const;
+    // Blends the frame into the history using the currently bound vertex array
+    // (the fullscreen quad, 6 vertices). Returns the texture holding the result
+    // in its lower left width x height. Leaves the resolve program bound.
+    GLuint resolve(const TemporalCamera& camera);
+    // Copies the last result to the default framebuffer, when nothing upscales it
+    void blitToWindow();
+
+private:
+    bool resize(int width, int height);
+
+    GLuint program = 0;
+    GLint sizeLoc = -1, historySizeLoc = -1, jitterLoc = -1, historyWeightLoc = -1;
+    GLint camPosLoc = -1, camTargetLoc = -1, scrollLoc = -1;
+    GLint prevCamPosLoc = -1, prevCamTargetLoc = -1, prevScrollLoc = -1;
+
+    GLuint sceneFBO = 0;
+    GLuint sceneColor = 0;
+    GLuint sceneDistance = 0;
+    GLuint historyFBO[2] = {};
+    GLuint history[2] = {};
+    int textureWidth = 0, textureHeight = 0;
+
+    int width = 0, height = 0;               // this frame
+    int historyWidth = 0, historyHeight = 0; // the frame in history[current]
+    int current = 0;
+    unsigned frame = 0;
+    bool historyValid = false;
+    TemporalCamera previousCamera = {};
+};
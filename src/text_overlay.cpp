@@ -0,0 +1,174 @@
+#include "text_overlay.h"
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include <algorithm>
+#include <iostream>
+
+// Atlas width in texels; it grows downwards as rows of glyphs fill up
+#define TEXT_OVERLAY_ATLAS_WIDTH 512
+// Pixels between the window edge, the backdrop edge and the text
+#define TEXT_OVERLAY_MARGIN 8
+#define TEXT_OVERLAY_PADDING 6
+
+bool TextOverlay::create(GLuint overlayProgram, const std::string& fontPath, int pixelSize) {
+    destroy();
+
+    FT_Library library;
+    if (FT_Init_FreeType(&library)) {
+        std::cerr << "Failed to initialize FreeType\n";
+        return false;
+    }
+    FT_Face face;
+    if (FT_New_Face(library, fontPath.c_str(), 0, &face)) {
+        std::cerr << "Failed to load font: " << fontPath << "\n";
+        FT_Done_FreeType(library);
+        return false;
+    }
+    FT_Set_Pixel_Sizes(face, 0, pixelSize);
+    lineHeight = (int)(face->size->metrics.height >> 6);
+    ascender = (int)(face->size->metrics.ascender >> 6);
+
+    // Shelf packing: glyphs left to right, a new row when one doesn't fit
+    std::vector<unsigned char> pixels;
+    int penX = 0, penY = 0, rowHeight = 0;
+    for (int c = TEXT_OVERLAY_FIRST_CHAR; c <= TEXT_OVERLAY_LAST_CHAR; c++) {
+        Glyph& glyph = glyphs[c - TEXT_OVERLAY_FIRST_CHAR];
+        glyph = Glyph();
+        if (FT_Load_Char(face, c, FT_LOAD_RENDER)) continue;
+
+        const FT_Bitmap& bitmap = face->glyph->bitmap;
+        glyph.width = std::min((int)bitmap.width, TEXT_OVERLAY_ATLAS_WIDTH);
+        glyph.height = (int)bitmap.rows;
+        glyph.bearingX = face->glyph->bitmap_left;
+        glyph.bearingY = face->glyph->bitmap_top;
+        glyph.advance = (int)(face->glyph->advance.x >> 6);
+
+        if (penX + glyph.width > TEXT_OVERLAY_ATLAS_WIDTH) {
+            penX = 0;
+            penY += rowHeight + 1;
+            rowHeight = 0;
+        }
+        glyph.x = penX;
+        glyph.y = penY;
+        rowHeight = std::max(rowHeight, glyph.height);
+        pixels.resize((size_t)(penY + rowHeight) * TEXT_OVERLAY_ATLAS_WIDTH, 0);
+        for (int row = 0; row < glyph.height; row++) {
+            std::copy_n(bitmap.buffer + row * bitmap.pitch, glyph.width,
+                        pixels.begin() + (size_t)(penY + row) * TEXT_OVERLAY_ATLAS_WIDTH + penX);
+        }
+        penX += glyph.width + 1;
+    }
+    FT_Done_Face(face);
+    FT_Done_FreeType(library);
+
+    int atlasHeight = std::max(penY + rowHeight, 1);
+    pixels.resize((size_t)atlasHeight * TEXT_OVERLAY_ATLAS_WIDTH, 0);
+    glGenTextures(1, &atlas);
+    glBindTexture(GL_TEXTURE_2D, atlas);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_R8, TEXT_OVERLAY_ATLAS_WIDTH, atlasHeight);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, TEXT_OVERLAY_ATLAS_WIDTH, atlasHeight, GL_RED, GL_UNSIGNED_BYTE, pixels.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    program = overlayProgram;
+    viewportLoc = glGetUniformLocation(program, "u_viewport");
+    textColorLoc = glGetUniformLocation(program, "u_textColor");
+
+    GLint previousArray = 0;
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousArray);
+    glGenVertexArrays(1, &vertexArray);
+    glGenBuffers(1, &vertexBuffer);
+    glBindVertexArray(vertexArray);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
+    glBindVertexArray(previousArray);
+    bufferFloats = 0;
+    return program != 0;
+}
+
+void TextOverlay::destroy() {
+    if (!atlas) return;
+
+    glDeleteTextures(1, &atlas);
+    glDeleteBuffers(1, &vertexBuffer);
+    glDeleteVertexArrays(1, &vertexArray);
+    atlas = vertexBuffer = vertexArray = 0;
+    program = 0;
+}
+
+void TextOverlay::draw(const std::vector<std::string>& lines, int windowWidth, int windowHeight) {
+    if (!atlas || lines.empty()) return;
+
+    auto quad = [this](float x0, float y0, float x1, float y1, float u0, float v0, float u1, float v1) {
+        const float corners[6][4] = {
+            { x0, y0, u0, v0 }, { x1, y0, u1, v0 }, { x1, y1, u1, v1 },
+            { x0, y0, u0, v0 }, { x1, y1, u1, v1 }, { x0, y1, u0, v1 }
+        };
+        vertices.insert(vertices.end(), &corners[0][0], &corners[0][0] + 24);
+    };
+
+    auto glyphOf = [this](char c) -> const Glyph& {
+        if (c < TEXT_OVERLAY_FIRST_CHAR || c > TEXT_OVERLAY_LAST_CHAR) c = '?';
+        return glyphs[c - TEXT_OVERLAY_FIRST_CHAR];
+    };
+
+    // Backdrop behind the widest line, then the glyphs
+    int textWidth = 0;
+    for (const std::string& line : lines) {
+        int width = 0;
+        for (char c : line) width += glyphOf(c).advance;
+        textWidth = std::max(textWidth, width);
+    }
+    int originX = TEXT_OVERLAY_MARGIN + TEXT_OVERLAY_PADDING;
+    vertices.clear();
+    quad((float)TEXT_OVERLAY_MARGIN, (float)TEXT_OVERLAY_MARGIN,
+         (float)(originX + textWidth + TEXT_OVERLAY_PADDING),
+         (float)(TEXT_OVERLAY_MARGIN + 2 * TEXT_OVERLAY_PADDING + lineHeight * (int)lines.size()),
+         -1.0f, -1.0f, -1.0f, -1.0f);
+
+    int baseline = TEXT_OVERLAY_MARGIN + TEXT_OVERLAY_PADDING + ascender;
+    for (const std::string& line : lines) {
+        int penX = originX;
+        for (char c : line) {
+            const Glyph& glyph = glyphOf(c);
+            if (glyph.width > 0 && glyph.height > 0) {
+                float x = (float)(penX + glyph.bearingX);
+                float y = (float)(baseline - glyph.bearingY);
+                quad(x, y, x + glyph.width, y + glyph.height,
+                     (float)glyph.x, (float)glyph.y, (float)(glyph.x + glyph.width), (float)(glyph.y + glyph.height));
+            }
+            penX += glyph.advance;
+        }
+        baseline += lineHeight;
+    }
+
+    GLint previousArray = 0;
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousArray);
+    glBindVertexArray(vertexArray);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    // Orphaned every frame, the overlay is tiny
+    if (vertices.size() > bufferFloats) {
+        bufferFloats = vertices.size() * 2;
+    }
+    glBufferData(GL_ARRAY_BUFFER, bufferFloats * sizeof(float), nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(float), vertices.data());
+
+    glViewport(0, 0, windowWidth, windowHeight);
+    glUseProgram(program);
+    glUniform2f(viewportLoc, (float)windowWidth, (float)windowHeight);
+    glUniform4f(textColorLoc, 1.0f, 1.0f, 1.0f, 1.0f);
+    glActiveTexture(GL_TEXTURE0 + TEXT_OVERLAY_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, atlas);
+    glActiveTexture(GL_TEXTURE0);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glDrawArrays(GL_TRIANGLES, 0, (GLsizei)(vertices.size() / 4));
+    glDisable(GL_BLEND);
+    glBindVertexArray(previousArray);
+}
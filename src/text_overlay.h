@@ -0,0 +1,51 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+
+// Texture unit of the glyph atlas (u_glyphs in shaders/overlay.glsl), after the tiled path's 13-14
+#define TEXT_OVERLAY_TEXTURE_UNIT 15
+// First and last character in the atlas, printable ASCII
+#define TEXT_OVERLAY_FIRST_CHAR 32
+#define TEXT_OVERLAY_LAST_CHAR 126
+
+// Lines of text in the top left corner of the window, e.g. the performance
+// readout. create() rasterizes the printable ASCII characters of a font with
+// FreeType into one R8 atlas; draw() lays the lines out as pixel aligned
+// quads over a translucent backdrop and blends them in, so the glyphs are
+// sampled 1:1 without filtering.
+class TextOverlay {
+public:
+    TextOverlay() = default;
+    TextOverlay(const TextOverlay&) = delete;
+    TextOverlay& operator=(const TextOverlay&) = delete;
+    ~TextOverlay() { destroy(); }
+
+    // overlayProgram is the linked overlay_vertex.glsl/overlay.glsl program
+    // (not owned); fontPath any font FreeType can open, pixelSize its height
+    bool create(GLuint overlayProgram, const std::string& fontPath, int pixelSize);
+    void destroy();
+
+    // Draws into the bound framebuffer, which is windowWidth x windowHeight.
+    // Restores the vertex array binding; leaves the overlay program bound.
+    void draw(const std::vector<std::string>& lines, int windowWidth, int windowHeight);
+
+private:
+    struct Glyph {
+        int x = 0, y = 0;               // top left in the atlas
+        int width = 0, height = 0;
+        int bearingX = 0, bearingY = 0; // from the pen position to the bitmap's top left
+        int advance = 0;
+    };
+
+    GLuint program = 0;
+    GLint viewportLoc = -1, textColorLoc = -1;
+    GLuint atlas = 0;
+    GLuint vertexArray = 0, vertexBuffer = 0;
+    size_t bufferFloats = 0;
+    std::vector<float> vertices; // x, y, u, v per vertex
+    Glyph glyphs[TEXT_OVERLAY_LAST_CHAR - TEXT_OVERLAY_FIRST_CHAR + 1];
+    int lineHeight = 0, ascender = 0;
+};
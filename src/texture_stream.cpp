@@ -0,0 +1,401 @@
+#include "texture_stream.h"
+
+#include "gl_ext.h"
+#include "program_cache.h"
+
+#include <SOIL.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+
+// Bumped when the encoder changes, so old cache entries are ignored
+#define TEXTURE_CACHE_VERSION "bc1-1"
+
+static const uint8_t KTX_IDENTIFIER[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+
+struct KtxHeader {
+    uint8_t identifier[12];
+    uint32_t endianness;
+    uint32_t glType, glTypeSize, glFormat, glInternalFormat, glBaseInternalFormat;
+    uint32_t pixelWidth, pixelHeight, pixelDepth;
+    uint32_t numberOfArrayElements, numberOfFaces, numberOfMipmapLevels;
+    uint32_t bytesOfKeyValueData;
+};
+
+// Halves the previous level with a box filter until it is 1x1, like glGenerateMipmap
+static void buildMips(std::vector<TextureLevel>& levels) {
+    while (levels.back().width > 1 || levels.back().height > 1) {
+        const TextureLevel& src = levels.back();
+        TextureLevel dst = { std::max(src.width / 2, 1), std::max(src.height / 2, 1), {} };
+        dst.data.resize((size_t)dst.width * dst.height * 4);
+        for (int y = 0; y < dst.height; y++) {
+            int y0 = std::min(2 * y, src.height - 1), y1 = std::min(2 * y + 1, src.height - 1);
+            for (int x = 0; x < dst.width; x++) {
+                int x0 = std::min(2 * x, src.width - 1), x1 = std::min(2 * x + 1, src.width - 1);
+                for (int c = 0; c < 4; c++) {
+                    int sum = src.data[((size_t)y0 * src.width + x0) * 4 + c] + src.data[((size_t)y0 * src.width + x1) * 4 + c] +
+                              src.data[((size_t)y1 * src.width + x0) * 4 + c] + src.data[((size_t)y1 * src.width + x1) * 4 + c];
+                    dst.data[((size_t)y * dst.width + x) * 4 + c] = (uint8_t)((sum + 2) / 4);
+                }
+            }
+        }
+        levels.push_back(std::move(dst));
+    }
+}
+
+static uint16_t to565(const int rgb[3]) {
+    return (uint16_t)(((rgb[0] >> 3) << 11) | ((rgb[1] >> 2) << 5) | (rgb[2] >> 3));
+}
+
+static void from565(uint16_t c, int rgb[3]) {
+    int r = c >> 11, g = (c >> 5) & 63, b = c & 31;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+// One 4x4 block of RGBA pixels to BC1, opaque four colour mode. The
+// endpoints are the corners of the colour bounding box, inset by a sixteenth
+// of its size so the interpolated colours land closer to the pixels.
+static void encodeBC1Block(const uint8_t pixels[16][4], uint8_t out[8]) {
+    int lo[3] = { 255, 255, 255 }, hi[3] = { 0, 0, 0 };
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < 3; c++) {
+            lo[c] = std::min(lo[c], (int)pixels[i][c]);
+            hi[c] = std::max(hi[c], (int)pixels[i][c]);
+        }
+    }
+    for (int c = 0; c < 3; c++) {
+        int inset = (hi[c] - lo[c]) >> 4;
+        lo[c] += inset;
+        hi[c] -= inset;
+    }
+    uint16_t c0 = to565(hi), c1 = to565(lo);
+    if (c0 < c1) std::swap(c0, c1);
+
+    uint32_t indices = 0;
+    if (c0 != c1) {
+        int palette[4][3];
+        from565(c0, palette[0]);
+        from565(c1, palette[1]);
+        for (int c = 0; c < 3; c++) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        for (int i = 0; i < 16; i++) {
+            int best = 0, bestDist = 1 << 30;
+            for (int p = 0; p < 4; p++) {
+                int dist = 0;
+                for (int c = 0; c < 3; c++) {
+                    int d = (int)pixels[i][c] - palette[p][c];
+                    dist += d * d;
+                }
+                if (dist < bestDist) {
+                    bestDist = dist;
+                    best = p;
+                }
+            }
+            indices |= (uint32_t)best << (2 * i);
+        }
+    }
+    out[0] = (uint8_t)(c0 & 0xFF);
+    out[1] = (uint8_t)(c0 >> 8);
+    out[2] = (uint8_t)(c1 & 0xFF);
+    out[3] = (uint8_t)(c1 >> 8);
+    for (int i = 0; i < 4; i++) out[4 + i] = (uint8_t)(indices >> (8 * i));
+}
+
+// RGBA8 level to BC1 blocks, edge blocks repeat the last row and column
+static std::vector<uint8_t> compressBC1(int width, int height, const std::vector<uint8_t>& rgba) {
+    int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+    std::vector<uint8_t> blocks((size_t)blocksX * blocksY * 8);
+    uint8_t pixels[16][4];
+    for (int by = 0; by < blocksY; by++) {
+        for (int bx = 0; bx < blocksX; bx++) {
+            for (int i = 0; i < 16; i++) {
+                int x = std::min(bx * 4 + (i & 3), width - 1);
+                int y = std::min(by * 4 + (i >> 2), height - 1);
+                memcpy(pixels[i], &rgba[((size_t)y * width + x) * 4], 4);
+            }
+            encodeBC1Block(pixels, &blocks[((size_t)by * blocksX + bx) * 8]);
+        }
+    }
+    return blocks;
+}
+
+static bool loadKtx(const std::string& path, GLenum format, std::vector<TextureLevel>& levels) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) return false;
+
+    KtxHeader header;
+    if (!file.read((char*)&header, sizeof(header)) || memcmp(header.identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER)) != 0 ||
+        header.endianness != 0x04030201u || header.glInternalFormat != format || header.numberOfMipmapLevels == 0) {
+        return false;
+    }
+    file.seekg(header.bytesOfKeyValueData, std::ios::cur);
+    levels.clear();
+    for (uint32_t i = 0; i < header.numberOfMipmapLevels; i++) {
+        uint32_t size = 0;
+        if (!file.read((char*)&size, sizeof(size))) return false;
+        TextureLevel level = { (int)std::max(header.pixelWidth >> i, 1u), (int)std::max(header.pixelHeight >> i, 1u), {} };
+        level.data.resize(size);
+        if (!file.read((char*)level.data.data(), size)) return false;
+        file.seekg((4 - size % 4) % 4, std::ios::cur);
+        levels.push_back(std::move(level));
+    }
+    return true;
+}
+
+static void saveKtx(const std::string& path, GLenum format, const std::vector<TextureLevel>& levels) {
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+
+    // Same as the program cache: never leave a truncated file behind
+    std::string tempPath = path + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary);
+        if (!file.is_open()) {
+            std::cerr << "Failed to write texture cache: " << path << std::endl;
+            return;
+        }
+        bool compressed = format != GL_RGBA8;
+        KtxHeader header = {};
+        memcpy(header.identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER));
+        header.endianness = 0x04030201u;
+        header.glType = compressed ? 0 : GL_UNSIGNED_BYTE;
+        header.glTypeSize = 1;
+        header.glFormat = compressed ? 0 : GL_RGBA;
+        header.glInternalFormat = format;
+        header.glBaseInternalFormat = compressed ? GL_RGB : GL_RGBA;
+        header.pixelWidth = (uint32_t)levels[0].width;
+        header.pixelHeight = (uint32_t)levels[0].height;
+        header.numberOfFaces = 1;
+        header.numberOfMipmapLevels = (uint32_t)levels.size();
+        file.write((const char*)&header, sizeof(header));
+        static const uint8_t padding[3] = {};
+        for (const TextureLevel& level : levels) {
+            uint32_t size = (uint32_t)level.data.size();
+            file.write((const char*)&size, sizeof(size));
+            file.write((const char*)level.data.data(), size);
+            file.write((const char*)padding, (4 - size % 4) % 4);
+        }
+    }
+    std::filesystem::rename(tempPath, path, error);
+    if (error) {
+        std::cerr << "Failed to write texture cache: " << path << std::endl;
+    }
+}
+
+bool TextureStreamer::create(const std::string& textureCacheDir) {
+    destroy();
+    cacheDir = textureCacheDir;
+    format = hasS3TC() ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_RGBA8;
+    glGenBuffers(1, &unpackBuffer);
+    stopping = false;
+
+    unsigned cores = std::thread::hardware_concurrency();
+    int count = std::min(std::max((int)cores - 1, 1), TEXTURE_STREAM_MAX_THREADS);
+    for (int i = 0; i < count; i++) {
+        threads.emplace_back(&TextureStreamer::worker, this);
+    }
+    return true;
+}
+
+void TextureStreamer::destroy() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        queue.clear();
+    }
+    wake.notify_all();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    threads.clear();
+    jobs.clear();
+    pendingCount = 0;
+    if (unpackBuffer) {
+        glDeleteBuffers(1, &unpackBuffer);
+        unpackBuffer = 0;
+    }
+}
+
+GLuint TextureStreamer::request(const std::string& path) {
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    static const uint8_t grey[4] = { 128, 128, 128, 255 };
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    std::shared_ptr<Job> job = std::make_shared<Job>();
+    job->path = path;
+    job->texture = texture;
+    job->format = format;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(job);
+        jobs.push_back(job);
+    }
+    wake.notify_one();
+    if (pendingCount++ == 0) {
+        firstRequest = std::chrono::steady_clock::now();
+        loadedCount = cachedCount = 0;
+    }
+    return texture;
+}
+
+void TextureStreamer::worker() {
+    for (;;) {
+        std::shared_ptr<Job> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this]() { return stopping || !queue.empty(); });
+            if (stopping) return;
+            job = queue.front();
+            queue.pop_front();
+        }
+        load(*job);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job->done = true;
+        }
+        loaded.notify_all();
+    }
+}
+
+// On a worker thread: the mip chain from the cache, or decoded, filtered and compressed
+void TextureStreamer::load(Job& job) const {
+    std::ifstream file(job.path, std::ios::binary);
+    std::string bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (!file.is_open() || bytes.empty()) {
+        job.failed = true;
+        return;
+    }
+
+    std::string cachePath;
+    if (!cacheDir.empty()) {
+        uint64_t hash = hashString(bytes);
+        hash = hashString(TEXTURE_CACHE_VERSION + std::to_string(job.format), hash);
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.ktx", (unsigned long long)hash);
+        cachePath = (std::filesystem::path(cacheDir) / name).string();
+        if (loadKtx(cachePath, job.format, job.levels)) {
+            job.fromCache = true;
+            return;
+        }
+    }
+
+    int width, height;
+    unsigned char* image = SOIL_load_image_from_memory((const unsigned char*)bytes.data(), (int)bytes.size(), &width, &height, 0, SOIL_LOAD_RGBA);
+    if (!image) {
+        job.failed = true;
+        return;
+    }
+    job.levels.assign(1, TextureLevel{ width, height, std::vector<uint8_t>(image, image + (size_t)width * height * 4) });
+    SOIL_free_image_data(image);
+
+    buildMips(job.levels);
+    if (job.format != GL_RGBA8) {
+        for (TextureLevel& level : job.levels) {
+            level.data = compressBC1(level.width, level.height, level.data);
+        }
+    }
+    if (!cachePath.empty()) {
+        saveKtx(cachePath, job.format, job.levels);
+    }
+}
+
+// On the GL thread: all levels through the unpack buffer, then the texture is complete again
+void TextureStreamer::upload(const Job& job) {
+    size_t total = 0;
+    for (const TextureLevel& level : job.levels) total += level.data.size();
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, unpackBuffer);
+    // Orphaned, so a previous upload the GPU is still reading from never blocks the map
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, total, nullptr, GL_STREAM_DRAW);
+    uint8_t* mapped = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, total, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (!mapped) {
+        std::cerr << "Failed to map texture upload buffer for " << job.path << std::endl;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return;
+    }
+    size_t offset = 0;
+    for (const TextureLevel& level : job.levels) {
+        memcpy(mapped + offset, level.data.data(), level.data.size());
+        offset += level.data.size();
+    }
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    glBindTexture(GL_TEXTURE_2D, job.texture);
+    offset = 0;
+    for (size_t i = 0; i < job.levels.size(); i++) {
+        const TextureLevel& level = job.levels[i];
+        if (job.format == GL_RGBA8) {
+            glTexImage2D(GL_TEXTURE_2D, (GLint)i, GL_RGBA8, level.width, level.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, (const void*)offset);
+        } else {
+            glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)i, job.format, level.width, level.height, 0,
+                                   (GLsizei)level.data.size(), (const void*)offset);
+        }
+        offset += level.data.size();
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)job.levels.size() - 1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void TextureStreamer::update() {
+    if (pendingCount == 0) return;
+
+    // In request order; the ones still loading stay for a later frame
+    std::vector<std::shared_ptr<Job>> finished;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const std::shared_ptr<Job>& job : jobs) {
+            if (job->done) finished.push_back(job);
+        }
+    }
+    size_t bytes = 0;
+    for (const std::shared_ptr<Job>& job : finished) {
+        if (bytes >= TEXTURE_STREAM_FRAME_BYTES) break;
+        if (job->failed) {
+            std::cerr << "Failed to load texture: " << job->path << std::endl;
+        } else {
+            upload(*job);
+            for (const TextureLevel& level : job->levels) bytes += level.data.size();
+            loadedCount++;
+            cachedCount += job->fromCache;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.erase(std::find(jobs.begin(), jobs.end(), job));
+        pendingCount--;
+    }
+    if (pendingCount == 0) {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - firstRequest).count();
+        std::cout << "Textures: " << loadedCount << " loaded (" << cachedCount << " from cache) in "
+                  << std::fixed << std::setprecision(2) << seconds << std::defaultfloat << " s\n";
+    }
+}
+
+void TextureStreamer::finish() {
+    while (pendingCount > 0) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            loaded.wait(lock, [this]() {
+                return std::any_of(jobs.begin(), jobs.end(), [](const std::shared_ptr<Job>& job) { return job->done; });
+            });
+        }
+        update();
+    }
+}
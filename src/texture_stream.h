@@ -0,0 +1,90 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Bytes uploaded per update() before the rest waits for the next frame; a
+// texture's levels always go up together, so one larger texture can exceed it
+#define TEXTURE_STREAM_FRAME_BYTES (4 << 20)
+// Decode threads at most, the rest of the cores are left to the driver
+#define TEXTURE_STREAM_MAX_THREADS 4
+
+// One mip level, RGBA8 pixels or BC1 blocks
+struct TextureLevel {
+    int width, height;
+    std::vector<uint8_t> data;
+};
+
+// Texture loading that doesn't hold up the render loop. request() returns a
+// texture right away with a 1x1 grey placeholder in it; worker threads decode
+// the image with SOIL, build the mip chain and block compress it (BC1, when
+// EXT_texture_compression_s3tc is there), and update() uploads finished
+// images on the GL thread through a pixel unpack buffer, so the copy to the
+// GPU is asynchronous and only a bounded amount lands in any frame. The
+// texture ID never changes, its levels are respecified in place.
+//
+// The compressed mip chains are written to the cache directory as KTX 1.1
+// files keyed by a hash of the image file, like the shader and SDF caches, so
+// later launches skip decoding, mip generation and compression entirely.
+class TextureStreamer {
+public:
+    TextureStreamer() = default;
+    TextureStreamer(const TextureStreamer&) = delete;
+    TextureStreamer& operator=(const TextureStreamer&) = delete;
+    ~TextureStreamer() { destroy(); }
+
+    // cacheDir may be empty to disable the cache. Call after loadGLExtensions().
+    bool create(const std::string& cacheDir);
+    // Stops the workers, the textures stay alive and are the caller's to delete
+    void destroy();
+
+    // A repeating, trilinear filtered texture that will hold the image at path
+    GLuint request(const std::string& path);
+
+    // Call once per frame on the GL thread: uploads what the workers finished
+    void update();
+    // Blocks until every requested texture is uploaded, e.g. before a benchmark
+    void finish();
+
+    // Requested textures not uploaded yet
+    int pending() const { return pendingCount; }
+
+private:
+    struct Job {
+        std::string path;
+        GLuint texture = 0;
+        bool done = false;
+        bool failed = false;
+        bool fromCache = false;
+        GLenum format = 0;
+        std::vector<TextureLevel> levels;
+    };
+
+    void worker();
+    void load(Job& job) const;
+    void upload(const Job& job);
+
+    std::string cacheDir;
+    GLenum format = GL_RGBA8; // GL_COMPRESSED_RGB_S3TC_DXT1_EXT when the driver has it
+    GLuint unpackBuffer = 0;
+    int pendingCount = 0;
+    int loadedCount = 0, cachedCount = 0; // since pendingCount was last 0, for the log line
+    std::chrono::steady_clock::time_point firstRequest;
+
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake;    // workers wait for queued jobs
+    std::condition_variable loaded;  // finish() waits for workers
+    std::deque<std::shared_ptr<Job>> queue;    // not started yet
+    std::vector<std::shared_ptr<Job>> jobs;    // requested, not uploaded yet
+    bool stopping = false;
+};
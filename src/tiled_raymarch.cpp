@@ -0,0 +1,79 @@
+#include "tiled_raymarch.h"
+
+#include <algorithm>
+
+bool TiledRaymarch::create(GLuint computeProgram, GLuint presentProgram) {
+    destroy();
+    program = computeProgram;
+    present = presentProgram;
+    resolutionLoc = glGetUniformLocation(program, "u_resolution");
+    timeLoc = glGetUniformLocation(program, "u_time");
+    scrollLoc = glGetUniformLocation(program, "u_scroll");
+    camPosLoc = glGetUniformLocation(program, "u_camPos");
+    camTargetLoc = glGetUniformLocation(program, "u_camTarget");
+    flashlightLoc = glGetUniformLocation(program, "u_flashlight");
+    renderModeLoc = glGetUniformLocation(program, "u_renderMode");
+    jitterLoc = glGetUniformLocation(program, "u_jitter");
+    prepassTileLoc = glGetUniformLocation(program, "u_prepassTile");
+    lightCountLoc = glGetUniformLocation(program, "u_lightCount");
+    relaxedMarchLoc = glGetUniformLocation(program, "u_relaxedMarch");
+    return program && present;
+}
+
+void TiledRaymarch::destroy() {
+    glDeleteTextures(1, &colorTexture);
+    glDeleteTextures(1, &distanceTexture);
+    colorTexture = distanceTexture = 0;
+    textureWidth = textureHeight = 0;
+    program = present = 0;
+}
+
+void TiledRaymarch::resize(int width, int height) {
+    glDeleteTextures(1, &colorTexture);
+    glDeleteTextures(1, &distanceTexture);
+    GLuint* textures[2] = { &colorTexture, &distanceTexture };
+    GLenum formats[2] = { GL_RGBA8, GL_R32F };
+    for (int i = 0; i < 2; i++) {
+        glGenTextures(1, textures[i]);
+        glBindTexture(GL_TEXTURE_2D, *textures[i]);
+        glTexStorage2D(GL_TEXTURE_2D, 1, formats[i], width, height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    textureWidth = width;
+    textureHeight = height;
+}
+
+void TiledRaymarch::render(const TiledFrame& frame) {
+    int width = std::max(frame.width, 1);
+    int height = std::max(frame.height, 1);
+    if (width > textureWidth || height > textureHeight) {
+        resize(std::max(width, textureWidth), std::max(height, textureHeight));
+    }
+
+    glUseProgram(program);
+    glUniform2f(resolutionLoc, (float)width, (float)height);
+    glUniform1f(timeLoc, frame.time);
+    glUniform1f(scrollLoc, frame.scroll);
+    glUniform3fv(camPosLoc, 1, &frame.camPos[0]);
+    glUniform3fv(camTargetLoc, 1, &frame.camTarget[0]);
+    glUniform1i(flashlightLoc, frame.flashlight);
+    glUniform1i(renderModeLoc, frame.renderMode);
+    glUniform2fv(jitterLoc, 1, &frame.jitter[0]);
+    glUniform1i(prepassTileLoc, frame.prepassTile);
+    glUniform1i(lightCountLoc, frame.lightCount);
+    glUniform1i(relaxedMarchLoc, frame.relaxedMarch);
+    glBindImageTexture(TILED_IMAGE_UNIT, colorTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+    glBindImageTexture(TILED_IMAGE_UNIT + 1, distanceTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+    glDispatchCompute((width + TILED_SIZE - 1) / TILED_SIZE, (height + TILED_SIZE - 1) / TILED_SIZE, 1);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    glUseProgram(present);
+    glActiveTexture(GL_TEXTURE0 + TILED_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, colorTexture);
+    glActiveTexture(GL_TEXTURE0 + TILED_TEXTURE_UNIT + 1);
+    glBindTexture(GL_TEXTURE_2D, distanceTexture);
+    glActiveTexture(GL_TEXTURE0);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+}
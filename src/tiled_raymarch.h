@@ -0,0 +1,66 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// Pixels per workgroup along each axis, must match TILE_SIZE in raymarch_tiled.glsl
+#define TILED_SIZE 8
+// Texture units the present pass reads (u_color, u_hitDistance in tiled_present.glsl)
+#define TILED_TEXTURE_UNIT 13
+// Image units the compute shader writes, unit 0 is the SDF bake and 1 the shadow pass
+#define TILED_IMAGE_UNIT 2
+
+// What the scene pass needs for a frame, the uniforms fragment.glsl reads
+struct TiledFrame {
+    int width, height;
+    float time;
+    float scroll;
+    glm::vec3 camPos;
+    glm::vec3 camTarget;
+    bool flashlight;
+    int renderMode;
+    glm::vec2 jitter;
+    int prepassTile;  // 0 without the depth prepass
+    int lightCount;
+    bool relaxedMarch;
+};
+
+// Tiled compute path: instead of drawing fragment.glsl on the fullscreen
+// quad, shaders/raymarch_tiled.glsl is dispatched over TILED_SIZE x TILED_SIZE
+// tiles. Each workgroup culls the primitives against its tile's bounding cone
+// in shared memory first, so its primary rays are marched against only those
+// that can be hit. The result goes to a colour and a hit distance image, which
+// shaders/tiled_present.glsl then draws into whatever target the scene pass
+// would have drawn to, so dynamic resolution and TAA work unchanged.
+//
+// It shades in the compute shader like the forward path, the deferred
+// G-buffer isn't used. Like the other targets the images only grow, and a
+// frame uses their lower left corner.
+class TiledRaymarch {
+public:
+    TiledRaymarch() = default;
+    TiledRaymarch(const TiledRaymarch&) = delete;
+    TiledRaymarch& operator=(const TiledRaymarch&) = delete;
+    ~TiledRaymarch() { destroy(); }
+
+    // The linked raymarch_tiled.glsl and tiled_present.glsl programs (not owned)
+    bool create(GLuint computeProgram, GLuint presentProgram);
+    void destroy();
+
+    // Renders the frame and draws it into the bound framebuffer with the
+    // current viewport and vertex array (the fullscreen quad, 6 vertices).
+    // Leaves the present program bound.
+    void render(const TiledFrame& frame);
+
+private:
+    void resize(int width, int height);
+
+    GLuint program = 0;
+    GLuint present = 0;
+    GLint resolutionLoc = -1, timeLoc = -1, scrollLoc = -1, camPosLoc = -1, camTargetLoc = -1;
+    GLint flashlightLoc = -1, renderModeLoc = -1, jitterLoc = -1, prepassTileLoc = -1, lightCountLoc = -1;
+    GLint relaxedMarchLoc = -1;
+    GLuint colorTexture = 0;
+    GLuint distanceTexture = 0;
+    int textureWidth = 0, textureHeight = 0;
+};